@@ -0,0 +1,80 @@
+import functools
+import math
+from array import array
+from io import BytesIO
+import sys
+
+import pytest
+
+import mp3
+
+
+def generate_pcm(sample_rate, channels, duration_s, frequency=440.0):
+    """
+    Generate a synthetic signal (a sine tone with a slow amplitude modulation), 16-bit signed interleaved.
+    """
+    nsamples = int(sample_rate * duration_s)
+    step = 2.0 * math.pi * frequency / sample_rate
+    samples = array('h')
+    for i in range(nsamples):
+        amplitude = 8000.0 + 6000.0 * math.sin(2.0 * math.pi * i / sample_rate)
+        value = int(amplitude * math.sin(step * i))
+        for ch in range(channels):
+            # Shift phase of the second channel to make stereo channels different
+            samples.append(value if ch == 0 else int(amplitude * math.sin(step * i + 1.0)))
+
+    if sys.byteorder != 'little':
+        samples.byteswap()
+
+    return samples.tobytes()
+
+
+def encode_mp3(pcm_data, sample_rate, channels, bit_rate):
+    """
+    Encode 16-bit PCM data into MP3 (CBR)
+    """
+    fp = BytesIO()
+    encoder = mp3.Encoder(fp)
+    encoder.set_channels(channels)
+    encoder.set_sample_rate(sample_rate)
+    encoder.set_bit_rate(bit_rate)
+    encoder.set_mode(mp3.MODE_JOINT_STEREO if channels == 2 else mp3.MODE_SINGLE_CHANNEL)
+    encoder.set_quality(5)
+
+    chunk_size = 8192 * channels
+    for pos in range(0, len(pcm_data), chunk_size):
+        encoder.write(pcm_data[pos:pos + chunk_size])
+    encoder.flush()
+
+    return fp.getvalue()
+
+
+@functools.lru_cache(maxsize=None)
+def synthetic_audio(sample_rate, channels, bit_rate, duration_s):
+    """
+    Synthetic signal as a tuple of (PCM data, MP3 data), cached for the whole session
+    """
+    pcm_data = generate_pcm(sample_rate, channels, duration_s)
+    return pcm_data, encode_mp3(pcm_data, sample_rate, channels, bit_rate)
+
+
+def peak_rss():
+    """
+    Peak resident set size of the process (in bytes), or None if not supported by the platform
+    """
+    try:
+        import resource
+    except ImportError:
+        return None
+
+    maxrss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # Bytes on macOS, kilobytes on Linux
+    return maxrss if sys.platform == 'darwin' else maxrss * 1024
+
+
+@pytest.fixture(scope='session')
+def mp3_44khz_stereo():
+    """
+    30 seconds of 44100 Hz stereo audio, encoded at 128 kbps
+    """
+    return encode_mp3(generate_pcm(44100, 2, 30.0), 44100, 2, 128)
@@ -0,0 +1,606 @@
+/**
+ * Native benchmark of MP3 encoding/decoding with LAME and libmad, without the Python layer.
+ *
+ * Generates synthetic signals for a matrix of sample rates, bit rates and channel layouts,
+ * encodes them into MP3 and decodes them back, and reports for every case:
+ *  - throughput (x realtime)
+ *  - per-call latency of encoding/decoding one MPEG frame (median, p99, max)
+ *  - allocations per second (when built with malloc wrappers, see CMakeLists.txt)
+ *  - peak RSS of the process
+ *
+ * Results are printed as a table, and optionally written as JSON (--json FILE) to compare releases.
+ *
+ * Usage: pymp3_bench [--duration SECONDS] [--repeat N] [--json FILE] [--quick]
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+#include <mad.h>
+#include <lame/lame.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define MAX_FRAME_SAMPLES 1152          // Maximum number of samples per channel in one MPEG frame
+
+
+/* -----------------------------------------------------------------
+ * Allocation counter
+ * ----------------------------------------------------------------- */
+
+static unsigned long long alloc_count = 0;
+
+/* Keeps the compiler from optimizing the PCM conversion out */
+static volatile short pcm_sink;
+
+#ifdef PYMP3_BENCH_WRAP_MALLOC
+/* The linker redirects malloc/calloc/realloc to these wrappers (-Wl,--wrap=malloc, etc.) */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void *ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    alloc_count++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+    alloc_count++;
+    return __real_calloc(nmemb, size);
+}
+
+void* __wrap_realloc(void *ptr, size_t size)
+{
+    alloc_count++;
+    return __real_realloc(ptr, size);
+}
+
+#define ALLOC_COUNT_SUPPORTED 1
+#else
+#define ALLOC_COUNT_SUPPORTED 0
+#endif
+
+
+/* -----------------------------------------------------------------
+ * Clock and memory
+ * ----------------------------------------------------------------- */
+
+/**
+ * Monotonic time in seconds
+ */
+static double now(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#endif
+}
+
+/**
+ * Peak resident set size of the process (in bytes)
+ */
+static unsigned long long peak_rss(void)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return (unsigned long long) counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return (unsigned long long) usage.ru_maxrss;            // bytes on macOS
+#else
+    return (unsigned long long) usage.ru_maxrss * 1024;     // kilobytes on Linux
+#endif
+#endif
+}
+
+
+/* -----------------------------------------------------------------
+ * Helpers
+ * ----------------------------------------------------------------- */
+
+typedef struct {
+    double *values;
+    size_t count;
+    size_t capacity;
+} samples_t;
+
+static void samples_add(samples_t *s, double value)
+{
+    if (s->count == s->capacity)
+    {
+        size_t capacity = s->capacity ? s->capacity * 2 : 1024;
+        double *values = realloc(s->values, capacity * sizeof(double));
+        if (values == NULL)
+            return;
+        s->values = values;
+        s->capacity = capacity;
+    }
+    s->values[s->count++] = value;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Percentile (0..1) of the collected values, the values are sorted in place
+ */
+static double samples_percentile(samples_t *s, double percentile)
+{
+    if (s->count == 0)
+        return 0.0;
+    qsort(s->values, s->count, sizeof(double), compare_double);
+    size_t index = (size_t) (percentile * (double) (s->count - 1) + 0.5);
+    return s->values[index];
+}
+
+/**
+ * Generate a synthetic signal (a sine tone with a slow amplitude modulation and a bit of noise), 16-bit interleaved.
+ * The second channel is phase shifted, so that stereo channels differ.
+ */
+static short* generate_pcm(int sample_rate, int channels, size_t nsamples)
+{
+    short *pcm = malloc(nsamples * channels * sizeof(short));
+    if (pcm == NULL)
+        return NULL;
+
+    double step = 2.0 * M_PI * 440.0 / sample_rate;
+    unsigned int seed = 12345;
+
+    for (size_t i = 0; i < nsamples; i++)
+    {
+        double amplitude = 8000.0 + 6000.0 * sin(2.0 * M_PI * (double) i / sample_rate);
+        for (int ch = 0; ch < channels; ch++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            double noise = (double) ((seed >> 16) & 0x7ff) - 1024.0;
+            pcm[i * channels + ch] = (short) (amplitude * sin(step * (double) i + ch) + noise);
+        }
+    }
+
+    return pcm;
+}
+
+static void silent_output(const char *format, va_list ap)
+{
+    return;
+}
+
+/**
+ * Convert libmad fixed-point sample into 16-bit integer (same as in the decoder of the Python module)
+ */
+static short madfixed_to_short(mad_fixed_t sample)
+{
+    sample += (1L << (MAD_F_FRACBITS - 16));
+    if (sample >= MAD_F_ONE)
+        sample = MAD_F_ONE - 1;
+    else if (sample < -MAD_F_ONE)
+        sample = -MAD_F_ONE;
+    return (short) (sample >> (MAD_F_FRACBITS + 1 - 16));
+}
+
+
+/* -----------------------------------------------------------------
+ * Benchmark cases
+ * ----------------------------------------------------------------- */
+
+typedef struct {
+    const char *name;
+    int sample_rate;
+    int channels;
+    int bit_rate;
+
+    double audio_seconds;       // duration of audio processed by one run
+    double seconds;             // best time of one run
+    double realtime_factor;
+    double latency_median_us;
+    double latency_p99_us;
+    double latency_max_us;
+    unsigned long long allocations;
+    double allocations_per_second;
+} result_t;
+
+/**
+ * Encode PCM data frame-by-frame. The MP3 data is returned in `*mp3_data` (the caller frees it).
+ *
+ * \return  0 on success, -1 on error
+ */
+static int run_encode(const short *pcm, size_t nsamples, int sample_rate, int channels, int bit_rate,
+                      unsigned char **mp3_data, size_t *mp3_size, samples_t *latency)
+{
+    lame_global_flags *lame = lame_init();
+    if (lame == NULL)
+        return -1;
+
+    lame_set_num_channels(lame, channels);
+    lame_set_in_samplerate(lame, sample_rate);
+    lame_set_brate(lame, bit_rate);
+    lame_set_quality(lame, 5);
+    lame_set_mode(lame, channels == 1 ? MONO : JOINT_STEREO);
+    lame_set_bWriteVbrTag(lame, 0);
+    lame_set_errorf(lame, &silent_output);
+    lame_set_debugf(lame, &silent_output);
+    lame_set_msgf(lame, &silent_output);
+
+    if (lame_init_params(lame) < 0)
+    {
+        lame_close(lame);
+        return -1;
+    }
+
+    /* The worst case estimate of the MP3 size is 1.25 * samples + 7200 per call */
+    size_t capacity = nsamples + nsamples / 4 + 7200 * (nsamples / MAX_FRAME_SAMPLES + 2);
+    unsigned char *output = malloc(capacity);
+    if (output == NULL)
+    {
+        lame_close(lame);
+        return -1;
+    }
+
+    size_t size = 0;
+    int framesize = lame_get_framesize(lame);
+    if (framesize <= 0)
+        framesize = MAX_FRAME_SAMPLES;
+
+    for (size_t offset = 0; offset < nsamples; offset += framesize)
+    {
+        int count = (int) (nsamples - offset < (size_t) framesize ? nsamples - offset : (size_t) framesize);
+        short *block = (short *) pcm + offset * channels;
+        int bytes;
+
+        double started = now();
+        if (channels > 1)
+            bytes = lame_encode_buffer_interleaved(lame, block, count, output + size, (int) (capacity - size));
+        else
+            bytes = lame_encode_buffer(lame, block, block, count, output + size, (int) (capacity - size));
+        if (latency != NULL)
+            samples_add(latency, now() - started);
+
+        if (bytes < 0)
+        {
+            free(output);
+            lame_close(lame);
+            return -1;
+        }
+        size += bytes;
+    }
+
+    int bytes = lame_encode_flush(lame, output + size, (int) (capacity - size));
+    if (bytes > 0)
+        size += bytes;
+
+    lame_close(lame);
+
+    *mp3_data = output;
+    *mp3_size = size;
+    return 0;
+}
+
+/**
+ * Decode MP3 data frame-by-frame into 16-bit PCM
+ *
+ * \return  the number of decoded samples (per channel), or -1 on error
+ */
+static long long run_decode(const unsigned char *mp3_data, size_t mp3_size, samples_t *latency)
+{
+    struct mad_stream stream;
+    struct mad_frame frame;
+    struct mad_synth synth;
+    short pcm[MAX_FRAME_SAMPLES * 2];
+    long long decoded = 0;
+
+    /* libmad needs MAD_BUFFER_GUARD zero bytes after the last frame to decode it */
+    unsigned char *input = calloc(mp3_size + MAD_BUFFER_GUARD, 1);
+    if (input == NULL)
+        return -1;
+    memcpy(input, mp3_data, mp3_size);
+
+    mad_stream_init(&stream);
+    mad_frame_init(&frame);
+    mad_synth_init(&synth);
+    mad_stream_buffer(&stream, input, mp3_size + MAD_BUFFER_GUARD);
+
+    for (;;)
+    {
+        double started = now();
+
+        if (mad_frame_decode(&frame, &stream) != 0)
+        {
+            if (MAD_RECOVERABLE(stream.error))
+                continue;
+            break;      // MAD_ERROR_BUFLEN is the end of data
+        }
+
+        mad_synth_frame(&synth, &frame);
+
+        unsigned int nchannels = synth.pcm.channels;
+        unsigned int length = synth.pcm.length;
+        for (unsigned int i = 0; i < length; i++)
+        {
+            for (unsigned int ch = 0; ch < nchannels; ch++)
+                pcm[i * nchannels + ch] = madfixed_to_short(synth.pcm.samples[ch][i]);
+        }
+
+        if (latency != NULL)
+            samples_add(latency, now() - started);
+
+        pcm_sink = pcm[0];
+        decoded += length;
+    }
+
+    mad_synth_finish(&synth);
+    mad_frame_finish(&frame);
+    mad_stream_finish(&stream);
+    free(input);
+
+    return decoded;
+}
+
+/**
+ * Fill in the result with the best time of the runs and latency of one frame
+ */
+static void finish_result(result_t *result, double best, samples_t *latency, unsigned long long allocations, int repeat)
+{
+    result->seconds = best;
+    result->realtime_factor = best > 0 ? result->audio_seconds / best : 0.0;
+    result->latency_median_us = samples_percentile(latency, 0.5) * 1e6;
+    result->latency_p99_us = samples_percentile(latency, 0.99) * 1e6;
+    result->latency_max_us = samples_percentile(latency, 1.0) * 1e6;
+    result->allocations = allocations / repeat;
+    result->allocations_per_second = best > 0 ? (double) result->allocations / best : 0.0;
+}
+
+/**
+ * Run encode and decode benchmarks of one case
+ *
+ * \return  0 on success, -1 on error
+ */
+static int bench_case(int sample_rate, int channels, int bit_rate, double duration, int repeat,
+                      result_t *encode_result, result_t *decode_result)
+{
+    size_t nsamples = (size_t) (sample_rate * duration);
+    short *pcm = generate_pcm(sample_rate, channels, nsamples);
+    if (pcm == NULL)
+        return -1;
+
+    unsigned char *mp3_data = NULL;
+    size_t mp3_size = 0;
+    samples_t latency = { NULL, 0, 0 };
+    double best = 0;
+    unsigned long long allocations = 0;
+
+    /* Encoding */
+    for (int run = 0; run < repeat; run++)
+    {
+        free(mp3_data);
+        mp3_data = NULL;
+
+        unsigned long long allocs_before = alloc_count;
+        double started = now();
+        if (run_encode(pcm, nsamples, sample_rate, channels, bit_rate, &mp3_data, &mp3_size, &latency) < 0)
+        {
+            fprintf(stderr, "Encoding failed (%d Hz, %d channels, %d kbps)\n", sample_rate, channels, bit_rate);
+            free(latency.values);
+            free(pcm);
+            return -1;
+        }
+        double elapsed = now() - started;
+        allocations += alloc_count - allocs_before;
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    *encode_result = (result_t) { "encode", sample_rate, channels, bit_rate, duration };
+    finish_result(encode_result, best, &latency, allocations, repeat);
+
+    /* Decoding */
+    latency.count = 0;
+    allocations = 0;
+    for (int run = 0; run < repeat; run++)
+    {
+        unsigned long long allocs_before = alloc_count;
+        double started = now();
+        if (run_decode(mp3_data, mp3_size, &latency) <= 0)
+        {
+            fprintf(stderr, "Decoding failed (%d Hz, %d channels, %d kbps)\n", sample_rate, channels, bit_rate);
+            free(latency.values);
+            free(mp3_data);
+            free(pcm);
+            return -1;
+        }
+        double elapsed = now() - started;
+        allocations += alloc_count - allocs_before;
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    *decode_result = (result_t) { "decode", sample_rate, channels, bit_rate, duration };
+    finish_result(decode_result, best, &latency, allocations, repeat);
+
+    free(latency.values);
+    free(mp3_data);
+    free(pcm);
+    return 0;
+}
+
+
+/* -----------------------------------------------------------------
+ * Output
+ * ----------------------------------------------------------------- */
+
+static void print_result(const result_t *r)
+{
+    printf("%-7s %6d Hz %d ch %3d kbps  %8.1fx realtime  latency median %7.1f us  p99 %7.1f us  max %8.1f us",
+           r->name, r->sample_rate, r->channels, r->bit_rate, r->realtime_factor,
+           r->latency_median_us, r->latency_p99_us, r->latency_max_us);
+    if (ALLOC_COUNT_SUPPORTED)
+        printf("  %10.0f allocs/s", r->allocations_per_second);
+    printf("\n");
+}
+
+static int write_json(const char *path, const result_t *results, size_t count, double duration, int repeat)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"tool\": \"pymp3_bench\",\n");
+#ifdef VERSION
+    fprintf(fp, "  \"version\": \"%s\",\n", VERSION);
+#endif
+    fprintf(fp, "  \"duration_s\": %g,\n", duration);
+    fprintf(fp, "  \"repeat\": %d,\n", repeat);
+    fprintf(fp, "  \"peak_rss_bytes\": %llu,\n", peak_rss());
+    fprintf(fp, "  \"results\": [\n");
+    for (size_t i = 0; i < count; i++)
+    {
+        const result_t *r = &results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"sample_rate\": %d, \"channels\": %d, \"bit_rate\": %d, "
+                    "\"seconds\": %.6f, \"realtime_factor\": %.2f, "
+                    "\"latency_us\": {\"median\": %.2f, \"p99\": %.2f, \"max\": %.2f}, ",
+                r->name, r->sample_rate, r->channels, r->bit_rate,
+                r->seconds, r->realtime_factor,
+                r->latency_median_us, r->latency_p99_us, r->latency_max_us);
+        if (ALLOC_COUNT_SUPPORTED)
+            fprintf(fp, "\"allocations\": %llu, \"allocations_per_second\": %.1f}", r->allocations, r->allocations_per_second);
+        else
+            fprintf(fp, "\"allocations\": null, \"allocations_per_second\": null}");
+        fprintf(fp, "%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+
+    fclose(fp);
+    return 0;
+}
+
+
+/* -----------------------------------------------------------------
+ * Main
+ * ----------------------------------------------------------------- */
+
+typedef struct {
+    int sample_rate;
+    int channels;
+    int bit_rate;
+} bench_config_t;
+
+static const bench_config_t configs[] = {
+    {  8000, 1,  16 },
+    {  8000, 2,  24 },
+    { 16000, 1,  32 },
+    { 16000, 2,  64 },
+    { 22050, 2,  96 },
+    { 32000, 2, 128 },
+    { 44100, 1,  64 },
+    { 44100, 2, 128 },
+    { 44100, 2, 320 },
+    { 48000, 2, 192 },
+};
+
+static const bench_config_t quick_configs[] = {
+    {  8000, 1,  16 },
+    { 44100, 2, 128 },
+};
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--duration SECONDS] [--repeat N] [--json FILE] [--quick]\n", program);
+}
+
+int main(int argc, char *argv[])
+{
+    double duration = 10.0;
+    int repeat = 3;
+    const char *json_path = NULL;
+    const bench_config_t *cases = configs;
+    size_t ncases = sizeof(configs) / sizeof(configs[0]);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc)
+            duration = atof(argv[++i]);
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            repeat = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            json_path = argv[++i];
+        else if (strcmp(argv[i], "--quick") == 0)
+        {
+            cases = quick_configs;
+            ncases = sizeof(quick_configs) / sizeof(quick_configs[0]);
+        }
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (duration <= 0 || repeat <= 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    result_t *results = calloc(ncases * 2, sizeof(result_t));
+    if (results == NULL)
+        return 1;
+
+    for (size_t i = 0; i < ncases; i++)
+    {
+        if (bench_case(cases[i].sample_rate, cases[i].channels, cases[i].bit_rate, duration, repeat,
+                       &results[i * 2], &results[i * 2 + 1]) < 0)
+        {
+            free(results);
+            return 1;
+        }
+        print_result(&results[i * 2]);
+        print_result(&results[i * 2 + 1]);
+    }
+
+    printf("peak RSS: %.1f MB\n", (double) peak_rss() / (1024.0 * 1024.0));
+
+    int status = 0;
+    if (json_path != NULL && write_json(json_path, results, ncases * 2, duration, repeat) < 0)
+        status = 1;
+
+    free(results);
+    return status;
+}
@@ -0,0 +1,39 @@
+"""
+Per-call overhead of the hot Decoder/Encoder methods.
+
+The calls do (almost) no work, so the measured time is dominated by the calling convention and argument parsing.
+To compare two builds, run:
+
+    pytest benchmarks/test_bench_calls.py --benchmark-autosave
+    # ... rebuild ...
+    pytest benchmarks/test_bench_calls.py --benchmark-compare
+"""
+from io import BytesIO
+
+import mp3
+
+
+def test_call_decoder_read(benchmark, mp3_44khz_stereo):
+    decoder = mp3.Decoder(BytesIO(mp3_44khz_stereo))
+    benchmark(decoder.read, 0)
+
+
+def test_call_decoder_readinto(benchmark, mp3_44khz_stereo):
+    decoder = mp3.Decoder(BytesIO(mp3_44khz_stereo))
+    buffer = bytearray(0)
+    benchmark(decoder.readinto, buffer)
+
+
+def test_call_encoder_write(benchmark):
+    encoder = mp3.Encoder(BytesIO())
+    benchmark(encoder.write, b'')
+
+
+def test_call_decoder_constructor(benchmark):
+    fp = BytesIO(b'')
+    benchmark(mp3.Decoder, fp)
+
+
+def test_call_encoder_constructor(benchmark):
+    fp = BytesIO()
+    benchmark(mp3.Encoder, fp)
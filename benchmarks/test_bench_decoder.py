@@ -0,0 +1,154 @@
+from io import BytesIO
+import threading
+
+import pytest
+
+import mp3
+
+
+# Maximum acceptable median time to decode one MPEG frame (1152 samples, 26ms of audio at 44100 Hz)
+FRAME_LATENCY_TARGET = 0.001
+
+
+def test_decode_frame_latency(benchmark, mp3_44khz_stereo):
+    """
+    Time from decode_frame() call to the PCM data of the next MPEG frame being available
+    """
+    decoder = mp3.Decoder(BytesIO(mp3_44khz_stereo))
+
+    result = benchmark.pedantic(decoder.decode_frame, rounds=500, iterations=1, warmup_rounds=10)
+    assert result is not None
+
+    if not benchmark.disabled:
+        assert benchmark.stats.stats.median < FRAME_LATENCY_TARGET
+
+
+def test_decode_read(benchmark, mp3_44khz_stereo):
+    """
+    Decode the whole file with read() calls of the typical block size
+    """
+
+    def decode():
+        decoder = mp3.Decoder(BytesIO(mp3_44khz_stereo))
+        while decoder.read(4000):
+            pass
+
+    benchmark(decode)
+
+
+def test_decode_iter(benchmark, mp3_44khz_stereo):
+    """
+    Decode the whole file by iterating over the decoder (compare with test_decode_read)
+    """
+
+    def decode():
+        decoder = mp3.Decoder(BytesIO(mp3_44khz_stereo), chunk_size=4000)
+        for _ in decoder:
+            pass
+
+    benchmark(decode)
+
+
+def _corrupt(mp3_data, period=20000, size=1000):
+    """
+    Overwrite `size` bytes of every `period` bytes of the data with junk (like a damaged archive)
+    """
+    data = bytearray(mp3_data)
+    junk = bytes(i * 7 % 256 for i in range(size))
+    for pos in range(period // 2, len(data) - size, period):
+        data[pos:pos + size] = junk
+    return bytes(data)
+
+
+def test_decode_corrupt(benchmark, mp3_44khz_stereo):
+    """
+    Decode a damaged file in resilient mode (compare with test_decode_iter)
+    """
+    corrupted_data = _corrupt(mp3_44khz_stereo)
+
+    def decode():
+        decoder = mp3.Decoder(BytesIO(corrupted_data), chunk_size=4000, resilient=True)
+        for _ in decoder:
+            pass
+        return decoder
+
+    decoder = benchmark(decode)
+    assert decoder.get_damaged_ranges()
+
+
+def test_decode_levels(benchmark, mp3_44khz_stereo):
+    """
+    Measure frame levels without synthesis (compare with test_decode_iter)
+    """
+
+    def analyse():
+        return mp3.Decoder(BytesIO(mp3_44khz_stereo)).read_levels()
+
+    levels = benchmark(analyse)
+    assert levels
+
+
+def test_decode_one_channel(benchmark, mp3_44khz_stereo):
+    """
+    Decode only the right channel of a stereo file (compare with test_decode_iter)
+    """
+
+    def decode():
+        decoder = mp3.Decoder(BytesIO(mp3_44khz_stereo), chunk_size=4000, channels=[1])
+        for _ in decoder:
+            pass
+
+    benchmark(decode)
+
+
+def test_decode_planar(benchmark, mp3_44khz_stereo):
+    """
+    Decode both channels of a stereo file into separate buffers
+    """
+
+    def decode():
+        return mp3.Decoder(BytesIO(mp3_44khz_stereo)).read_planar()
+
+    left, right = benchmark(decode)
+    assert len(left) == len(right)
+
+
+@pytest.mark.parametrize('pool', [False, True], ids=['malloc', 'pool'])
+def test_decode_short_files_threads(benchmark, mp3_44khz_stereo, pool):
+    """
+    Decode many short files with a new decoder per file in 8 threads, with and without the per-thread pools of buffers
+    """
+    short_mp3 = mp3_44khz_stereo[:16 * 1024]
+
+    def decode_files():
+        for _ in range(50):
+            mp3.Decoder(BytesIO(short_mp3)).read()
+
+    def decode():
+        threads = [threading.Thread(target=decode_files) for _ in range(8)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+    previous = mp3.enable_buffer_pool(pool)
+    try:
+        benchmark(decode)
+    finally:
+        mp3.enable_buffer_pool(previous)
+
+
+@pytest.mark.parametrize('read_ahead', [0, 4], ids=['sync', 'read_ahead'])
+def test_decode_file_read_ahead(benchmark, tmp_path, mp3_44khz_stereo, read_ahead):
+    """
+    Decode a file with synchronous reads of the file object, and with the read-ahead thread
+    """
+    path = tmp_path / 'stereo.mp3'
+    path.write_bytes(mp3_44khz_stereo)
+
+    def decode():
+        with open(path, 'rb') as fp:
+            return mp3.Decoder(fp, read_ahead=read_ahead).read()
+
+    result = benchmark(decode)
+    assert len(result) > 0
@@ -0,0 +1,17 @@
+import mp3
+
+
+def test_cut(benchmark, mp3_44khz_stereo):
+    """
+    Cut 10 seconds from the middle of the file at frame level (compare with test_transcode)
+    """
+    result = benchmark(mp3.cut, mp3_44khz_stereo, None, 10.0, 20.0)
+    assert result
+
+
+def test_concat(benchmark, mp3_44khz_stereo):
+    """
+    Join 3 copies of the file at frame level
+    """
+    result = benchmark(mp3.concat, [mp3_44khz_stereo] * 3, None)
+    assert len(result) == 3 * len(mp3_44khz_stereo)
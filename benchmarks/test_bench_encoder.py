@@ -0,0 +1,56 @@
+from io import BytesIO
+import timeit
+
+import pytest
+
+import mp3
+
+from .conftest import synthetic_audio
+
+
+# A short stream, e.g. a voice prompt: 0.5 seconds of 16000 Hz mono audio at 32 kbps
+SAMPLE_RATE = 16000
+CHANNELS = 1
+BIT_RATE = 32
+DURATION = 0.5
+
+
+def encode_new(pcm_data):
+    encoder = mp3.Encoder(BytesIO())
+    encoder.set_channels(CHANNELS)
+    encoder.set_sample_rate(SAMPLE_RATE)
+    encoder.set_bit_rate(BIT_RATE)
+    encoder.set_mode(mp3.MODE_SINGLE_CHANNEL)
+    encoder.write(pcm_data)
+    encoder.flush()
+
+
+def encode_pooled(pcm_data):
+    encoder = mp3.acquire_encoder(BytesIO(), sample_rate=SAMPLE_RATE, channels=CHANNELS, bit_rate=BIT_RATE)
+    encoder.write(pcm_data)
+    mp3.release_encoder(encoder)
+
+
+@pytest.mark.parametrize('pooled', [False, True], ids=['new', 'pool'])
+def test_encode_short_stream(benchmark, pooled):
+    """
+    Encode a short stream with a new encoder (mp3.Encoder() and the setup of LAME on the first write),
+    and with an encoder of the pool, which is restarted with its initialised LAME encoder
+    """
+    pcm_data, _ = synthetic_audio(SAMPLE_RATE, CHANNELS, BIT_RATE, DURATION)
+
+    encode = encode_pooled if pooled else encode_new
+    encode(pcm_data)    # Fill the pool
+    benchmark(encode, pcm_data)
+
+
+def test_encode_short_stream_pool_gain():
+    """
+    A pooled encoder must be cheaper than a new encoder for a short stream, because it skips the setup of LAME
+    """
+    pcm_data, _ = synthetic_audio(SAMPLE_RATE, CHANNELS, BIT_RATE, DURATION)
+    encode_pooled(pcm_data)
+
+    new_time = min(timeit.repeat(lambda: encode_new(pcm_data), number=20, repeat=5))
+    pooled_time = min(timeit.repeat(lambda: encode_pooled(pcm_data), number=20, repeat=5))
+    assert pooled_time < new_time
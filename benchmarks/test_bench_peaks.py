@@ -0,0 +1,35 @@
+from array import array
+from io import BytesIO
+import sys
+
+import mp3
+
+
+def test_peaks(benchmark, mp3_44khz_stereo):
+    """
+    Waveform summary of 44100 Hz stereo with mp3.peaks() (256 samples per point)
+    """
+    result = benchmark(mp3.peaks, mp3_44khz_stereo, 256)
+    assert result
+
+
+def test_peaks_python(benchmark, mp3_44khz_stereo):
+    """
+    The same summary as test_peaks with Decoder output reduced in Python (compare with test_peaks)
+    """
+
+    def peaks():
+        decoder = mp3.Decoder(BytesIO(mp3_44khz_stereo))
+        points = array('h')
+        block = 256 * decoder.get_channels()
+        pcm = array('h', decoder.read())
+        if sys.byteorder != 'little':
+            pcm.byteswap()
+        for offset in range(0, len(pcm), block):
+            values = pcm[offset:offset + block]
+            rms = (sum(v * v for v in values) / len(values)) ** 0.5
+            points.extend([min(values), max(values), min(int(rms), 32767)])
+        return points.tobytes()
+
+    result = benchmark(peaks)
+    assert result
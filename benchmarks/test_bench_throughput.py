@@ -0,0 +1,139 @@
+from io import BytesIO
+import tracemalloc
+
+import pytest
+
+import mp3
+
+from .conftest import peak_rss, synthetic_audio
+
+
+# Duration of the synthetic signals (in seconds)
+DURATION = 5.0
+
+# (sample rate, channels, bit rate)
+CONFIGS = [
+    (8000, 1, 16),
+    (16000, 1, 32),
+    (16000, 2, 64),
+    (22050, 2, 96),
+    (44100, 1, 64),
+    (44100, 2, 128),
+    (44100, 2, 320),
+    (48000, 2, 192),
+]
+
+CONFIG_IDS = ['{}Hz-{}ch-{}kbps'.format(*config) for config in CONFIGS]
+
+
+def encode(pcm_data, sample_rate, channels, bit_rate, block_size):
+    encoder = mp3.Encoder(BytesIO())
+    encoder.set_channels(channels)
+    encoder.set_sample_rate(sample_rate)
+    encoder.set_bit_rate(bit_rate)
+    encoder.set_mode(mp3.MODE_JOINT_STEREO if channels == 2 else mp3.MODE_SINGLE_CHANNEL)
+    for pos in range(0, len(pcm_data), block_size):
+        encoder.write(pcm_data[pos:pos + block_size])
+    encoder.flush()
+
+
+def decode(mp3_data, backend=mp3.BACKEND_LIBMAD, half_rate=False):
+    for _ in mp3.Decoder(BytesIO(mp3_data), chunk_size=16384, backend=backend, half_rate=half_rate):
+        pass
+
+
+def python_peak_memory(func, *args):
+    """
+    Peak memory allocated by Python allocators during one call (in bytes)
+    """
+    tracemalloc.start()
+    try:
+        func(*args)
+        return tracemalloc.get_traced_memory()[1]
+    finally:
+        tracemalloc.stop()
+
+
+def add_extra_info(benchmark, sample_rate, channels, bit_rate, python_peak):
+    benchmark.extra_info['sample_rate'] = sample_rate
+    benchmark.extra_info['channels'] = channels
+    benchmark.extra_info['bit_rate'] = bit_rate
+    benchmark.extra_info['audio_seconds'] = DURATION
+    benchmark.extra_info['python_peak_bytes'] = python_peak
+    benchmark.extra_info['peak_rss_bytes'] = peak_rss()
+    if not benchmark.disabled:
+        benchmark.extra_info['realtime_factor'] = DURATION / benchmark.stats.stats.min
+
+
+@pytest.mark.parametrize('sample_rate,channels,bit_rate', CONFIGS, ids=CONFIG_IDS)
+def test_encode_throughput(benchmark, sample_rate, channels, bit_rate):
+    """
+    Encode the whole signal with write() calls of 1 second of audio (x realtime in extra_info)
+    """
+    pcm_data, _ = synthetic_audio(sample_rate, channels, bit_rate, DURATION)
+    block_size = sample_rate * channels * 2
+
+    benchmark(encode, pcm_data, sample_rate, channels, bit_rate, block_size)
+
+    add_extra_info(benchmark, sample_rate, channels, bit_rate,
+                   python_peak_memory(encode, pcm_data, sample_rate, channels, bit_rate, block_size))
+
+
+@pytest.mark.parametrize('sample_rate,channels,bit_rate', CONFIGS, ids=CONFIG_IDS)
+def test_decode_throughput(benchmark, sample_rate, channels, bit_rate):
+    """
+    Decode the whole signal (x realtime in extra_info)
+    """
+    _, mp3_data = synthetic_audio(sample_rate, channels, bit_rate, DURATION)
+
+    benchmark(decode, mp3_data)
+
+    add_extra_info(benchmark, sample_rate, channels, bit_rate, python_peak_memory(decode, mp3_data))
+
+
+@pytest.mark.parametrize('backend', mp3.BACKENDS, ids=['libmad', 'minimp3'][:len(mp3.BACKENDS)])
+@pytest.mark.parametrize('sample_rate,channels,bit_rate', [(16000, 1, 32), (44100, 2, 128)], ids=['16000Hz-1ch-32kbps', '44100Hz-2ch-128kbps'])
+def test_decode_backend_throughput(benchmark, sample_rate, channels, bit_rate, backend):
+    """
+    Decode the whole signal with each decoder backend built in the module (compare within the group)
+    """
+    _, mp3_data = synthetic_audio(sample_rate, channels, bit_rate, DURATION)
+    benchmark.group = 'decode-backends-{}Hz-{}ch-{}kbps'.format(sample_rate, channels, bit_rate)
+
+    benchmark(decode, mp3_data, backend)
+
+    add_extra_info(benchmark, sample_rate, channels, bit_rate, python_peak_memory(decode, mp3_data, backend))
+
+
+@pytest.mark.parametrize('half_rate', [False, True], ids=['full-rate', 'half-rate'])
+@pytest.mark.parametrize('sample_rate,channels,bit_rate', [(16000, 1, 32), (44100, 2, 128)], ids=['16000Hz-1ch-32kbps', '44100Hz-2ch-128kbps'])
+def test_decode_half_rate_throughput(benchmark, sample_rate, channels, bit_rate, half_rate):
+    """
+    Decode the whole signal with full and half sample rate synthesis (compare within the group)
+    """
+    _, mp3_data = synthetic_audio(sample_rate, channels, bit_rate, DURATION)
+    benchmark.group = 'decode-half-rate-{}Hz-{}ch-{}kbps'.format(sample_rate, channels, bit_rate)
+
+    benchmark(decode, mp3_data, mp3.BACKEND_LIBMAD, half_rate)
+
+    add_extra_info(benchmark, sample_rate, channels, bit_rate, python_peak_memory(decode, mp3_data, mp3.BACKEND_LIBMAD, half_rate))
+
+
+@pytest.mark.parametrize('sample_rate,channels,bit_rate', [(16000, 1, 32), (44100, 2, 128)], ids=['16000Hz-1ch-32kbps', '44100Hz-2ch-128kbps'])
+def test_encode_write_latency(benchmark, sample_rate, channels, bit_rate):
+    """
+    Per-call latency of encoding one MPEG frame worth of PCM data
+    """
+    pcm_data, _ = synthetic_audio(sample_rate, channels, bit_rate, DURATION)
+
+    encoder = mp3.Encoder(BytesIO())
+    encoder.set_channels(channels)
+    encoder.set_sample_rate(sample_rate)
+    encoder.set_bit_rate(bit_rate)
+    encoder.set_mode(mp3.MODE_JOINT_STEREO if channels == 2 else mp3.MODE_SINGLE_CHANNEL)
+    frame_bytes = encoder.get_frame_size() * channels * 2
+
+    blocks = [pcm_data[pos:pos + frame_bytes] for pos in range(0, len(pcm_data) - frame_bytes + 1, frame_bytes)]
+    iterator = iter(blocks)
+
+    benchmark.pedantic(lambda: encoder.write(next(iterator)), rounds=len(blocks) - 10, iterations=1, warmup_rounds=10)
@@ -0,0 +1,43 @@
+from io import BytesIO
+
+import mp3
+
+
+def _format(mp3_data):
+    decoder = mp3.Decoder(BytesIO(mp3_data))
+    decoder.read(4608)
+    return decoder.get_channels(), decoder.get_sample_rate()
+
+
+def test_transcode(benchmark, mp3_44khz_stereo):
+    """
+    Transcode 44100 Hz stereo 128 kbps to 44100 Hz stereo 64 kbps with mp3.transcode()
+    """
+    result = benchmark(mp3.transcode, mp3_44khz_stereo, None, bit_rate=64, channels=2)
+    assert _format(result) == (2, 44100)
+
+
+def test_transcode_python(benchmark, mp3_44khz_stereo):
+    """
+    The same transcoding as test_transcode with a Decoder/Encoder loop in Python (compare with test_transcode).
+    Both keep 2 channels: the Python API has no downmix, so mono output would be different work
+    """
+
+    def transcode():
+        decoder = mp3.Decoder(BytesIO(mp3_44khz_stereo))
+        output_fp = BytesIO()
+        encoder = mp3.Encoder(output_fp)
+        encoder.set_channels(decoder.get_channels())
+        encoder.set_sample_rate(decoder.get_sample_rate())
+        encoder.set_mode(mp3.MODE_JOINT_STEREO)
+        encoder.set_bit_rate(64)
+        while True:
+            pcm_data = decoder.read(4608)
+            if not pcm_data:
+                break
+            encoder.write(pcm_data)
+        encoder.flush()
+        return output_fp.getvalue()
+
+    result = benchmark(transcode)
+    assert _format(result) == _format(mp3.transcode(mp3_44khz_stereo, None, bit_rate=64, channels=2)) == (2, 44100)
@@ -0,0 +1,19 @@
+# Merge raw profiles of Clang's instrumented build into ${PGO_DIR}/default.profdata
+# Usage: cmake -DLLVM_PROFDATA=<path> -DPGO_DIR=<dir> -P PgoMergeProfiles.cmake
+
+file(GLOB PGO_RAW_PROFILES "${PGO_DIR}/*.profraw")
+
+if(NOT PGO_RAW_PROFILES)
+    message(FATAL_ERROR "No raw profiles found in ${PGO_DIR}, run the instrumented build first")
+endif()
+
+execute_process(
+    COMMAND "${LLVM_PROFDATA}" merge "-output=${PGO_DIR}/default.profdata" ${PGO_RAW_PROFILES}
+    RESULT_VARIABLE PGO_MERGE_RESULT
+)
+
+if(NOT PGO_MERGE_RESULT EQUAL 0)
+    message(FATAL_ERROR "llvm-profdata failed to merge the profiles")
+endif()
+
+message(STATUS "Merged profile: ${PGO_DIR}/default.profdata")
@@ -0,0 +1,229 @@
+#include "mp3_alloc.h"
+#include "py_module.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#define POOL_MIN_SHIFT 11               // The smallest size class: 2 KB
+#define POOL_CLASSES 7                  // Size classes from 2 KB to 128 KB
+#define POOL_MAX_BUFFERS 8              // Free buffers kept per size class in the pool of a thread
+
+
+/* Free buffers of a thread, by size classes */
+typedef struct {
+    int count[POOL_CLASSES];
+    void *buffers[POOL_CLASSES][POOL_MAX_BUFFERS];
+} buffer_pool;
+
+/* The pools are disabled by default (atomic, the setting is shared by all threads) */
+static int pool_enabled = 0;
+
+
+void* pymp3_mem_malloc(size_t size)
+{
+#ifdef PYMP3_ALLOCATOR_MALLOC
+    return malloc(size);
+#else
+    return PyMem_RawMalloc(size);
+#endif
+}
+
+void* pymp3_mem_calloc(size_t nelem, size_t size)
+{
+#ifdef PYMP3_ALLOCATOR_MALLOC
+    return calloc(nelem, size);
+#else
+    return PyMem_RawCalloc(nelem, size);
+#endif
+}
+
+void* pymp3_mem_realloc(void *ptr, size_t size)
+{
+#ifdef PYMP3_ALLOCATOR_MALLOC
+    return realloc(ptr, size);
+#else
+    return PyMem_RawRealloc(ptr, size);
+#endif
+}
+
+void pymp3_mem_free(void *ptr)
+{
+#ifdef PYMP3_ALLOCATOR_MALLOC
+    free(ptr);
+#else
+    PyMem_RawFree(ptr);
+#endif
+}
+
+/**
+ * Free the buffers of a pool and the pool itself (at exit of the thread, or when the pools are disabled)
+ */
+static void pool_destroy(void *ptr)
+{
+    buffer_pool *pool = (buffer_pool *) ptr;
+    if (pool == NULL)
+        return;
+
+    for (int c = 0; c < POOL_CLASSES; c++)
+    {
+        for (int i = 0; i < pool->count[c]; i++)
+            pymp3_mem_free(pool->buffers[c][i]);
+    }
+    pymp3_mem_free(pool);
+}
+
+/*
+ * Thread-specific storage of the pools with a destructor, which frees the buffers of a thread when it exits
+ */
+#ifdef _WIN32
+static DWORD pool_key = FLS_OUT_OF_INDEXES;
+static INIT_ONCE pool_once = INIT_ONCE_STATIC_INIT;
+
+static VOID WINAPI pool_destroy_fls(PVOID ptr)
+{
+    pool_destroy(ptr);
+}
+
+static BOOL CALLBACK pool_create_key(PINIT_ONCE once, PVOID parameter, PVOID *context)
+{
+    pool_key = FlsAlloc(&pool_destroy_fls);
+    return TRUE;
+}
+
+static buffer_pool* pool_get(void)
+{
+    InitOnceExecuteOnce(&pool_once, &pool_create_key, NULL, NULL);
+    return pool_key != FLS_OUT_OF_INDEXES ? (buffer_pool *) FlsGetValue(pool_key) : NULL;
+}
+
+static int pool_set(buffer_pool *pool)
+{
+    return pool_key != FLS_OUT_OF_INDEXES && FlsSetValue(pool_key, pool) ? 0 : -1;
+}
+#else
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static int pool_key_valid = 0;
+
+static void pool_create_key(void)
+{
+    pool_key_valid = pthread_key_create(&pool_key, &pool_destroy) == 0;
+}
+
+static buffer_pool* pool_get(void)
+{
+    pthread_once(&pool_once, &pool_create_key);
+    return pool_key_valid ? (buffer_pool *) pthread_getspecific(pool_key) : NULL;
+}
+
+static int pool_set(buffer_pool *pool)
+{
+    return pool_key_valid && pthread_setspecific(pool_key, pool) == 0 ? 0 : -1;
+}
+#endif
+
+/**
+ * Index of the size class of `size` bytes, or POOL_CLASSES if the size is larger than all classes
+ */
+static int pool_class(size_t size)
+{
+    int c = 0;
+    while (c < POOL_CLASSES && ((size_t) 1 << (POOL_MIN_SHIFT + c)) < size)
+        c++;
+    return c;
+}
+
+/**
+ * Size of the buffer, which is allocated for `size` bytes: the size of its class, or `size` for large buffers
+ */
+size_t pymp3_buffer_round(size_t size)
+{
+    int c = pool_class(size);
+    return c < POOL_CLASSES ? (size_t) 1 << (POOL_MIN_SHIFT + c) : size;
+}
+
+/**
+ * Allocate a buffer of pymp3_buffer_round(size) bytes, taking a free buffer of the size class from the pool of the thread
+ */
+void* pymp3_buffer_alloc(size_t size)
+{
+    int c = pool_class(size);
+
+    if (PYMP3_ATOMIC_LOAD_INT(&pool_enabled) && c < POOL_CLASSES)
+    {
+        buffer_pool *pool = pool_get();
+        if (pool != NULL && pool->count[c] > 0)
+            return pool->buffers[c][--pool->count[c]];
+    }
+
+    return pymp3_mem_malloc(pymp3_buffer_round(size));
+}
+
+/**
+ * Free a buffer of `size` bytes. A buffer of a size class is kept in the pool of the thread, unless the pool is full
+ */
+void pymp3_buffer_free(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return;
+
+    int c = pool_class(size);
+
+    if (PYMP3_ATOMIC_LOAD_INT(&pool_enabled) && c < POOL_CLASSES && size == ((size_t) 1 << (POOL_MIN_SHIFT + c)))
+    {
+        buffer_pool *pool = pool_get();
+        if (pool == NULL)
+        {
+            pool = pymp3_mem_calloc(1, sizeof(buffer_pool));
+            if (pool != NULL && pool_set(pool) < 0)
+            {
+                pymp3_mem_free(pool);
+                pool = NULL;
+            }
+        }
+
+        if (pool != NULL && pool->count[c] < POOL_MAX_BUFFERS)
+        {
+            pool->buffers[c][pool->count[c]++] = ptr;
+            return;
+        }
+    }
+
+    pymp3_mem_free(ptr);
+}
+
+/**
+ * Enable/disable the per-thread pools, return the previous setting.
+ * Disabling frees the pool of the calling thread, pools of other threads are freed when the threads exit
+ */
+int pymp3_buffer_pool_enable(int enabled)
+{
+    int previous = PYMP3_ATOMIC_EXCHANGE_INT(&pool_enabled, enabled);
+
+    if (!enabled)
+    {
+        buffer_pool *pool = pool_get();
+        if (pool != NULL && pool_set(NULL) == 0)
+            pool_destroy(pool);
+    }
+
+    return previous;
+}
+
+/**
+ * Enable/disable the per-thread pools of buffers: mp3.enable_buffer_pool(enabled), return the previous setting
+ */
+PyObject* pymp3_module_enable_buffer_pool(PyObject *module, PyObject *args)
+{
+    int enabled;
+
+    if (!PyArg_ParseTuple(args, "p:enable_buffer_pool", &enabled))
+    {
+        return NULL;
+    }
+
+    return PyBool_FromLong(pymp3_buffer_pool_enable(enabled));
+}
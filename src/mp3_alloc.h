@@ -0,0 +1,39 @@
+#pragma once
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stddef.h>
+
+
+/*
+ * Allocator of native buffers of the module. By default blocks come from PyMem_RawMalloc(), so they are traced
+ * by tracemalloc, and the functions can be called with the GIL released.
+ * Define PYMP3_ALLOCATOR_MALLOC (CMake option PYMP3_ALLOCATOR=malloc) to use malloc() of the C library.
+ */
+void* pymp3_mem_malloc(size_t size);
+void* pymp3_mem_calloc(size_t nelem, size_t size);
+void* pymp3_mem_realloc(void *ptr, size_t size);
+void pymp3_mem_free(void *ptr);
+
+/*
+ * Buffers of fixed sizes (frame and I/O buffers of decoders and encoders), which can be recycled by a per-thread pool.
+ * The size of a buffer is rounded up to a size class (a power of 2 from 2 KB to 128 KB), and a freed buffer of a size class
+ * is kept in the pool of the thread, so creating and destroying objects doesn't call the allocator, nor contend on its locks.
+ * The buffers are regular blocks of pymp3_mem_malloc(), they can be resized with pymp3_mem_realloc() and freed
+ * by pymp3_buffer_free() with their new size. The pool is disabled by default, see mp3.enable_buffer_pool()
+ */
+
+/* Size of the buffer, which is allocated for `size` bytes */
+size_t pymp3_buffer_round(size_t size);
+
+/* Allocate a buffer of pymp3_buffer_round(size) bytes */
+void* pymp3_buffer_alloc(size_t size);
+
+/* Free a buffer of `size` bytes, or keep it in the pool of the thread */
+void pymp3_buffer_free(void *ptr, size_t size);
+
+/* Enable/disable the per-thread pools, return the previous setting */
+int pymp3_buffer_pool_enable(int enabled);
+
+/* mp3.enable_buffer_pool(enabled) */
+PyObject* pymp3_module_enable_buffer_pool(PyObject *module, PyObject *args);
@@ -1,12 +1,34 @@
 #include "mp3_decoder.h"
+#include "mp3_alloc.h"
+#include "mp3_header.h"
+#include "pcm_convert.h"
 #include "py_module.h"
 
 #define ERROR_MSG_SIZE 512
-#define MAX_READ_BYTES 256*1024*1024    // 256MB maximum supported size of one read operation
+#define MAX_READ_BYTES (256*1024*1024)  // 256MB maximum supported size of one read operation
+#define READ_BLOCK_SIZE (64*1024)       // Initial size of a result of read() operation, it grows for larger reads
+#define DEFAULT_CHUNK_SIZE 4096         // Default minimum size of PCM chunks returned by the iterator
+#define LEVEL_FLOOR_DB -120.0           // Level of digital silence returned by read_levels()
+#define FRAME_BUFFER_SIZE (1152*2*2)    // PCM data of the largest frame: 1152 samples of 16-bit stereo
+#define MIN_MEMORY_LIMIT (64*1024)      // Minimum `memory_limit` of a decoder
+#define MAX_LOST_FRAMES 500             // Silence inserted for one damaged range: about 13s of MPEG-1 Layer III at 44.1 kHz
+
+/* PCM samples synthesized from one time slot of 32 subband samples (16 with half sample rate synthesis) */
+#define DECODER_SUBBAND_SAMPLES(self) ((self)->half_rate ? 16 : 32)
+
+/* Sample rate of the decoded audio, `samplerate` is the sample rate of the stream */
+#define DECODER_OUTPUT_SAMPLERATE(self) ((self)->half_rate ? (self)->samplerate / 2 : (self)->samplerate)
 
 
 static PyMethodDef Decoder_methods[] = {
-    { "read", (PyCFunction) &Decoder_read, METH_VARARGS, "Read a decoded audio from the file object" },
+    { "read", (PyCFunction) &Decoder_read, METH_FASTCALL, "Read a decoded audio from the file object" },
+    { "readinto", (PyCFunction) &Decoder_readinto, METH_FASTCALL, "Read a decoded audio into a pre-allocated writable buffer, return the number of bytes read" },
+    { "decode_frame", (PyCFunction) &Decoder_decodeFrame, METH_NOARGS, "Decode the next MPEG frame, return a tuple of PCM data and the frame header, or None on EOF" },
+    { "read_planar", (PyCFunction) &Decoder_readPlanar, METH_VARARGS, "Decode the next frames, return a tuple of PCM data per channel (planar)" },
+    { "read_levels", (PyCFunction) &Decoder_readLevels, METH_VARARGS, "Decode the next frames without synthesis, return a list of their levels (RMS in dBFS)" },
+    { "reset", (PyCFunction) &Decoder_reset, METH_O, "Start decoding of another file-like object, reusing the decoder state and buffers" },
+    { "stats", (PyCFunction) &Decoder_stats, METH_NOARGS, "Get performance counters of the decoder" },
+    { "get_damaged_ranges", (PyCFunction) &Decoder_getDamagedRanges, METH_NOARGS, "Get a list of damaged ranges (start_byte, end_byte, start_sample, end_sample) found in resilient mode" },
     { "get_channels", (PyCFunction) &Decoder_getChannels, METH_NOARGS, "Get the number of channels" },
     { "is_valid", (PyCFunction) &Decoder_isValid, METH_NOARGS, "Report if MP3 file is valid, i.e. at least one MPEG frame was decoded successfully" },
     { "get_mode", (PyCFunction) &Decoder_getMode, METH_NOARGS, "Get MPEG mode (MODE_STEREO, MODE_DUAL_CHANNEL, MODE_JOINT_STEREO, MODE_SINGLE_CHANNEL)" },
@@ -16,67 +38,39 @@ static PyMethodDef Decoder_methods[] = {
     { NULL, NULL, 0, NULL }
 };
 
-/** The Decoder class type */
-PyTypeObject DecoderType = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    "mp3.Decoder",                 /* tp_name */
-    sizeof(DecoderObject),         /* tp_basicsize */
-    0,                             /* tp_itemsize */
-    (destructor) Decoder_dealloc,  /* tp_dealloc */
-    0,                             /* tp_print */
-    0,                             /* tp_getattr */
-    0,                             /* tp_setattr */
-    0,                             /* tp_compare */
-    0,                             /* tp_repr */
-    0,                             /* tp_as_number */
-    0,                             /* tp_as_sequence */
-    0,                             /* tp_as_mapping */
-    0,                             /* tp_hash */
-    0,                             /* tp_call */
-    0,                             /* tp_str */
-    0,                             /* tp_getattro */
-    0,                             /* tp_setattro */
-    0,                             /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT,            /* tp_flags */
-    "MP3 decoder",                 /* tp_doc */
-    0,                             /* tp_traverse */
-    0,                             /* tp_clear */
-    0,                             /* tp_richcompare */
-    0,                             /* tp_weaklistoffset */
-    0,                             /* tp_iter */
-    0,                             /* tp_iternext */
-    Decoder_methods,               /* tp_methods */
-    0,                             /* tp_members */
-    0,                             /* tp_getset */
-    0,                             /* tp_base */
-    0,                             /* tp_dict */
-    0,                             /* tp_descr_get */
-    0,                             /* tp_descr_set */
-    0,                             /* tp_dictoffset */
-    (initproc) Decoder_init,       /* tp_init */
-    0,                             /* tp_alloc */
-    Decoder_new,                   /* tp_new */
+/** The Decoder class slots */
+static PyType_Slot Decoder_slots[] = {
+    { Py_tp_dealloc, (void *) Decoder_dealloc },
+    { Py_tp_doc, (void *) "MP3 decoder" },
+    { Py_tp_iter, (void *) PyObject_SelfIter },
+    { Py_tp_iternext, (void *) Decoder_iternext },
+    { Py_tp_methods, (void *) Decoder_methods },
+    { Py_tp_init, (void *) Decoder_init },
+    { Py_tp_new, (void *) Decoder_new },
+    { 0, NULL }
+};
+
+/** The Decoder class type (heap type, created per module) */
+PyType_Spec DecoderType_spec = {
+    "mp3.Decoder",                 /* name */
+    sizeof(DecoderObject),         /* basicsize */
+    0,                             /* itemsize */
+    PYMP3_TPFLAGS,                 /* flags */
+    Decoder_slots,                 /* slots */
 };
 
 /**
- * Instantiates the new Decoder class memory
+ * Make sure the file-like object has callable `read` attribute
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
  */
-static PyObject* Decoder_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+static int decoder_check_fobject(PyObject *fobject)
 {
-    PyObject *fobject = NULL;
-    PyObject *fread = NULL;
-
-    if (!PyArg_ParseTuple(args, "O:Decoder", &fobject)) {
-        PyErr_SetString(PyExc_ValueError, "File-like object must be provided in a constructor of Decoder");
-        return NULL;
-    }
-
-    // Make sure the file-like object has callable `read` attribute
-    fread = PyObject_GetAttrString(fobject, "read");
+    PyObject *fread = PyObject_GetAttrString(fobject, "read");
     if (fread == NULL)
     {
         PyErr_SetString(PyExc_TypeError, "File-like object must have a read method");
-        return NULL;
+        return -1;
     }
 
 
@@ -84,12 +78,145 @@ static PyObject* Decoder_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     Py_DECREF(fread);
     if (!isCallable) {
         PyErr_SetString(PyExc_TypeError, "read attribute of file-like object must be callable");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Start decoding of a new source: reset the stream format and decode the first frame
+ */
+static void decoder_start(DecoderObject* self)
+{
+    self->output_buffer_begin = 0;
+    self->output_buffer_end = 0;
+
+#ifdef PYMP3_WITH_MINIMP3
+    self->input_begin = 0;
+    self->input_end = 0;
+    self->input_eof = 0;
+#endif
+
+    self->is_valid = 0;
+    self->mode = 0;
+    self->layer = 0;
+    self->bitrate = 0;
+    self->channels = 0;
+    self->samplerate = 0;
+    self->frame_count = 0;
+
+    self->bytes_read = 0;
+    self->frame_offset = 0;
+    self->frame_bitrate = 0;
+
+    self->sample_count = 0;
+    self->frame_samples = 0;
+    self->expected_offset = 0;
+    self->frame_size = 0;
+    Py_CLEAR(self->damage);
+    self->tag_bytes = 0;
+    self->tag_end = 0;
+    self->silence_frames = 0;
+    self->pending_size = 0;
+
+    /* explicitly decode the first frame with MPEG info (channels, samplerate, etc.) */
+    if (decoder_decode_frame(self) < 0)
+        PyErr_Clear();  // decoding can fail when file is not MP3 encoded
+}
+
+/**
+ * Parse the `channels` argument of the constructor: a sequence of 1 or 2 channel indexes
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int decoder_parse_channels(PyObject *channels, int *output_channels, int *noutput_channels)
+{
+    PyObject *sequence = PySequence_Fast(channels, "channels must be a sequence of channel indexes");
+    if (sequence == NULL)
+        return -1;
+
+    Py_ssize_t size = PySequence_Fast_GET_SIZE(sequence);
+    int result = (size == 1 || size == 2) ? 0 : -1;
+
+    for (Py_ssize_t i = 0; i < size && result == 0; i++)
+    {
+        long channel = PyLong_AsLong(PySequence_Fast_GET_ITEM(sequence, i));
+        if (channel == -1 && PyErr_Occurred())
+            PyErr_Clear();
+        if (channel != 0 && channel != 1)
+            result = -1;
+        output_channels[i] = (int) channel;
+    }
+    Py_DECREF(sequence);
+
+    if (result < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "channels must be a sequence of 1 or 2 channel indexes (0 for left, 1 for right)");
+        return -1;
+    }
+
+    *noutput_channels = (int) size;
+    return 0;
+}
+
+/**
+ * Creates a new Decoder object for the file-like object
+ */
+static PyObject* Decoder_create(PyTypeObject *type, PyObject *fobject, Py_ssize_t chunk_size, int resilient, int backend, PyObject *channels, int half_rate, Py_ssize_t memory_limit, int read_ahead)
+{
+    int output_channels[2] = { 0, 1 };
+    int noutput_channels = 0;
+
+    if (decoder_check_fobject(fobject) < 0)
+        return NULL;
+
+    if (channels != NULL && channels != Py_None &&
+        decoder_parse_channels(channels, output_channels, &noutput_channels) < 0)
+    {
+        return NULL;
+    }
+
+    if (chunk_size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "chunk_size must be positive");
+        return NULL;
+    }
+
+    if (backend != BACKEND_LIBMAD && !(backend == BACKEND_MINIMP3 && PYMP3_HAVE_MINIMP3)) {
+        PyErr_Format(PyExc_ValueError, "Decoder backend %d is not available (see mp3.BACKENDS)", backend);
+        return NULL;
+    }
+
+    if (half_rate && backend != BACKEND_LIBMAD) {
+        PyErr_SetString(PyExc_ValueError, "half_rate is supported by BACKEND_LIBMAD only");
+        return NULL;
+    }
+
+    if (memory_limit < 0 || (memory_limit > 0 && memory_limit < MIN_MEMORY_LIMIT)) {
+        PyErr_Format(PyExc_ValueError, "memory_limit must be 0 (no limit) or at least %d bytes", MIN_MEMORY_LIMIT);
+        return NULL;
+    }
+
+    if (read_ahead < 0) {
+        PyErr_SetString(PyExc_ValueError, "read_ahead must be 0 (synchronous reads) or a positive number of chunks");
+        return NULL;
+    }
+
+    /* The ring of the read-ahead may take a quarter of the memory limit */
+    if (memory_limit > 0 && (size_t) read_ahead * PYMP3_READAHEAD_CHUNK_SIZE > (size_t) memory_limit / 4) {
+        PyErr_Format(PyExc_ValueError, "read_ahead of %d chunks (%d bytes each) exceeds a quarter of memory_limit", read_ahead, PYMP3_READAHEAD_CHUNK_SIZE);
         return NULL;
     }
 
     DecoderObject* self = (DecoderObject*) type->tp_alloc(type, 0);
     if (self != NULL)
     {
+        if (pymp3_lock_init(&self->lock) < 0)
+        {
+            Py_DECREF(self);
+            return NULL;
+        }
+
         Py_INCREF(fobject);
         self->fobject = fobject;
 
@@ -98,56 +225,156 @@ static PyObject* Decoder_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
         mad_frame_init(&self->frame);
         mad_synth_init(&self->synth);
 
+        /* Half sample rate synthesis: libmad computes every other PCM sample. The option is kept by reset() */
+        self->half_rate = half_rate;
+        if (half_rate)
+            mad_stream_options(&self->stream, MAD_OPTION_HALFSAMPLERATE);
+
         /* One frame of MPEG Layer III is always 1152 samples, where each sample is 16-bit (2 bytes) for mono and x2 for stereo */
-        self->output_buffer_size = 1152*2*2;
-        self->output_buffer = malloc(self->output_buffer_size);
-        self->output_buffer_begin = 0;
-        self->output_buffer_end = 0;
+        self->output_buffer_size = pymp3_buffer_round(FRAME_BUFFER_SIZE);
+        self->output_buffer = pymp3_buffer_alloc(self->output_buffer_size);
 
         /* Input buffer for compressed frames. 2048 should be enough to keep one frame in the highest possible bit rate */
         self->input_buffer_size = 2048;
-        self->input_buffer = malloc(self->input_buffer_size);
 
-        self->is_valid = 0;
-        self->frame_count = 0;
+        self->backend = backend;
+#ifdef PYMP3_WITH_MINIMP3
+        if (backend == BACKEND_MINIMP3)
+        {
+            self->minimp3 = pymp3_minimp3_new();
+            if (self->minimp3 == NULL)
+            {
+                Py_DECREF(self);
+                return PyErr_NoMemory();
+            }
+
+            /* minimp3 syncs on several consecutive frames */
+            self->input_buffer_size = PYMP3_MINIMP3_INPUT_SIZE;
+        }
+#endif
+        self->input_buffer = pymp3_buffer_alloc(self->input_buffer_size);
+
+        if (self->output_buffer == NULL || self->input_buffer == NULL)
+        {
+            Py_DECREF(self);
+            return PyErr_NoMemory();
+        }
+
+        self->chunk_size = chunk_size;
+        self->resilient = resilient;
+        self->memory_limit = memory_limit;
+
+        self->output_channels[0] = output_channels[0];
+        self->output_channels[1] = output_channels[1];
+        self->noutput_channels = noutput_channels;
 
-        /* explicitly call read() to read the first frame with MPEG info (channels, samplerate, etc.) */
-        PyObject * arglist = Py_BuildValue("(i)", 0);   
+        /* All the selected channels are the same channel of the stream, it is synthesized alone */
+        self->synth_channel = -1;
+        if (noutput_channels == 1 || (noutput_channels == 2 && output_channels[0] == output_channels[1]))
+            self->synth_channel = output_channels[0];
 
-        // Note, Py_BuildValue() may fail due to MemoryError. In this case, we don't call read() method
-        if (arglist != NULL)
+        self->state = pymp3_get_state(type);
+
+        self->read_ahead_depth = read_ahead;
+        if (decoder_start_read_ahead(self) < 0 || decoder_check_memory_limit(self) < 0)
         {
-            PyObject * read_res = Decoder_read(self, arglist);
-            Py_DECREF(arglist);
-            if (read_res == NULL)
-                PyErr_Clear();  // read() can set error when file is not MP3 encoded
-            else
-                Py_DECREF(read_res);  // release memory
+            Py_DECREF(self);
+            return NULL;
         }
+
+        decoder_start(self);
+
+        decoder_update_memory(self);
+        pymp3_stats_publish(self->state, PYMP3_STATS_DECODER, &self->stats, &self->published);
     }
 
     return (PyObject*) self;
 }
 
+/**
+ * Instantiates the new Decoder class memory
+ */
+static PyObject* Decoder_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"fobject", "chunk_size", "resilient", "backend", "channels", "half_rate", "memory_limit", "read_ahead", NULL};
+
+    PyObject *fobject = NULL;
+    Py_ssize_t chunk_size = DEFAULT_CHUNK_SIZE;
+    int resilient = 0;
+    int backend = BACKEND_LIBMAD;
+    PyObject *channels = NULL;
+    int half_rate = 0;
+    Py_ssize_t memory_limit = 0;
+    int read_ahead = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|npiOpni:Decoder", kwlist, &fobject, &chunk_size, &resilient, &backend, &channels, &half_rate, &memory_limit, &read_ahead)) {
+        /* An invalid optional argument keeps the exception of PyArg_ParseTupleAndKeywords() */
+        if (fobject == NULL)
+        {
+            PyErr_SetString(PyExc_ValueError, "File-like object must be provided in a constructor of Decoder");
+        }
+        return NULL;
+    }
+
+    return Decoder_create(type, fobject, chunk_size, resilient, backend, channels, half_rate, memory_limit, read_ahead);
+}
+
+#if PY_VERSION_HEX >= 0x03090000
+/**
+ * Vectorcall entry point of the Decoder class, i.e. a fast path for `mp3.Decoder(fp)`
+ */
+PyObject* Decoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames)
+{
+    Py_ssize_t nargs = PyVectorcall_NARGS(nargsf);
+
+    if (nargs == 1 && kwnames == NULL)
+    {
+        return Decoder_create((PyTypeObject *) type, args[0], DEFAULT_CHUNK_SIZE, 0, BACKEND_LIBMAD, NULL, 0, 0, 0);
+    }
+
+    /* Keyword arguments are parsed by the regular constructor */
+    return pymp3_vectorcall_fallback((PyTypeObject *) type, args, nargs, kwnames);
+}
+#endif
+
 /**
  * Destroy the Decoder class
  */
 static void Decoder_dealloc(DecoderObject* self)
 {
+    pymp3_memory_publish(self->state, PYMP3_STATS_DECODER, 0, &self->memory_published);
+
+    decoder_stop_read_ahead(self);
+
     mad_synth_finish(&self->synth);
     mad_frame_finish(&self->frame);
     mad_stream_finish(&self->stream);
 
-    free(self->output_buffer);
+    pymp3_buffer_free(self->output_buffer, self->output_buffer_size);
     self->output_buffer = NULL;
 
-    free(self->input_buffer);
+    pymp3_buffer_free(self->input_buffer, self->input_buffer_size);
     self->input_buffer = NULL;
 
-    Py_DECREF(self->fobject);
+    pymp3_mem_free(self->pending_frame);
+    self->pending_frame = NULL;
+
+#ifdef PYMP3_WITH_MINIMP3
+    pymp3_minimp3_free(self->minimp3);
+    self->minimp3 = NULL;
+#endif
+
+    Py_XDECREF(self->fobject);
     self->fobject = NULL;
 
-    Py_TYPE(self)->tp_free((PyObject*) self);
+    Py_CLEAR(self->damage);
+
+    pymp3_lock_free(&self->lock);
+
+    /* Instances of heap types hold a reference to their type */
+    PyTypeObject *type = Py_TYPE(self);
+    type->tp_free((PyObject*) self);
+    Py_DECREF(type);
 }
 
 /**
@@ -159,362 +386,1574 @@ static int Decoder_init(DecoderObject* self, PyObject* args, PyObject* kwds)
     return 0;
 }
 
-/* convert the MAD fixed point format to a signed 16 bit int */
-static int16_t madfixed_to_int16(mad_fixed_t sample) {
-    /* A fixed point number is formed of the following bit pattern:
-    *
-    * SWWWFFFFFFFFFFFFFFFFFFFFFFFFFFFF
-    * MSB                          LSB
-    * S = sign
-    * W = whole part bits
-    * F = fractional part bits
-    *
-    * This pattern contains MAD_F_FRACBITS fractional bits, one should
-    * always use this macro when working on the bits of a fixed point
-    * number.  It is not guaranteed to be constant over the different
-    * platforms supported by libmad.
-    *
-    * The int16_t value is formed by the least significant
-    * whole part bit, followed by the 15 most significant fractional
-    * part bits.
-    *
-    * This algorithm was taken from input/mad/mad_engine.c in alsaplayer,
-    * which scales and rounds samples to 16 bits, unlike the version in
-    * madlld.
-    */
-
-    /* round */
-    sample += (1L << (MAD_F_FRACBITS - 16));
-
-    /* clip */
-    if (sample >= MAD_F_ONE)
-        sample = MAD_F_ONE - 1;
-    else if (sample < -MAD_F_ONE)
-        sample = -MAD_F_ONE;
+/**
+ * Whether read() of the object returns the bytes of its file descriptor as they are: io.FileIO, or io.BufferedReader
+ * of io.FileIO (open(path, 'rb')). Objects like gzip or bz2 files have a descriptor of the compressed file
+ *
+ * \return  1 if the descriptor can be read directly, 0 if not, -1 on error (Python exception is set)
+ */
+static int decoder_is_raw_file(PyObject *fobject)
+{
+    PyObject *io = PyImport_ImportModule("io");
+    if (io == NULL)
+        return -1;
 
-    /* quantize */
-    return sample >> (MAD_F_FRACBITS + 1 - 16);
-}
+    PyObject *file_io = PyObject_GetAttrString(io, "FileIO");
+    PyObject *buffered_reader = PyObject_GetAttrString(io, "BufferedReader");
+    Py_DECREF(io);
 
+    int result = -1;
+    if (file_io != NULL && buffered_reader != NULL)
+    {
+        /* Exact types only: a subclass can override read() */
+        if ((PyObject *) Py_TYPE(fobject) == file_io)
+            result = 1;
+        else if ((PyObject *) Py_TYPE(fobject) == buffered_reader)
+        {
+            PyObject *raw = PyObject_GetAttrString(fobject, "raw");
+            result = raw != NULL && (PyObject *) Py_TYPE(raw) == file_io;
+            Py_XDECREF(raw);
+            PyErr_Clear();
+        }
+        else
+            result = 0;
+    }
 
-/* 
-Concatenate buffer to a bytestring object.
-As bytes object is immutable, it will recreate new object.
-*/
-static int concat_bytes(PyObject **bytes, char const* buffer, Py_ssize_t len)
-{
-    PyObject * newpart = PyByteArray_FromStringAndSize((const char *)buffer, len);
-    PyBytes_ConcatAndDel(bytes, newpart);
-    if (bytes == NULL)
-        return 0;   // memory error, could not allocate a new bytestring
-    else
-        return 1;
+    Py_XDECREF(file_io);
+    Py_XDECREF(buffered_reader);
+    return result;
 }
 
 /**
- * Read the next block of audio (decoded on flight)
+ * Start the read-ahead thread when it is enabled and the file object is a plain binary file (see decoder_is_raw_file()).
+ * The thread reads the file from the current position of the object, which is not moved.
+ * Other file-like objects are read synchronously with their read() method
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
  */
-static PyObject* Decoder_read(DecoderObject* self, PyObject* args)
+static int decoder_start_read_ahead(DecoderObject* self)
 {
-    // An empty bytestring as a result from this function
-    PyObject * result_bytes = Py_BuildValue("y", "");
+    if (self->read_ahead_depth == 0)
+        return 0;
 
-    int remaining_read_size = -1;    // 256MB maximum supported size of one read operation
+    int raw_file = decoder_is_raw_file(self->fobject);
+    if (raw_file <= 0)
+        return raw_file;
 
-    int unrecoverable_error = 0;
-    char errmsg[ERROR_MSG_SIZE];
+    int fd = PyObject_AsFileDescriptor(self->fobject);
+    if (fd < 0)
+    {
+        PyErr_Clear();
+        return 0;
+    }
 
-    if(!PyArg_ParseTuple(args, "|i", &remaining_read_size))
+    PyObject *o_position = PyObject_CallMethod(self->fobject, "tell", NULL);
+    long long position = o_position != NULL ? PyLong_AsLongLong(o_position) : -1;
+    Py_XDECREF(o_position);
+    if (position < 0)
     {
-        PyErr_SetString(PyExc_ValueError, "A size argument is required to read() method");
-        return NULL;
+        PyErr_Clear();
+        return 0;
     }
-    
-    if (remaining_read_size == -1 || remaining_read_size > MAX_READ_BYTES)
+
+    self->read_ahead = pymp3_readahead_start(fd, position, self->read_ahead_depth);
+    if (self->read_ahead == NULL)
     {
-        remaining_read_size = MAX_READ_BYTES;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
     }
-    else if (remaining_read_size < 0)
+
+    return 0;
+}
+
+/**
+ * Stop the read-ahead thread, the GIL is released while waiting for its pending read
+ */
+static void decoder_stop_read_ahead(DecoderObject* self)
+{
+    pymp3_readahead *read_ahead = self->read_ahead;
+    self->read_ahead = NULL;
+
+    if (read_ahead != NULL)
     {
-        PyErr_SetString(PyExc_ValueError, "A size argument cannot be negative");
-        return NULL;
+        Py_BEGIN_ALLOW_THREADS;
+        pymp3_readahead_stop(read_ahead);
+        Py_END_ALLOW_THREADS;
     }
+}
 
-    /* User may call read(0) to read the first frame and initialize MPEG info (channels, samplerate, etc.) */
-    while(remaining_read_size > 0 || self->frame_count == 0)
+/**
+ * Take up to `size` bytes read ahead by the thread. The GIL is released only if the thread hasn't read the data yet,
+ * the time of such stalls is counted in the statistics
+ *
+ * \return  A number of bytes read, 0 on EOF, -1 on error (Python exception is set)
+ */
+static Py_ssize_t decoder_read_ahead_input(DecoderObject* self, unsigned char *buffer, Py_ssize_t size)
+{
+    ptrdiff_t readsize = pymp3_readahead_read(self->read_ahead, buffer, size, 0, NULL);
+    int error = errno;
+
+    if (readsize == PYMP3_READAHEAD_WAIT)
     {
-        /* If we have already available uncompressed data, copy them into the buffer */
-        int available = remaining_read_size > 0 ? self->output_buffer_end - self->output_buffer_begin : 0;
-        if(available > 0)
-        {
-            int size = (available > remaining_read_size) ? remaining_read_size : available;
-            if(!concat_bytes(&result_bytes, self->output_buffer + self->output_buffer_begin, size))
-                return NULL;
+        unsigned long long stall_ns = 0;
 
-            self->output_buffer_begin += size;
-            if (self->output_buffer_begin == self->output_buffer_end)
-            {
-                /* If we are here, then output_buffer is empty, so, reset the begin/end pointers. */
-                self->output_buffer_begin = 0;
-                self->output_buffer_end = 0;
-            }
+        Py_BEGIN_ALLOW_THREADS;
+        readsize = pymp3_readahead_read(self->read_ahead, buffer, size, 1, &stall_ns);
+        error = errno;
+        Py_END_ALLOW_THREADS;
 
-            remaining_read_size -= size;
-            if(remaining_read_size <= 0)
-            {
-                break;   /* we read all the requested bytes, return the read data */
-            }
-        }
-        else
-        {
-            if (unrecoverable_error) {
-                break;
-            }
-        }
+        self->stats.stalls++;
+        self->stats.stall_ns += stall_ns;
+    }
 
-        Py_ssize_t readsize, remaining;
-        unsigned char *readstart;
-        PyObject *o_read;
-        char *o_buffer;
+    if (readsize < 0)
+    {
+        errno = error;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
 
-        /* {2} libmad may not consume all bytes of the input
-        * buffer. If the last frame in the buffer is not wholly
-        * contained by it, then that frame's start is pointed by
-        * the next_frame member of the Stream structure. This
-        * common situation occurs when mad_frame_decode() fails,
-        * sets the stream error code to MAD_ERROR_BUFLEN, and
-        * sets the next_frame pointer to a non NULL value. (See
-        * also the comment marked {4} bellow.)
-        *
-        * When this occurs, the remaining unused bytes must be
-        * put back at the beginning of the buffer and taken in
-        * account before refilling the buffer. This means that
-        * the input buffer must be large enough to hold a whole
-        * frame at the highest observable bit-rate (currently 448
-        * kb/s). XXX=XXX Is 2016 bytes the size of the largest
-        * frame? (448000*(1152/32000))/8
-        */
-        if (self->stream.next_frame != NULL)
-        {
-            remaining = self->stream.bufend - self->stream.next_frame;
-            if (remaining >= self->input_buffer_size)
-            {
-                // Something is wrong (too much remaining data). Ignoring it
-                readstart = self->input_buffer;
-                readsize = self->input_buffer_size;
-                remaining = 0;
-            }
-            else {
-                memmove(self->input_buffer, self->stream.next_frame, remaining);
-                readstart = self->input_buffer + remaining;
-                readsize = self->input_buffer_size - remaining;
-            }
-        }
-        else
-        {
-            readstart = self->input_buffer;
-            readsize = self->input_buffer_size;
-            remaining = 0;
-        }
+    self->bytes_read += readsize;
+    self->stats.bytes_in += readsize;
+
+    return (Py_ssize_t) readsize;
+}
+
+/**
+ * Read up to `size` bytes from the file-like object into `buffer`.
+ *
+ * \return  A number of bytes read, 0 on EOF, -1 on error (Python exception is set)
+ */
+static Py_ssize_t decoder_read_input(DecoderObject* self, unsigned char *buffer, Py_ssize_t size)
+{
+    if (self->read_ahead != NULL)
+        return decoder_read_ahead_input(self, buffer, size);
+
+    Py_ssize_t readsize;
+    PyObject *o_read;
+    char *o_buffer;
 
-        // Call read() method on a file-like object
-        o_read = PyObject_CallMethod(self->fobject, "read", "i", readsize);
-        if (o_read == NULL) {
+    // Call read() method on a file-like object
+    int timers = PYMP3_TIMERS_ENABLED(self->state);
+    unsigned long long started = PYMP3_TIMER_START(timers);
+    o_read = PyObject_CallMethod(self->fobject, "read", "n", size);
+    PYMP3_TIMER_STOP(timers, started, self->stats.io_ns);
+    self->stats.io_calls++;
+
+    if (o_read == NULL) {
 
 # if 0 // Unfortunately, _PyErr_ChainExceptions() is not supported in PyPy interpreter
-            // Chain the previous exception to a new exception RuntimeError
-            PyObject *exc, *val, *tb;
-            PyErr_Fetch(&exc, &val, &tb);
-            PyErr_SetString(PyExc_RuntimeError, "Failure in calling read() method of the file-like object");
-            _PyErr_ChainExceptions(exc, val, tb);
+        // Chain the previous exception to a new exception RuntimeError
+        PyObject *exc, *val, *tb;
+        PyErr_Fetch(&exc, &val, &tb);
+        PyErr_SetString(PyExc_RuntimeError, "Failure in calling read() method of the file-like object");
+        _PyErr_ChainExceptions(exc, val, tb);
 # else
-            PyErr_SetString(PyExc_RuntimeError, "Failure in calling read() method of the file-like object");
+        PyErr_SetString(PyExc_RuntimeError, "Failure in calling read() method of the file-like object");
 # endif
 
-            Py_DECREF(result_bytes);
-            return NULL;
-        }
+        return -1;
+    }
 
-        PyBytes_AsStringAndSize(o_read, &o_buffer, &readsize);
-        if(PyErr_Occurred())
-        {
+    PyBytes_AsStringAndSize(o_read, &o_buffer, &readsize);
+    if(PyErr_Occurred())
+    {
 
 # if 0 // Unfortunately, _PyErr_ChainExceptions() is not supported in PyPy interpreter
-            // Chain the previous exception to a new exception RuntimeError
-            PyObject *exc, *val, *tb;
-            PyErr_Fetch(&exc, &val, &tb);
-            PyErr_SetString(PyExc_RuntimeError, "Failure in reading bytes from file-like object (Is it opened in binary mode?)");
-            _PyErr_ChainExceptions(exc, val, tb);
+        // Chain the previous exception to a new exception RuntimeError
+        PyObject *exc, *val, *tb;
+        PyErr_Fetch(&exc, &val, &tb);
+        PyErr_SetString(PyExc_RuntimeError, "Failure in reading bytes from file-like object (Is it opened in binary mode?)");
+        _PyErr_ChainExceptions(exc, val, tb);
 # else
-            PyErr_SetString(PyExc_RuntimeError, "Failure in reading bytes from file-like object (Is it opened in binary mode?)");
+        PyErr_SetString(PyExc_RuntimeError, "Failure in reading bytes from file-like object (Is it opened in binary mode?)");
 # endif
 
-            Py_DECREF(o_read);
-            Py_DECREF(result_bytes);
-            return NULL;
-        }
+        Py_DECREF(o_read);
+        return -1;
+    }
 
-        /* EOF is reached. Return whatever is read */
-        if (readsize == 0) {
-            Py_DECREF(o_read);
-            break;
-        }
+    if (readsize > size)
+        readsize = size;   // the file-like object returned more data than requested
 
-        memcpy(readstart, o_buffer, readsize);
-        Py_DECREF(o_read);
+    memcpy(buffer, o_buffer, readsize);
+    Py_DECREF(o_read);
 
-        /* Pipe the new buffer content to libmad's stream decode facility */
-        Py_BEGIN_ALLOW_THREADS;
-        mad_stream_buffer(&self->stream, self->input_buffer, readsize + remaining);
-        self->stream.error = MAD_ERROR_NONE;
-        Py_END_ALLOW_THREADS;
+    self->bytes_read += readsize;
+    self->stats.bytes_in += readsize;
 
-        while(1)
-        {
-            /* Decode the next MPEG frame. The streams is read from the
-            * buffer, its constituents are break down and stored the the
-            * Frame structure, ready for examination/alteration or PCM
-            * synthesis. Decoding options are carried in the Frame
-            * structure from the Stream structure.
-            *
-            * Error handling: mad_frame_decode() returns a non zero value
-            * when an error occurs. The error condition can be checked in
-            * the error member of the Stream structure. A mad error is
-            * recoverable or fatal, the error status is checked with the
-            * MAD_RECOVERABLE macro.
-            *
-            * {4} When a fatal error is encountered all decoding
-            * activities shall be stopped, except when a MAD_ERROR_BUFLEN
-            * is signaled. This condition means that the
-            * mad_frame_decode() function needs more input to complete
-            * its work. One shall refill the buffer and repeat the
-            * mad_frame_decode() call. Some bytes may be left unused at
-            * the end of the buffer if those bytes forms an incomplete
-            * frame. Before refilling, the remaining bytes must be moved
-            * to the beginning of the buffer and used for input for the
-            * next mad_frame_decode() invocation. (See the comments
-            * marked {2} earlier for more details.)
-            *
-            * Recoverable errors are caused by malformed bit-streams, in
-            * this case one can call again mad_frame_decode() in order to
-            * skip the faulty part and re-sync to the next frame.
-            */
+    return readsize;
+}
 
-            int result;
+/**
+ * Refill the input buffer of libmad from the file-like object.
+ *
+ * \return  1 if new data is available, 0 on EOF, -1 on error (Python exception is set)
+ */
+static int decoder_fill_input(DecoderObject* self)
+{
+    Py_ssize_t readsize, remaining;
+    unsigned char *readstart;
+
+    /* {2} libmad may not consume all bytes of the input
+    * buffer. If the last frame in the buffer is not wholly
+    * contained by it, then that frame's start is pointed by
+    * the next_frame member of the Stream structure. This
+    * common situation occurs when mad_frame_decode() fails,
+    * sets the stream error code to MAD_ERROR_BUFLEN, and
+    * sets the next_frame pointer to a non NULL value. (See
+    * also the comment marked {4} bellow.)
+    *
+    * When this occurs, the remaining unused bytes must be
+    * put back at the beginning of the buffer and taken in
+    * account before refilling the buffer. This means that
+    * the input buffer must be large enough to hold a whole
+    * frame at the highest observable bit-rate (currently 448
+    * kb/s). XXX=XXX Is 2016 bytes the size of the largest
+    * frame? (448000*(1152/32000))/8
+    */
+    if (self->stream.next_frame != NULL)
+    {
+        remaining = self->stream.bufend - self->stream.next_frame;
+        if (remaining >= self->input_buffer_size)
+        {
+            // Something is wrong (too much remaining data). Ignoring it
+            readstart = self->input_buffer;
+            readsize = self->input_buffer_size;
+            remaining = 0;
+        }
+        else {
+            memmove(self->input_buffer, self->stream.next_frame, remaining);
+            readstart = self->input_buffer + remaining;
+            readsize = self->input_buffer_size - remaining;
+        }
+    }
+    else
+    {
+        readstart = self->input_buffer;
+        readsize = self->input_buffer_size;
+        remaining = 0;
+    }
 
-            Py_BEGIN_ALLOW_THREADS;
-            result = mad_frame_decode(&self->frame, &self->stream);
-            Py_END_ALLOW_THREADS;
+    readsize = decoder_read_input(self, readstart, readsize);
+    if (readsize <= 0)
+        return (int) readsize;   /* EOF is reached, or error */
 
-            if (result)
-            {
-                if (MAD_RECOVERABLE(self->stream.error))
-                {
-                    // recoverable frame level error (malformed bit-streams), read the next frame
-                    continue;
-                }
-                else
-                {
-                    if (self->stream.error == MAD_ERROR_BUFLEN)
-                    {
-                        /* There is no enough binary data to decode. Decode it the next time. See {2}. */
-                    }
-                    else
-                    {
-                        snprintf(errmsg, ERROR_MSG_SIZE, "Unrecoverable mpeg frame level error: %s", mad_stream_errorstr(&self->stream));
-                        unrecoverable_error = 1;
-                    }
-                    break;
-                }
-            }
+    /* Pipe the new buffer content to libmad's stream decode facility */
+    mad_stream_buffer(&self->stream, self->input_buffer, readsize + remaining);
+    self->stream.error = MAD_ERROR_NONE;
 
-            if (self->frame_count++ == 0)
-            {
-                // Read the stream format from the first frame
-                self->is_valid = 1;
-                self->channels = MAD_NCHANNELS(&self->frame.header);
-                self->bitrate = self->frame.header.bitrate/1000;
-                self->samplerate = self->frame.header.samplerate;
-                self->mode = self->frame.header.mode;
-                self->layer = self->frame.header.layer;
-            }
+    return 1;
+}
 
+/**
+ * Whether the parsed frame header is consistent with the format of the stream (any header before the first frame)
+ */
+static int decoder_header_matches(DecoderObject* self, const pymp3_header *header)
+{
+    return self->frame_count == 0 || (header->samplerate == self->samplerate && header->layer == self->layer);
+}
 
-            /* Once decoded, the frame can be synthesized to PCM samples. 
-            * No errors are reported by mad_synth_frame(); */
-            Py_BEGIN_ALLOW_THREADS;
-            mad_synth_frame(&self->synth, &self->frame);
-            Py_END_ALLOW_THREADS;
+/**
+ * Resilient mode: skip corrupted data after a recoverable libmad error.
+ *
+ * After a header error libmad tries every frame sync pattern, one per call of mad_frame_decode().
+ * Instead, the input buffer is scanned for the next header consistent with the stream format,
+ * which is confirmed by the header of the following frame when it is already in the buffer.
+ * After an error in the frame body, the frame state is muted, so the damaged frame doesn't leak into the next one.
+ */
+static void decoder_resync(DecoderObject* self)
+{
+    struct mad_stream *stream = &self->stream;
 
-            /* Synthesized samples must be converted from libmad's fixed
-            * point number to the consumer format. Here we use unsigned
-            * 16 bit big endian integers on two channels. Integer samples
-            * are temporarily stored in a buffer that is flushed when
-            * full.
-            */
+    if ((stream->error & 0xff00) != 0x0100)
+    {
+        mad_frame_mute(&self->frame);
+        return;
+    }
 
-            struct mad_pcm *pcm = &self->synth.pcm;
+    /* libmad has set next_frame past the bogus frame sync. The data from this_frame is skipped, except the tags in it */
+    const unsigned char *ptr = stream->this_frame;
+    const unsigned char *end = stream->bufend;
+    unsigned long long offset = self->bytes_read - (unsigned long long)(end - ptr);
+    pymp3_header header, next_header;
 
-            /* Get this frame's info.
-               Note, it is possible that this frame's info (like a number of channels) 
-               is different form the very first frame.
-            */
-            unsigned int frame_nchannels = pcm->channels;
-            unsigned int frame_nsamples  = pcm->length;
-            mad_fixed_t const * left_ch   = pcm->samples[0];
-            mad_fixed_t const * right_ch  = pcm->samples[1];
+    /* The rest of a tag found in the previous data */
+    if (self->tag_end > offset)
+        ptr = (self->tag_end - offset < (unsigned long long)(end - ptr)) ? ptr + (self->tag_end - offset) : end;
 
-            int size = frame_nsamples * self->channels * sizeof(short);
-            if (self->output_buffer_end + size > self->output_buffer_size)
+    while (end - ptr >= PYMP3_HEADER_SIZE)
+    {
+        if (*ptr == 0xff && ptr >= stream->next_frame)
+        {
+            if (pymp3_parse_header(ptr, &header) == 0 && decoder_header_matches(self, &header))
             {
-                /* increase buffer size, if necessary */
-                self->output_buffer_size = self->output_buffer_end + size;
-                unsigned char * new_buffer = realloc(self->output_buffer, self->output_buffer_size);
-                if (new_buffer == NULL)
+                if (header.frame_size == 0 || end - ptr < header.frame_size + PYMP3_HEADER_SIZE ||
+                    (pymp3_parse_header(ptr + header.frame_size, &next_header) == 0 && decoder_header_matches(self, &next_header)))
                 {
-                    PyErr_SetString(PyExc_MemoryError, "Could not allocate memory for output buffer");
-                    Py_DECREF(result_bytes);
-                    return NULL;
+                    stream->next_frame = ptr;
+                    return;
                 }
-                self->output_buffer = new_buffer;
             }
+        }
+        else if (*ptr == 'I' || *ptr == 'A' || *ptr == 'T')
+        {
+            Py_ssize_t tag_size = decoder_skip_tag(self, ptr, end - ptr, self->bytes_read - (unsigned long long)(end - ptr));
+            if (tag_size > 0)
+            {
+                ptr = (tag_size < end - ptr) ? ptr + tag_size : end;
+                continue;
+            }
+        }
 
-            int16_t	* output_ptr = (int16_t *)(self->output_buffer + self->output_buffer_end);
-            self->output_buffer_end += size;
+        ptr++;
+    }
 
-            //--------------- Convert mad_fixed_t samples to PCM ---------------------
-            int16_t sample;
-            while (frame_nsamples--) {
-                sample = madfixed_to_int16(*left_ch++);
-                *(output_ptr++) = sample;
+    /* No frame in the buffer. Keep its tail, which can be the beginning of a header or a tag (unless a tag continues), and read more data */
+    if (self->tag_end >= self->bytes_read)
+        stream->next_frame = end;
+    else if (end - stream->next_frame > PYMP3_TAG_HEADER_SIZE - 1)
+        stream->next_frame = end - (PYMP3_TAG_HEADER_SIZE - 1);
+    stream->error = MAD_ERROR_BUFLEN;
+}
 
-                /* Each MP3 frame can be encoded with differnet mode (STEREO vs MONO).
-                *  If we encounter a change in a number of channels, we stick to first frame's mode.
-                */
-                if(self->channels == 2)
-                {
-                    if (frame_nchannels == 2)
-                        sample = madfixed_to_int16(*right_ch++);
+/**
+ * Resilient mode: if an ID3v2, APE or ID3v1 tag starts at `ptr` (`size` bytes available, at `offset` of the source),
+ * count it out of the data skipped since the last decoded frame. Tags between frames (e.g. of concatenated files) are not damage
+ *
+ * \return  The size of the tag, or 0 if there is no tag
+ */
+static Py_ssize_t decoder_skip_tag(DecoderObject* self, const unsigned char *ptr, Py_ssize_t size, unsigned long long offset)
+{
+    if (offset < self->tag_end)
+        return 0;
+
+    Py_ssize_t tag_size = pymp3_tag_size(ptr, size);
+    if (tag_size > 0)
+    {
+        self->tag_bytes += tag_size;
+        self->tag_end = offset + tag_size;
+    }
+    return tag_size;
+}
+
+/**
+ * Resilient mode: check the position of the decoded frame (at `frame_offset`, of `frame_size` bytes and `frame_samples` samples),
+ * and record the range of data skipped before it. The number of lost frames is estimated from the size of the previous frame,
+ * not counting the tags in the skipped data, and it is capped at MAX_LOST_FRAMES.
+ *
+ * \return  The number of lost frames, or -1 on error (Python exception is set)
+ */
+static long decoder_check_damage(DecoderObject* self, unsigned long frame_size, unsigned int frame_samples)
+{
+    unsigned long long expected_offset = self->expected_offset;
+    unsigned long previous_size = self->frame_size;
+    unsigned long long tag_bytes = self->tag_bytes;
+
+    self->frame_size = frame_size;
+    self->expected_offset = self->frame_offset + frame_size;
+    self->tag_bytes = 0;
+
+    if (self->frame_count <= 1 || self->frame_offset <= expected_offset + tag_bytes)
+        return 0;
+
+    /* Tags in the skipped data are not a part of the lost audio, and the estimate is capped for long runs of junk */
+    unsigned long long gap = self->frame_offset - expected_offset - tag_bytes;
+    unsigned long long estimate = previous_size > 0 ? (gap + previous_size / 2) / previous_size : 0;
+    long lost_frames = estimate < MAX_LOST_FRAMES ? (long) estimate : MAX_LOST_FRAMES;
+    unsigned long long lost_samples = (unsigned long long) lost_frames * frame_samples;
+
+    if (self->damage == NULL)
+    {
+        self->damage = PyList_New(0);
+        if (self->damage == NULL)
+            return -1;
+    }
+
+    PyObject *range = Py_BuildValue("(KKKK)", expected_offset, self->frame_offset, self->sample_count, self->sample_count + lost_samples);
+    if (range == NULL)
+        return -1;
+
+    int res = PyList_Append(self->damage, range);
+    Py_DECREF(range);
+    if (res < 0)
+        return -1;
+
+    return lost_frames;
+}
+
+/**
+ * Size of the native buffers of the decoder: input and output buffers, and buffers allocated by the backend
+ */
+static size_t decoder_memory(DecoderObject* self)
+{
+    size_t memory = self->input_buffer_size + self->output_buffer_size;
+
+    /* libmad allocates the main data buffer and the overlap buffer on the first Layer III frame */
+    if (self->stream.main_data != NULL)
+        memory += MAD_BUFFER_MDLEN;
+    if (self->frame.overlap != NULL)
+        memory += sizeof(*self->frame.overlap);
+
+#ifdef PYMP3_WITH_MINIMP3
+    if (self->minimp3 != NULL)
+        memory += pymp3_minimp3_size();
+#endif
+
+    if (self->read_ahead != NULL)
+        memory += pymp3_readahead_memory(self->read_ahead);
+
+    if (self->pending_frame != NULL)
+        memory += FRAME_BUFFER_SIZE;
+
+    return memory;
+}
+
+/**
+ * Publish the size of the native buffers to the module-wide memory usage
+ */
+static void decoder_update_memory(DecoderObject* self)
+{
+    pymp3_memory_publish(self->state, PYMP3_STATS_DECODER, decoder_memory(self), &self->memory_published);
+}
+
+/**
+ * Check if `size` more bytes can be appended to the output buffer within the memory limit.
+ * The output buffer may take a half of the limit, the rest is left for the results of the methods
+ */
+static int decoder_output_fits(DecoderObject* self, size_t size)
+{
+    size_t new_size = self->output_buffer_end + size;
+
+    if (self->memory_limit == 0 || new_size <= self->output_buffer_size)
+        return 1;
+
+    return decoder_memory(self) - self->output_buffer_size + new_size <= self->memory_limit / 2;
+}
+
+/**
+ * Check that one frame of PCM data fits in the memory limit, together with the buffers allocated on the first frames:
+ * libmad's Layer III buffers, and the pending frame of resilient mode. Otherwise no frame could ever be decoded
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int decoder_check_memory_limit(DecoderObject* self)
+{
+    if (self->memory_limit == 0)
+        return 0;
+
+    size_t memory = decoder_memory(self) - self->output_buffer_size + FRAME_BUFFER_SIZE;
+    if (self->backend == BACKEND_LIBMAD && self->stream.main_data == NULL)
+        memory += MAD_BUFFER_MDLEN;
+    if (self->backend == BACKEND_LIBMAD && self->frame.overlap == NULL)
+        memory += sizeof(*self->frame.overlap);
+    if (self->resilient && self->pending_frame == NULL)
+        memory += FRAME_BUFFER_SIZE;
+
+    if (memory > self->memory_limit / 2)
+    {
+        PyErr_Format(PyExc_ValueError, "memory_limit of %zu bytes is too small, decoding of one frame needs at least %zu bytes", self->memory_limit, 2 * memory);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Maximum size of the result of one call (whole samples of all channels), which keeps the decoder within the memory limit
+ */
+static Py_ssize_t decoder_result_limit(DecoderObject* self)
+{
+    if (self->memory_limit == 0)
+        return MAX_READ_BYTES;
+
+    size_t memory = decoder_memory(self);
+    size_t limit = memory < self->memory_limit ? self->memory_limit - memory : 0;
+    if (self->channels > 0)
+        limit -= limit % (self->channels * sizeof(short));
+
+    return limit < MAX_READ_BYTES ? (Py_ssize_t) limit : MAX_READ_BYTES;
+}
+
+/**
+ * Make sure the output buffer has room for `size` more bytes
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int decoder_reserve_output(DecoderObject* self, size_t size)
+{
+    if (self->output_buffer_end + size > self->output_buffer_size)
+    {
+        /* Not expected: the constructor checks that one frame fits, and decoder_decode_frame() stops while data is buffered */
+        if (!decoder_output_fits(self, size))
+        {
+            PyErr_Format(PyExc_MemoryError, "Decoder memory limit exceeded: %zu bytes of PCM data do not fit in %zu bytes",
+                         (size_t) self->output_buffer_end + size, self->memory_limit);
+            return -1;
+        }
+
+        /* increase buffer size, if necessary: up to a size class of the allocator, unless it is past the memory limit */
+        size_t new_size = pymp3_buffer_round(self->output_buffer_end + size);
+        if (!decoder_output_fits(self, new_size - self->output_buffer_end))
+            new_size = self->output_buffer_end + size;
+
+        unsigned char * new_buffer = pymp3_mem_realloc(self->output_buffer, new_size);
+        if (new_buffer == NULL)
+        {
+            PyErr_SetString(PyExc_MemoryError, "Could not allocate memory for output buffer");
+            return -1;
+        }
+        self->output_buffer = new_buffer;
+        self->output_buffer_size = new_size;
+
+        decoder_update_memory(self);
+    }
+
+    return 0;
+}
+
+/**
+ * Resilient mode: allocate the buffer of the frame decoded after lost frames
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int decoder_reserve_pending(DecoderObject* self)
+{
+    if (self->pending_frame == NULL)
+    {
+        self->pending_frame = pymp3_mem_malloc(FRAME_BUFFER_SIZE);
+        if (self->pending_frame == NULL)
+        {
+            PyErr_SetString(PyExc_MemoryError, "Could not allocate memory for pending frame");
+            return -1;
+        }
+        decoder_update_memory(self);
+    }
+
+    return 0;
+}
+
+/**
+ * Resilient mode: append the next frame of silence of lost frames, or the frame decoded after them, to the output buffer.
+ * The silence is emitted one frame per call, so the output buffer doesn't grow with the number of lost frames.
+ * In planar mode, the pending frame is split into planes.
+ *
+ * \return  1 if a frame is appended, -1 on error (Python exception is set)
+ */
+static int decoder_emit_pending(DecoderObject* self)
+{
+    size_t size = self->pending_size;
+    if (decoder_reserve_output(self, size) < 0)
+        return -1;
+
+    unsigned char *output_ptr = self->output_buffer + self->output_buffer_end;
+    if (self->silence_frames > 0)
+    {
+        memset(output_ptr, 0, size);
+        self->silence_frames--;
+    }
+    else
+    {
+        if (self->planar && self->channels == 2)
+        {
+            size_t nsamples = size / (2 * sizeof(short));
+            pymp3_int16_deinterleave((int16_t *) output_ptr, (int16_t *) output_ptr + nsamples, (const int16_t *) self->pending_frame, nsamples);
+        }
+        else
+        {
+            memcpy(output_ptr, self->pending_frame, size);
+        }
+        self->pending_size = 0;
+    }
+
+    self->output_buffer_end += size;
+    self->stats.bytes_out += size;
+    return 1;
+}
+
+/**
+ * Decode exactly one MPEG frame and append its PCM samples to the output buffer.
+ *
+ * The input buffer is refilled only when libmad reports that it needs more data,
+ * so a frame is available to the caller as soon as its last byte is read.
+ *
+ * With a memory limit, no frame is decoded while the output buffer holds data and one more frame doesn't fit (backpressure):
+ * the caller returns the buffered data, and decoding continues in the next call.
+ *
+ * \return  1 if a frame is decoded, 0 on EOF or when the output buffer is full, -1 on error (Python exception is set)
+ */
+static int decoder_decode_frame(DecoderObject* self)
+{
+    if (self->output_buffer_end > self->output_buffer_begin && !decoder_output_fits(self, FRAME_BUFFER_SIZE))
+        return 0;
+
+    /* Resilient mode: the silence of lost frames and the frame after them go first */
+    if (self->pending_size > 0)
+        return decoder_emit_pending(self);
+
+#ifdef PYMP3_WITH_MINIMP3
+    if (self->backend == BACKEND_MINIMP3)
+        return decoder_decode_frame_minimp3(self);
+#endif
+
+    int timers = PYMP3_TIMERS_ENABLED(self->state);
+    unsigned long long started;
+
+    while(1)
+    {
+        if (self->stream.buffer == NULL || self->stream.error == MAD_ERROR_BUFLEN)
+        {
+            /* There is no enough binary data to decode. See {2}. */
+            int res = decoder_fill_input(self);
+            if (res <= 0)
+                return res;
+        }
+
+        /* Decode the next MPEG frame. The streams is read from the
+        * buffer, its constituents are break down and stored the the
+        * Frame structure, ready for examination/alteration or PCM
+        * synthesis. Decoding options are carried in the Frame
+        * structure from the Stream structure.
+        *
+        * Error handling: mad_frame_decode() returns a non zero value
+        * when an error occurs. The error condition can be checked in
+        * the error member of the Stream structure. A mad error is
+        * recoverable or fatal, the error status is checked with the
+        * MAD_RECOVERABLE macro.
+        *
+        * {4} When a fatal error is encountered all decoding
+        * activities shall be stopped, except when a MAD_ERROR_BUFLEN
+        * is signaled. This condition means that the
+        * mad_frame_decode() function needs more input to complete
+        * its work. One shall refill the buffer and repeat the
+        * mad_frame_decode() call. Some bytes may be left unused at
+        * the end of the buffer if those bytes forms an incomplete
+        * frame. Before refilling, the remaining bytes must be moved
+        * to the beginning of the buffer and used for input for the
+        * next mad_frame_decode() invocation. (See the comments
+        * marked {2} earlier for more details.)
+        *
+        * Recoverable errors are caused by malformed bit-streams, in
+        * this case one can call again mad_frame_decode() in order to
+        * skip the faulty part and re-sync to the next frame.
+        */
+
+        int result;
+
+        started = PYMP3_TIMER_START(timers);
+        Py_BEGIN_ALLOW_THREADS;
+        result = mad_frame_decode(&self->frame, &self->stream);
+        Py_END_ALLOW_THREADS;
+        PYMP3_TIMER_STOP(timers, started, self->stats.codec_ns);
+
+        if (result)
+        {
+            if (MAD_RECOVERABLE(self->stream.error))
+            {
+                self->stats.sync_errors++;
+
+                if (self->resilient)
+                    decoder_resync(self);
+            }
+
+            if (MAD_RECOVERABLE(self->stream.error) || self->stream.error == MAD_ERROR_BUFLEN)
+            {
+                // recoverable frame level error (malformed bit-streams), read the next frame
+                continue;
+            }
+
+            PyErr_Format(PyExc_RuntimeError, "Unrecoverable mpeg frame level error: %s", mad_stream_errorstr(&self->stream));
+            return -1;
+        }
+
+        if (self->resilient && self->frame_count > 0 &&
+            (self->frame.header.samplerate != (unsigned int) self->samplerate || self->frame.header.layer != self->layer))
+        {
+            // A false frame sync within corrupted data, which libmad accepted. Skip it, it is a part of the damaged range
+            self->stats.sync_errors++;
+            mad_frame_mute(&self->frame);
+            continue;
+        }
+
+        if (self->frame_count++ == 0)
+        {
+            // Read the stream format from the first frame
+            self->is_valid = 1;
+            self->channels = self->noutput_channels ? self->noutput_channels : MAD_NCHANNELS(&self->frame.header);
+            self->bitrate = self->frame.header.bitrate/1000;
+            self->samplerate = self->frame.header.samplerate;
+            self->mode = self->frame.header.mode;
+            self->layer = self->frame.header.layer;
+        }
+
+        /* Position of this frame in the source: the input buffer always holds the tail of the data read so far */
+        self->frame_offset = self->bytes_read - (unsigned long long)(self->stream.bufend - self->stream.this_frame);
+        self->frame_bitrate = self->frame.header.bitrate/1000;
+
+        /* Frames lost since the previous decoded frame are replaced with silence to keep the timeline */
+        long lost_frames = 0;
+        if (self->resilient)
+        {
+            lost_frames = decoder_check_damage(self, self->stream.next_frame - self->stream.this_frame, DECODER_SUBBAND_SAMPLES(self) * MAD_NSBSAMPLES(&self->frame.header));
+            if (lost_frames < 0)
+                return -1;
+        }
+
+        if (self->analysis)
+        {
+            /* The synthesis filter bank interpolates each subband by 32 with the gain of 32, so the sum of squares of
+            *  the subband samples of one time slot approximates the sum of squares of 32 PCM samples. The level of
+            *  the frame is known without synthesis and PCM conversion.
+            */
+            unsigned int nsbsamples = MAD_NSBSAMPLES(&self->frame.header);
+            unsigned int nchannels = MAD_NCHANNELS(&self->frame.header);
+            double energy = 0.0;
+
+            /* The output channels are measured */
+            started = PYMP3_TIMER_START(timers);
+            for (int c = 0; c < self->channels; c++)
+            {
+                unsigned int ch = self->noutput_channels ? (unsigned int) self->output_channels[c] : (unsigned int) c;
+                energy += pymp3_fixed_energy(&self->frame.sbsample[ch < nchannels ? ch : 0][0][0], nsbsamples * 32);
+            }
+            PYMP3_TIMER_STOP(timers, started, self->stats.convert_ns);
+
+            self->frame_mean_square = energy / (nsbsamples * self->channels);
+            self->frame_lost = lost_frames;
+            self->frame_samples = DECODER_SUBBAND_SAMPLES(self) * nsbsamples;
+            self->stats.frames++;
+            self->sample_count += (unsigned long long) (lost_frames + 1) * self->frame_samples;
+            return 1;
+        }
+
+        /* Once decoded, the frame can be synthesized to PCM samples. 
+        * No errors are reported by mad_synth_frame(); */
+        started = PYMP3_TIMER_START(timers);
+        Py_BEGIN_ALLOW_THREADS;
+        if (self->synth_channel >= 0 && MAD_NCHANNELS(&self->frame.header) == 2)
+        {
+            /* Only one channel is selected: it is synthesized alone as a mono frame (in the filter of channel 0) */
+            enum mad_mode mode = self->frame.header.mode;
+            if (self->synth_channel == 1)
+                memcpy(self->frame.sbsample[0], self->frame.sbsample[1], MAD_NSBSAMPLES(&self->frame.header) * sizeof(self->frame.sbsample[0][0]));
+
+            self->frame.header.mode = MAD_MODE_SINGLE_CHANNEL;
+            mad_synth_frame(&self->synth, &self->frame);
+            self->frame.header.mode = mode;
+        }
+        else
+        {
+            mad_synth_frame(&self->synth, &self->frame);
+        }
+        Py_END_ALLOW_THREADS;
+        PYMP3_TIMER_STOP(timers, started, self->stats.synth_ns);
+
+        /* Synthesized samples must be converted from libmad's fixed
+        * point number to the consumer format. Here we use unsigned
+        * 16 bit big endian integers on two channels. Integer samples
+        * are temporarily stored in a buffer that is flushed when
+        * full.
+        */
+
+        struct mad_pcm *pcm = &self->synth.pcm;
+
+        /* Get this frame's info.
+           Note, it is possible that this frame's info (like a number of channels) 
+           is different form the very first frame.
+        */
+        unsigned int frame_nchannels = pcm->channels;
+        unsigned int frame_nsamples  = pcm->length;
+
+        /* Samples of the output channels, the channel of a mono frame is used for both output channels */
+        mad_fixed_t const * sources[2];
+        for (int c = 0; c < self->channels; c++)
+        {
+            unsigned int ch = self->noutput_channels ? (unsigned int) self->output_channels[c] : (unsigned int) c;
+            sources[c] = pcm->samples[ch < frame_nchannels ? ch : 0];
+        }
+
+        int size = frame_nsamples * self->channels * sizeof(short);
+        int planar = self->planar;
+        int16_t	* output_ptr;
+
+        if (lost_frames > 0)
+        {
+            /* The frame waits for the silence of the lost frames, and it is kept interleaved (see decoder_emit_pending) */
+            if (decoder_reserve_pending(self) < 0)
+                return -1;
+            output_ptr = (int16_t *) self->pending_frame;
+            planar = 0;
+        }
+        else
+        {
+            if (decoder_reserve_output(self, size) < 0)
+                return -1;
+            output_ptr = (int16_t *)(self->output_buffer + self->output_buffer_end);
+            self->output_buffer_end += size;
+            self->stats.bytes_out += size;
+        }
+
+        //--------------- Convert mad_fixed_t samples to PCM ---------------------
+        /* Each MP3 frame can be encoded with differnet mode (STEREO vs MONO).
+        *  If we encounter a change in a number of channels, we stick to first frame's mode.
+        *  In planar mode of read_planar(), the channels of the frame are stored one after another.
+        */
+        started = PYMP3_TIMER_START(timers);
+        if (planar)
+        {
+            for (int c = 0; c < self->channels; c++)
+                pymp3_fixed_to_int16(output_ptr + c * frame_nsamples, sources[c], sources[c], frame_nsamples, 1);
+        }
+        else
+        {
+            pymp3_fixed_to_int16(output_ptr, sources[0], self->channels == 2 ? sources[1] : sources[0], frame_nsamples, self->channels);
+        }
+        PYMP3_TIMER_STOP(timers, started, self->stats.convert_ns);
+
+        self->stats.frames++;
+        self->sample_count += (unsigned long long) (lost_frames + 1) * pcm->length;
+        self->frame_samples = pcm->length;
+
+        if (lost_frames > 0)
+        {
+            self->silence_frames = lost_frames;
+            self->pending_size = size;
+            return decoder_emit_pending(self);
+        }
+
+        return 1;
+    }
+}
+
+#ifdef PYMP3_WITH_MINIMP3
+/**
+ * Refill the input buffer of minimp3 from the file-like object, keeping the data not consumed yet.
+ *
+ * \return  A number of bytes read, 0 on EOF, -1 on error (Python exception is set)
+ */
+static Py_ssize_t decoder_fill_input_minimp3(DecoderObject* self)
+{
+    unsigned int available = self->input_end - self->input_begin;
+    memmove(self->input_buffer, self->input_buffer + self->input_begin, available);
+    self->input_begin = 0;
+    self->input_end = available;
+
+    Py_ssize_t readsize = decoder_read_input(self, self->input_buffer + available, self->input_buffer_size - available);
+    if (readsize == 0)
+        self->input_eof = 1;
+    if (readsize > 0)
+        self->input_end += readsize;
+
+    return readsize;
+}
+
+/* MPEG mode of the parsed frame header in terms of libmad (see Decoder_getMode) */
+static long decoder_mad_mode(const pymp3_header *header)
+{
+    switch (header->mode) {
+        case MODE_SINGLE_CHANNEL: return MAD_MODE_SINGLE_CHANNEL;
+        case MODE_DUAL_CHANNEL: return MAD_MODE_DUAL_CHANNEL;
+        case MODE_JOINT_STEREO: return MAD_MODE_JOINT_STEREO;
+        default: return MAD_MODE_STEREO;
+    }
+}
+
+/**
+ * Decode exactly one MPEG frame with minimp3 backend and append its PCM samples to the output buffer.
+ *
+ * minimp3 needs several frames in the input buffer to sync, so the buffer is kept at least half full until EOF.
+ * The frame is decoded straight into the output buffer, and the last frame of the file is decoded too.
+ *
+ * \return  1 if a frame is decoded, 0 on EOF, -1 on error (Python exception is set)
+ */
+static int decoder_decode_frame_minimp3(DecoderObject* self)
+{
+    int timers = PYMP3_TIMERS_ENABLED(self->state);
+    unsigned long long started;
+    pymp3_minimp3_info info;
+    int frame_nsamples;
+
+    /* Room for the largest frame, the number of channels is converted in place */
+    if (decoder_reserve_output(self, PYMP3_MINIMP3_MAX_SAMPLES * sizeof(int16_t)) < 0)
+        return -1;
+
+    while (1)
+    {
+        unsigned int available = self->input_end - self->input_begin;
+        if (available < self->input_buffer_size / 2 && !self->input_eof)
+        {
+            if (decoder_fill_input_minimp3(self) < 0)
+                return -1;
+            continue;
+        }
+
+        if (available == 0)
+            return 0;   /* EOF */
+
+        const unsigned char *data = self->input_buffer + self->input_begin;
+        int16_t *output_ptr = (int16_t *)(self->output_buffer + self->output_buffer_end);
+
+        started = PYMP3_TIMER_START(timers);
+        Py_BEGIN_ALLOW_THREADS;
+        frame_nsamples = pymp3_minimp3_decode(self->minimp3, data, available, output_ptr, &info);
+        Py_END_ALLOW_THREADS;
+        PYMP3_TIMER_STOP(timers, started, self->stats.codec_ns);
+
+        if (info.frame_bytes == 0)
+        {
+            /* The frame is incomplete */
+            if (self->input_eof)
+                return 0;
+
+            if (available == self->input_buffer_size)
+            {
+                /* No frame in the full buffer (should not happen), skip a byte to make a progress */
+                self->input_begin++;
+                self->stats.sync_errors++;
+                continue;
+            }
+
+            if (decoder_fill_input_minimp3(self) < 0)
+                return -1;
+            continue;
+        }
+
+        pymp3_header header;
+        unsigned long long data_offset = self->bytes_read - (self->input_end - self->input_begin);
+        unsigned long long offset = data_offset + info.frame_offset;
+        int parsed = pymp3_parse_header(data + info.frame_offset, &header);
+        self->input_begin += info.frame_bytes;
+
+        if (self->resilient)
+        {
+            /* Tags in the data skipped by minimp3, which is all of the data when no frame is found */
+            Py_ssize_t skipped = (frame_nsamples == 0 && parsed != 0) ? info.frame_bytes : info.frame_offset;
+            for (Py_ssize_t i = 0; i < skipped; )
+            {
+                Py_ssize_t tag_size = decoder_skip_tag(self, data + i, available - i, data_offset + i);
+                i += tag_size > 0 ? tag_size : 1;
+            }
+        }
+
+        if (frame_nsamples == 0)
+        {
+            /* Skipped ID3 tag or corrupted data */
+            self->stats.sync_errors++;
+            continue;
+        }
+
+        if (self->resilient && self->frame_count > 0 && (info.samplerate != self->samplerate || info.layer != self->layer))
+        {
+            self->stats.sync_errors++;
+            continue;
+        }
+
+        if (self->frame_count++ == 0)
+        {
+            // Read the stream format from the first frame
+            self->is_valid = 1;
+            self->channels = self->noutput_channels ? self->noutput_channels : info.channels;
+            self->bitrate = info.bitrate;
+            self->samplerate = info.samplerate;
+            self->mode = parsed == 0 ? decoder_mad_mode(&header) : (info.channels == 1 ? MAD_MODE_SINGLE_CHANNEL : MAD_MODE_STEREO);
+            self->layer = info.layer;
+        }
+
+        self->frame_offset = offset;
+        self->frame_bitrate = info.bitrate;
+
+        long lost_frames = 0;
+        if (self->resilient)
+        {
+            lost_frames = decoder_check_damage(self, info.frame_bytes - info.frame_offset, frame_nsamples);
+            if (lost_frames < 0)
+                return -1;
+        }
+
+        /* Stick to the number of channels of the first frame, and select the output channels */
+        started = PYMP3_TIMER_START(timers);
+        if (info.channels == 2 && self->channels == 1)
+        {
+            int ch = self->noutput_channels ? self->output_channels[0] : 0;
+            for (int i = 0; i < frame_nsamples; i++)
+                output_ptr[i] = output_ptr[2 * i + ch];
+        }
+        else if (info.channels == 2 && self->noutput_channels == 2 && (self->output_channels[0] != 0 || self->output_channels[1] != 1))
+        {
+            for (int i = 0; i < frame_nsamples; i++)
+            {
+                int16_t left = output_ptr[2 * i + self->output_channels[0]];
+                int16_t right = output_ptr[2 * i + self->output_channels[1]];
+                output_ptr[2 * i] = left;
+                output_ptr[2 * i + 1] = right;
+            }
+        }
+        else if (info.channels == 1 && self->channels == 2)
+        {
+            for (int i = frame_nsamples - 1; i >= 0; i--)
+                output_ptr[2 * i] = output_ptr[2 * i + 1] = output_ptr[i];
+        }
+        PYMP3_TIMER_STOP(timers, started, self->stats.convert_ns);
+
+        size_t size = frame_nsamples * self->channels * sizeof(short);
+        self->stats.frames++;
+        self->sample_count += (unsigned long long) (lost_frames + 1) * frame_nsamples;
+        self->frame_samples = frame_nsamples;
+
+        if (lost_frames > 0)
+        {
+            /* The frame waits for the silence of the lost frames (see decoder_emit_pending) */
+            if (decoder_reserve_pending(self) < 0)
+                return -1;
+            memcpy(self->pending_frame, output_ptr, size);
+            self->silence_frames = lost_frames;
+            self->pending_size = size;
+            return decoder_emit_pending(self);
+        }
+
+        self->output_buffer_end += size;
+        self->stats.bytes_out += size;
+
+        return 1;
+    }
+}
+#endif
+
+/**
+ * Copy up to `size` bytes of decoded audio into `buffer`, decoding new frames as needed.
+ *
+ * \return  A number of copied bytes (0 on EOF), or -1 on error (Python exception is set)
+ */
+static Py_ssize_t decoder_read_into(DecoderObject* self, char* buffer, Py_ssize_t size)
+{
+    Py_ssize_t copied = 0;
+
+    while (copied < size)
+    {
+        /* If we have already available uncompressed data, copy them into the buffer */
+        Py_ssize_t available = self->output_buffer_end - self->output_buffer_begin;
+        if (available > 0)
+        {
+            Py_ssize_t n = (available > size - copied) ? size - copied : available;
+            memcpy(buffer + copied, self->output_buffer + self->output_buffer_begin, n);
 
-                    *(output_ptr++) = sample;
-                }
+            self->output_buffer_begin += n;
+            if (self->output_buffer_begin == self->output_buffer_end)
+            {
+                /* If we are here, then output_buffer is empty, so, reset the begin/end pointers. */
+                self->output_buffer_begin = 0;
+                self->output_buffer_end = 0;
             }
 
+            copied += n;
+            continue;
+        }
+
+        int res = decoder_decode_frame(self);
+        if (res < 0)
+            return -1;
+        if (res == 0)
+            break;   /* EOF is reached. Return whatever is read */
+    }
+
+    return copied;
+}
+
+/**
+ * Read the next block of audio (decoded on flight)
+ */
+static PyObject* Decoder_read(DecoderObject* self, PyObject *const *args, Py_ssize_t nargs)
+{
+    Py_ssize_t requested_size = -1;    // 256MB maximum supported size of one read operation
+
+    if (nargs > 1)
+    {
+        PyErr_Format(PyExc_TypeError, "read() takes at most 1 argument (%zd given)", nargs);
+        return NULL;
+    }
+
+    if (nargs == 1 && args[0] != Py_None)
+    {
+        requested_size = PyNumber_AsSsize_t(args[0], PyExc_OverflowError);
+        if (requested_size == -1 && PyErr_Occurred())
+        {
+            PyErr_SetString(PyExc_ValueError, "A size argument is required to read() method");
+            return NULL;
+        }
+    }
+
+    if (requested_size == -1 || requested_size > MAX_READ_BYTES)
+    {
+        requested_size = MAX_READ_BYTES;
+    }
+    else if (requested_size < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "A size argument cannot be negative");
+        return NULL;
+    }
+
+    if (pymp3_lock_acquire(&self->lock, (PyObject *) self) < 0)
+        return NULL;
+
+    PyObject * result = decoder_read_bytes(self, requested_size);
+
+    pymp3_stats_publish(self->state, PYMP3_STATS_DECODER, &self->stats, &self->published);
+    pymp3_lock_release(&self->lock);
+    return result;
+}
+
+/**
+ * Read up to `requested_size` bytes of decoded audio into a new bytes object
+ */
+static PyObject* decoder_read_bytes(DecoderObject* self, Py_ssize_t requested_size)
+{
+    /* User may call read(0) to read the first frame and initialize MPEG info (channels, samplerate, etc.) */
+    if (self->frame_count == 0)
+    {
+        if (decoder_decode_frame(self) < 0)
+            return NULL;
+    }
+
+    /* With a memory limit, a large read returns partial data instead of allocating past the limit */
+    Py_ssize_t limit = decoder_result_limit(self);
+    if (requested_size > limit)
+        requested_size = limit;
+
+    /* The result is allocated once for the typical block size, and grows only for large reads */
+    Py_ssize_t capacity = self->output_buffer_end - self->output_buffer_begin;
+    if (capacity < READ_BLOCK_SIZE)
+        capacity = READ_BLOCK_SIZE;
+    if (capacity > requested_size)
+        capacity = requested_size;
+
+    PyObject * result_bytes = PyBytes_FromStringAndSize(NULL, capacity);
+    if (result_bytes == NULL)
+        return NULL;
+
+    Py_ssize_t filled = 0;
+    while (filled < requested_size)
+    {
+        if (filled == capacity)
+        {
+            capacity = (capacity > requested_size / 2) ? requested_size : capacity * 2;
+            if (_PyBytes_Resize(&result_bytes, capacity) < 0)
+                return NULL;
+        }
+
+        Py_ssize_t n = decoder_read_into(self, PyBytes_AS_STRING(result_bytes) + filled, capacity - filled);
+        if (n < 0)
+        {
+            Py_DECREF(result_bytes);
+            return NULL;
+        }
+        if (n == 0)
+            break;   /* EOF is reached. Return whatever is read */
+
+        filled += n;
+    }
+
+    if (filled != capacity && _PyBytes_Resize(&result_bytes, filled) < 0)
+        return NULL;
+
+    return result_bytes;
+}
+
+/**
+ * Read the next block of audio (decoded on flight) into a pre-allocated writable buffer
+ */
+static PyObject* Decoder_readinto(DecoderObject* self, PyObject *const *args, Py_ssize_t nargs)
+{
+    Py_buffer view;
+
+    if (nargs != 1)
+    {
+        PyErr_Format(PyExc_TypeError, "readinto() takes exactly one argument (%zd given)", nargs);
+        return NULL;
+    }
+
+    if (PyObject_GetBuffer(args[0], &view, PyBUF_WRITABLE) < 0)
+        return NULL;
+
+    Py_ssize_t n = -1;
+    if (pymp3_lock_acquire(&self->lock, (PyObject *) self) == 0)
+    {
+        n = decoder_read_into(self, (char *) view.buf, view.len);
+        pymp3_stats_publish(self->state, PYMP3_STATS_DECODER, &self->stats, &self->published);
+        pymp3_lock_release(&self->lock);
+    }
+    PyBuffer_Release(&view);
+
+    if (n < 0)
+        return NULL;
+
+    return PyLong_FromSsize_t(n);
+}
+
+/**
+ * Return the next chunk of audio: whole MPEG frames, at least `chunk_size` bytes (except the last chunk)
+ */
+static PyObject* Decoder_iternext(DecoderObject* self)
+{
+    if (pymp3_lock_acquire(&self->lock, (PyObject *) self) < 0)
+        return NULL;
+
+    PyObject * result = decoder_next_chunk(self);
+
+    pymp3_stats_publish(self->state, PYMP3_STATS_DECODER, &self->stats, &self->published);
+    pymp3_lock_release(&self->lock);
+    return result;
+}
+
+static PyObject* decoder_next_chunk(DecoderObject* self)
+{
+    while (self->output_buffer_end - self->output_buffer_begin < self->chunk_size)
+    {
+        int res = decoder_decode_frame(self);
+        if (res < 0)
+            return NULL;
+        if (res == 0)
+            break;   /* EOF or the memory limit is reached. Return whatever is decoded */
+    }
+
+    Py_ssize_t size = self->output_buffer_end - self->output_buffer_begin;
+    if (size == 0)
+        return NULL;   /* StopIteration */
+
+    PyObject * pcm = PyBytes_FromStringAndSize((char const *)self->output_buffer + self->output_buffer_begin, size);
+    if (pcm == NULL)
+        return NULL;
+
+    self->output_buffer_begin = 0;
+    self->output_buffer_end = 0;
+
+    return pcm;
+}
+
+/**
+ * Decode the next MPEG frame and return its PCM data together with the frame header.
+ * If a previous read() left a part of the frame undelivered, the remainder of that frame is returned.
+ */
+static PyObject* Decoder_decodeFrame(DecoderObject* self, PyObject* args)
+{
+    if (pymp3_lock_acquire(&self->lock, (PyObject *) self) < 0)
+        return NULL;
+
+    PyObject * result = decoder_next_frame(self);
+
+    pymp3_stats_publish(self->state, PYMP3_STATS_DECODER, &self->stats, &self->published);
+    pymp3_lock_release(&self->lock);
+    return result;
+}
+
+static PyObject* decoder_next_frame(DecoderObject* self)
+{
+    if (self->output_buffer_end == self->output_buffer_begin)
+    {
+        int res = decoder_decode_frame(self);
+        if (res < 0)
+            return NULL;
+        if (res == 0)
+            Py_RETURN_NONE;   /* EOF */
+    }
+
+    Py_ssize_t size = self->output_buffer_end - self->output_buffer_begin;
+    PyObject * pcm = PyBytes_FromStringAndSize((char const *)self->output_buffer + self->output_buffer_begin, size);
+    if (pcm == NULL)
+        return NULL;
+
+    self->output_buffer_begin = 0;
+    self->output_buffer_end = 0;
+
+    return Py_BuildValue("(N{s:l,s:l,s:n,s:K})",
+        pcm,
+        "bit_rate", self->frame_bitrate,
+        "sample_rate", DECODER_OUTPUT_SAMPLERATE(self),
+        "samples", self->channels > 0 ? size / (Py_ssize_t)(self->channels * sizeof(short)) : (Py_ssize_t)0,
+        "offset", self->frame_offset
+    );
+}
 
-        }; //while(1)
+/**
+ * Append the level (RMS in dBFS) of the mean square of samples to the list
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int decoder_append_level(PyObject *levels, double mean_square)
+{
+    double level = mean_square > 0.0 ? 10.0 * log10(mean_square) : LEVEL_FLOOR_DB;
+    PyObject *o_level = PyFloat_FromDouble(level > LEVEL_FLOOR_DB ? level : LEVEL_FLOOR_DB);
+    if (o_level == NULL)
+        return -1;
+
+    int result = PyList_Append(levels, o_level);
+    Py_DECREF(o_level);
+    return result;
+}
 
-    } // while (requested_read_len >= 0)
+/**
+ * Append levels of the PCM data in the output buffer to the list, one level per frame, and empty the buffer
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int decoder_measure_output(DecoderObject* self, PyObject *levels)
+{
+    size_t frame_size = (size_t) self->frame_samples * self->channels * sizeof(short);
 
-    if(unrecoverable_error)
+    while (self->output_buffer_begin < self->output_buffer_end)
     {
-        Py_DECREF(result_bytes);
-        PyErr_SetString(PyExc_RuntimeError, errmsg);
+        size_t size = self->output_buffer_end - self->output_buffer_begin;
+        if (frame_size > 0 && size > frame_size)
+            size = frame_size;
+
+        size_t nsamples = size / sizeof(short);
+        double energy = pymp3_int16_energy((const int16_t *) (self->output_buffer + self->output_buffer_begin), nsamples);
+        if (nsamples > 0 && decoder_append_level(levels, energy / nsamples) < 0)
+            return -1;
+
+        self->output_buffer_begin += size;
+    }
+
+    self->output_buffer_begin = 0;
+    self->output_buffer_end = 0;
+    return 0;
+}
+
+/**
+ * Decode the next frames without synthesis and return their levels: read_levels(frames=-1)
+ */
+static PyObject* Decoder_readLevels(DecoderObject* self, PyObject* args)
+{
+    Py_ssize_t max_frames = -1;
+
+    if (!PyArg_ParseTuple(args, "|n:read_levels", &max_frames))
+        return NULL;
+
+    if (pymp3_lock_acquire(&self->lock, (PyObject *) self) < 0)
+        return NULL;
+
+    PyObject * result = decoder_read_levels(self, max_frames);
+
+    pymp3_stats_publish(self->state, PYMP3_STATS_DECODER, &self->stats, &self->published);
+    pymp3_lock_release(&self->lock);
+    return result;
+}
+
+static PyObject* decoder_read_levels(DecoderObject* self, Py_ssize_t max_frames)
+{
+    PyObject *levels = PyList_New(0);
+    if (levels == NULL)
         return NULL;
+
+    /* PCM data decoded but not read yet (e.g. the first frame decoded by the constructor) is measured from the samples,
+    *  as well as the silence of lost frames and the frame after them, which are pending in resilient mode */
+    if (decoder_measure_output(self, levels) < 0)
+        goto error;
+
+    while (self->pending_size > 0 && (max_frames < 0 || PyList_GET_SIZE(levels) < max_frames))
+    {
+        if (decoder_emit_pending(self) < 0 || decoder_measure_output(self, levels) < 0)
+            goto error;
+    }
+
+    /* minimp3 doesn't expose the subband samples, its frames are synthesized and measured from the PCM samples */
+    self->analysis = self->backend == BACKEND_LIBMAD;
+
+    while (max_frames < 0 || PyList_GET_SIZE(levels) < max_frames)
+    {
+        int res = decoder_decode_frame(self);
+        if (res < 0)
+            goto error;
+        if (res == 0)
+            break;   /* EOF */
+
+        if (!self->analysis)
+        {
+            if (decoder_measure_output(self, levels) < 0)
+                goto error;
+            continue;
+        }
+
+        /* Lost frames are silence, like in the decoded audio */
+        for (long i = 0; i < self->frame_lost; i++)
+        {
+            if (decoder_append_level(levels, 0.0) < 0)
+                goto error;
+        }
+
+        if (decoder_append_level(levels, self->frame_mean_square) < 0)
+            goto error;
+    }
+
+    if (self->analysis)
+    {
+        /* The synthesis filter missed the analysed frames, don't mix them into the audio read next */
+        self->analysis = 0;
+        mad_synth_mute(&self->synth);
+    }
+    return levels;
+
+error:
+    if (self->analysis)
+    {
+        self->analysis = 0;
+        mad_synth_mute(&self->synth);
+    }
+    Py_DECREF(levels);
+    return NULL;
+}
+
+/**
+ * Make sure each plane has room for `size` more bytes after `filled` bytes, growing up to `max_capacity` bytes unless more is needed
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int decoder_grow_planes(PyObject **planes, int nplanes, Py_ssize_t *capacity, Py_ssize_t filled, Py_ssize_t size, Py_ssize_t max_capacity)
+{
+    if (filled + size <= *capacity)
+        return 0;
+
+    Py_ssize_t new_capacity = *capacity * 2;
+    if (new_capacity > max_capacity)
+        new_capacity = max_capacity;
+    if (new_capacity < filled + size)
+        new_capacity = filled + size;
+
+    for (int c = 0; c < nplanes; c++)
+    {
+        if (_PyBytes_Resize(&planes[c], new_capacity) < 0)
+            return -1;
+    }
+
+    *capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * Append the PCM data of the output buffer to the planes and empty the buffer.
+ * The buffer holds interleaved samples, or in planar mode the planes of one frame.
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int decoder_append_planes(DecoderObject* self, PyObject **planes, Py_ssize_t *capacity, Py_ssize_t *filled, Py_ssize_t max_capacity)
+{
+    int nplanes = self->channels;
+    size_t size = self->output_buffer_end - self->output_buffer_begin;
+    const unsigned char *data = self->output_buffer + self->output_buffer_begin;
+
+    if (decoder_grow_planes(planes, nplanes, capacity, *filled, size / nplanes, max_capacity) < 0)
+        return -1;
+
+    if (self->planar)
+    {
+        for (int c = 0; c < nplanes; c++)
+            memcpy(PyBytes_AS_STRING(planes[c]) + *filled, data + c * (size / nplanes), size / nplanes);
+    }
+    else if (nplanes == 2)
+    {
+        pymp3_int16_deinterleave((int16_t *) (PyBytes_AS_STRING(planes[0]) + *filled), (int16_t *) (PyBytes_AS_STRING(planes[1]) + *filled),
+                                 (const int16_t *) data, size / (2 * sizeof(short)));
     }
     else
     {
-        return result_bytes;
+        memcpy(PyBytes_AS_STRING(planes[0]) + *filled, data, size);
+    }
+
+    *filled += size / nplanes;
+    self->output_buffer_begin = 0;
+    self->output_buffer_end = 0;
+    return 0;
+}
+
+/**
+ * Decode the next frames into separate buffers per channel: read_planar(frames=-1)
+ */
+static PyObject* Decoder_readPlanar(DecoderObject* self, PyObject* args)
+{
+    Py_ssize_t max_frames = -1;
+
+    if (!PyArg_ParseTuple(args, "|n:read_planar", &max_frames))
+        return NULL;
+
+    if (pymp3_lock_acquire(&self->lock, (PyObject *) self) < 0)
+        return NULL;
+
+    PyObject * result = decoder_read_planar(self, max_frames);
+
+    pymp3_stats_publish(self->state, PYMP3_STATS_DECODER, &self->stats, &self->published);
+    pymp3_lock_release(&self->lock);
+    return result;
+}
+
+static PyObject* decoder_read_planar(DecoderObject* self, Py_ssize_t max_frames)
+{
+    if (self->frame_count == 0)
+    {
+        if (decoder_decode_frame(self) < 0)
+            return NULL;
+    }
+
+    int nplanes = self->channels;
+    if (nplanes == 0)
+        return PyTuple_New(0);   /* No MPEG frames */
+
+    PyObject *planes[2] = { NULL, NULL };
+    Py_ssize_t max_capacity = decoder_result_limit(self) / nplanes;
+    Py_ssize_t capacity = READ_BLOCK_SIZE / nplanes;
+    Py_ssize_t filled = 0;
+
+    if (capacity > max_capacity)
+        capacity = max_capacity;
+
+    for (int c = 0; c < nplanes; c++)
+    {
+        planes[c] = PyBytes_FromStringAndSize(NULL, capacity);
+        if (planes[c] == NULL)
+            goto error;
+    }
+
+    /* PCM data decoded but not read yet is interleaved */
+    if (decoder_append_planes(self, planes, &capacity, &filled, max_capacity) < 0)
+        goto error;
+
+    /* minimp3 decodes interleaved samples, they are split by decoder_append_planes() */
+    self->planar = self->backend == BACKEND_LIBMAD;
+
+    /* With a memory limit, decoding stops before the planes would grow past the limit */
+    for (Py_ssize_t frames = 0; (max_frames < 0 || frames < max_frames) && filled + FRAME_BUFFER_SIZE / 2 <= max_capacity; frames++)
+    {
+        int res = decoder_decode_frame(self);
+        if (res < 0)
+            goto error;
+        if (res == 0)
+            break;   /* EOF */
+
+        if (decoder_append_planes(self, planes, &capacity, &filled, max_capacity) < 0)
+            goto error;
+    }
+    self->planar = 0;
+
+    PyObject *result = PyTuple_New(nplanes);
+    if (result == NULL)
+        goto error;
+
+    for (int c = 0; c < nplanes; c++)
+    {
+        if (_PyBytes_Resize(&planes[c], filled) < 0)
+        {
+            Py_DECREF(result);
+            goto error;
+        }
+        PyTuple_SET_ITEM(result, c, planes[c]);
+        planes[c] = NULL;
     }
+
+    return result;
+
+error:
+    self->planar = 0;
+    Py_XDECREF(planes[0]);
+    Py_XDECREF(planes[1]);
+    return NULL;
 }
 
 
@@ -530,7 +1969,82 @@ static PyObject* Decoder_getBitRate(DecoderObject* self, PyObject* args)
 
 static PyObject* Decoder_getSampleRate(DecoderObject* self, PyObject* args)
 {
-    return PyLong_FromLong(self->samplerate);
+    return PyLong_FromLong(DECODER_OUTPUT_SAMPLERATE(self));
+}
+
+/**
+ * Start decoding of another file-like object: reset(fobject).
+ * libmad state is reinitialised in place and the buffers are kept, so no memory is allocated.
+ */
+static PyObject* Decoder_reset(DecoderObject* self, PyObject* fobject)
+{
+    if (decoder_check_fobject(fobject) < 0)
+        return NULL;
+
+    if (pymp3_lock_acquire(&self->lock, (PyObject *) self) < 0)
+        return NULL;
+
+    Py_INCREF(fobject);
+    Py_SETREF(self->fobject, fobject);
+
+    /* The read-ahead thread of the previous file is stopped, the new file is read synchronously if the thread can't start */
+    decoder_stop_read_ahead(self);
+    if (decoder_start_read_ahead(self) < 0)
+        PyErr_Clear();
+
+    /* mad_stream_init() forgets the main data buffer of Layer III, keep it (its content is not used across frames of different streams) */
+    unsigned char (*main_data)[MAD_BUFFER_MDLEN] = self->stream.main_data;
+    int options = self->stream.options;
+    self->stream.main_data = NULL;
+    mad_stream_finish(&self->stream);
+    mad_stream_init(&self->stream);
+    self->stream.main_data = main_data;
+    mad_stream_options(&self->stream, options);
+
+    /* Clear the overlap buffer of the frame and the synthesis filter, which would leak audio of the previous stream */
+    mad_header_init(&self->frame.header);
+    mad_frame_mute(&self->frame);
+    mad_synth_init(&self->synth);
+
+#ifdef PYMP3_WITH_MINIMP3
+    if (self->minimp3 != NULL)
+        pymp3_minimp3_reset(self->minimp3);
+#endif
+
+    decoder_start(self);
+
+    decoder_update_memory(self);
+    pymp3_stats_publish(self->state, PYMP3_STATS_DECODER, &self->stats, &self->published);
+    pymp3_lock_release(&self->lock);
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * Get performance counters of the decoder, as published at the end of the last call.
+ * The object lock is not taken, so the counters can be scraped while another thread is decoding.
+ */
+static PyObject* Decoder_stats(DecoderObject* self, PyObject* args)
+{
+    pymp3_stats stats;
+    pymp3_stats_snapshot(self->state, &self->published, &stats);
+    return pymp3_stats_to_dict(&stats, PYMP3_STATS_DECODER);
+}
+
+/**
+ * Get a list of damaged ranges found in resilient mode.
+ * Each range is a tuple of (start_byte, end_byte, start_sample, end_sample), where the samples are replaced with silence.
+ */
+static PyObject* Decoder_getDamagedRanges(DecoderObject* self, PyObject* args)
+{
+    /* The list is replaced by reset() */
+    if (pymp3_lock_acquire(&self->lock, (PyObject *) self) < 0)
+        return NULL;
+
+    PyObject *ranges = self->damage == NULL ? PyList_New(0) : PyList_GetSlice(self->damage, 0, PyList_GET_SIZE(self->damage));
+
+    pymp3_lock_release(&self->lock);
+    return ranges;
 }
 
 static PyObject* Decoder_isValid(DecoderObject* self, PyObject* args)
@@ -4,10 +4,30 @@
 #include <Python.h>
 #include <mad.h>
 
+#include "py_module.h"
+#include "mp3_readahead.h"
+
+#ifdef PYMP3_WITH_MINIMP3
+#include "mp3_minimp3.h"
+#endif
+
 typedef struct {
     PyObject_HEAD
+    /* Serializes method calls, the lock is held while the GIL is released for decoding */
+    pymp3_lock lock;
+
     /* File-like object that will be read */
     PyObject *fobject;
+
+    /* Decoder backend: BACKEND_LIBMAD or BACKEND_MINIMP3 */
+    int backend;
+#ifdef PYMP3_WITH_MINIMP3
+    pymp3_minimp3 *minimp3;
+    unsigned int input_begin;       /* Data of the input buffer not consumed by minimp3 yet */
+    unsigned int input_end;
+    int input_eof;
+#endif
+
     struct mad_stream stream;
     struct mad_frame frame;
     struct mad_synth synth;
@@ -20,6 +40,26 @@ typedef struct {
     unsigned int output_buffer_begin;
     unsigned int output_buffer_end;
 
+    /* Minimum size of PCM chunks returned by the iterator */
+    Py_ssize_t chunk_size;
+
+    /* Channels of the stream selected for the output (`channels` argument), noutput_channels is 0 for all channels */
+    int output_channels[2];
+    int noutput_channels;
+    int synth_channel;              /* The only selected channel, which is synthesized alone, or -1 */
+    int planar;                     /* Frames are converted to planar PCM data (in read_planar()) */
+
+    /* Half sample rate synthesis (MAD_OPTION_HALFSAMPLERATE) */
+    int half_rate;
+
+    /* Limit (in bytes) of the native buffers plus the result of one call, 0 for no limit (`memory_limit` argument) */
+    size_t memory_limit;
+    size_t memory_published;                /* Size of the native buffers added to the module-wide memory usage */
+
+    /* Read-ahead of the file by a background thread (`read_ahead` argument: number of chunks, 0 to read synchronously) */
+    int read_ahead_depth;
+    pymp3_readahead *read_ahead;            /* NULL when the file object has no file descriptor */
+
     int  is_valid;
     long mode;
     long layer;
@@ -28,6 +68,41 @@ typedef struct {
     long samplerate;
 
     unsigned int frame_count;
+
+    /* Total number of bytes read from the file-like object */
+    unsigned long long bytes_read;
+
+    /* Header of the last decoded frame */
+    unsigned long long frame_offset;
+    long frame_bitrate;
+
+    /* Number of samples (per channel) in the decoded audio so far, including the inserted silence */
+    unsigned long long sample_count;
+    /* Number of samples (per channel) of the last decoded frame */
+    unsigned int frame_samples;
+
+    /* Analysis mode of read_levels(): frames are decoded without synthesis, and measured from the subband samples */
+    int analysis;
+    double frame_mean_square;               /* Mean square of the samples of the last analysed frame */
+    long frame_lost;                        /* Frames lost before the last analysed frame (resilient mode) */
+
+    /* Resilient mode: resync with a fast header scan, replace lost frames with silence and report damaged ranges */
+    int resilient;
+    unsigned long long expected_offset;     /* Offset where the frame next to the last decoded one starts */
+    unsigned long frame_size;               /* Size of the last decoded frame (in bytes) */
+    PyObject *damage;                       /* List of (start_byte, end_byte, start_sample, end_sample), or NULL */
+    unsigned long long tag_bytes;           /* Size of the tags found in the data skipped since the last decoded frame */
+    unsigned long long tag_end;             /* Offset where the last found tag ends, its data is not scanned for frames */
+
+    /* Resilient mode: silence of lost frames is emitted frame by frame before the frame decoded after them */
+    long silence_frames;                    /* Lost frames not emitted yet */
+    unsigned char *pending_frame;           /* PCM data (interleaved) of the frame decoded after the lost frames */
+    size_t pending_size;                    /* Size of the frame and of each frame of silence, 0 when nothing is pending */
+
+    /* Performance counters, and the part of them already added to the module-wide aggregates */
+    pymp3_state *state;
+    pymp3_stats stats;
+    pymp3_stats published;
 } DecoderObject;
 
 /* Instantiates the new decoder class memory */
@@ -39,8 +114,71 @@ static void Decoder_dealloc(DecoderObject* self);
 /* Initialises a new decoder */
 static int Decoder_init(DecoderObject* self, PyObject* args, PyObject* kwds);
 
+/* Resets the stream format and decodes the first frame of a new source */
+static void decoder_start(DecoderObject* self);
+
+/* Decodes the next MPEG frame into the output buffer */
+static int decoder_decode_frame(DecoderObject* self);
+
+/* Resilient mode: skips corrupted data after a recoverable libmad error */
+static void decoder_resync(DecoderObject* self);
+
+/* Resilient mode: records the damaged range before the decoded frame, returns the number of lost frames */
+static long decoder_check_damage(DecoderObject* self, unsigned long frame_size, unsigned int frame_samples);
+
+/* Resilient mode: counts a tag at `ptr` (`size` bytes available, at `offset` of the source) out of the damaged range, returns its size or 0 */
+static Py_ssize_t decoder_skip_tag(DecoderObject* self, const unsigned char *ptr, Py_ssize_t size, unsigned long long offset);
+
+/* Resilient mode: appends the next frame of silence, or the frame decoded after the lost frames, to the output buffer */
+static int decoder_emit_pending(DecoderObject* self);
+
+/* Starts/stops the read-ahead thread of the file object */
+static int decoder_start_read_ahead(DecoderObject* self);
+static void decoder_stop_read_ahead(DecoderObject* self);
+
+/* Makes room for `size` more bytes in the output buffer */
+static int decoder_reserve_output(DecoderObject* self, size_t size);
+
+/* Resilient mode: allocates the buffer of the frame decoded after lost frames */
+static int decoder_reserve_pending(DecoderObject* self);
+
+/* Memory limit: size of the native buffers, the room left for `size` more bytes of the output buffer and for results, and the check of one frame */
+static size_t decoder_memory(DecoderObject* self);
+static void decoder_update_memory(DecoderObject* self);
+static int decoder_output_fits(DecoderObject* self, size_t size);
+static int decoder_check_memory_limit(DecoderObject* self);
+static Py_ssize_t decoder_result_limit(DecoderObject* self);
+
+#ifdef PYMP3_WITH_MINIMP3
+/* Decodes the next MPEG frame into the output buffer with minimp3 backend */
+static int decoder_decode_frame_minimp3(DecoderObject* self);
+#endif
+
+/* Parses the `channels` argument of the constructor */
+static int decoder_parse_channels(PyObject *channels, int *output_channels, int *noutput_channels);
+
+/* Appends levels of the PCM data in the output buffer to the list, and empties the buffer */
+static int decoder_measure_output(DecoderObject* self, PyObject *levels);
+
+/* Bodies of the methods, called with the object lock held */
+static PyObject* decoder_read_bytes(DecoderObject* self, Py_ssize_t requested_size);
+static PyObject* decoder_read_levels(DecoderObject* self, Py_ssize_t max_frames);
+static PyObject* decoder_read_planar(DecoderObject* self, Py_ssize_t max_frames);
+static PyObject* decoder_next_chunk(DecoderObject* self);
+static PyObject* decoder_next_frame(DecoderObject* self);
+
 /** The methods in the decoder class */
-static PyObject* Decoder_read(DecoderObject* self, PyObject* args);
+static PyObject* Decoder_read(DecoderObject* self, PyObject *const *args, Py_ssize_t nargs);
+static PyObject* Decoder_readinto(DecoderObject* self, PyObject *const *args, Py_ssize_t nargs);
+static PyObject* Decoder_decodeFrame(DecoderObject* self, PyObject* args);
+static PyObject* Decoder_readLevels(DecoderObject* self, PyObject* args);
+static PyObject* Decoder_readPlanar(DecoderObject* self, PyObject* args);
+static PyObject* Decoder_stats(DecoderObject* self, PyObject* args);
+static PyObject* Decoder_reset(DecoderObject* self, PyObject* fobject);
+static PyObject* Decoder_getDamagedRanges(DecoderObject* self, PyObject* args);
+
+/* Iterator protocol: yields chunks of PCM data */
+static PyObject* Decoder_iternext(DecoderObject* self);
 static PyObject* Decoder_isValid(DecoderObject* self, PyObject* args);
 static PyObject* Decoder_getChannels(DecoderObject* self, PyObject* args);
 static PyObject* Decoder_getBitRate(DecoderObject* self, PyObject* args);
@@ -0,0 +1,634 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "py_module.h"
+#include "mp3_alloc.h"
+#include "mp3_header.h"
+#include "mp3_source.h"
+
+#define EDIT_READ_SIZE (64*1024)        // Size of blocks read from a source
+#define EDIT_MIN_DATA (8*1024)          // Minimum amount of buffered data to find a frame and the header of the next frame
+#define EDIT_WRITE_SIZE (64*1024)       // Frames are written to the destination in blocks of at least this size
+#define EDIT_MAX_RESERVOIR 511          // Maximum main_data_begin (9 bits in MPEG-1)
+
+
+/* Source of MPEG audio frames: a bytes-like object (view), or a file-like object with read() method */
+typedef struct {
+    pymp3_source input;
+
+    /* Data not parsed yet is buffer[start:end] */
+    unsigned char *buffer;
+    size_t start;
+    size_t end;
+    Py_ssize_t skip;                /* Bytes to skip before the next frame (ID3v2 tag) */
+
+    int started;                    /* The beginning of the source was checked for ID3v2 tag */
+    int in_sync;                    /* The next frame is expected at buffer[start] */
+    int discontinuity;              /* Data was skipped between the previous frame and the next frame */
+    unsigned long long frames;      /* Audio frames returned so far */
+
+    /* Format of the first frame, other frames must be consistent with it */
+    int have_format;
+    pymp3_header format;
+
+    /* The last bytes of the main data of preceding Layer III frames */
+    unsigned char reservoir[EDIT_MAX_RESERVOIR];
+    size_t reservoir_size;
+} edit_source;
+
+/* Destination of the frames: a file-like object with write() method, or NULL to return bytes */
+typedef struct {
+    PyObject *destination;
+    unsigned long long written;
+
+    unsigned char *buffer;
+    size_t buffer_size;
+    size_t buffer_end;
+
+    /* Format of the output stream (of the first written frame) */
+    int have_format;
+    pymp3_header format;
+
+    /* The next frame directly follows the previously written frame in its source, its bit reservoir is in the output */
+    int continuous;
+} edit_output;
+
+
+/**
+ * Prepare reading of frames from a bytes-like or file-like object
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int edit_source_open(edit_source *s, PyObject *source)
+{
+    memset(s, 0, sizeof(edit_source));
+
+    if (pymp3_source_open(&s->input, source, "source") < 0)
+        return -1;
+
+    s->buffer = pymp3_mem_malloc(EDIT_READ_SIZE);
+    if (s->buffer == NULL)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    return 0;
+}
+
+static void edit_source_close(edit_source *s)
+{
+    pymp3_source_close(&s->input);
+
+    pymp3_mem_free(s->buffer);
+    s->buffer = NULL;
+}
+
+/**
+ * Read the next block of the source, keeping the data not parsed yet
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int edit_source_fill(edit_source *s)
+{
+    size_t remaining = s->end - s->start;
+    memmove(s->buffer, s->buffer + s->start, remaining);
+    s->start = 0;
+    s->end = remaining;
+
+    Py_ssize_t readsize = pymp3_source_read(&s->input, s->buffer + remaining, EDIT_READ_SIZE - remaining, NULL);
+    if (readsize < 0)
+        return -1;
+
+    s->end += readsize;
+    return 0;
+}
+
+/**
+ * Whether the header has the same version, layer, sample rate and number of channels as the first frame of the source
+ */
+static int edit_header_matches(const edit_source *s, const pymp3_header *header)
+{
+    if (header->frame_size == 0)
+        return 0;   // free format is not supported
+
+    if (!s->have_format)
+        return 1;
+
+    return header->version == s->format.version && header->layer == s->format.layer &&
+           header->samplerate == s->format.samplerate && header->channels == s->format.channels;
+}
+
+/**
+ * Find the next frame of the source. Frames are followed without checks as long as they are consistent,
+ * after junk data a frame is accepted only if it is followed by another consistent frame.
+ * The frame stays in the buffer until edit_source_consume() is called.
+ *
+ * \return  1 if a frame is found, 0 at the end of the source, -1 on error (Python exception is set)
+ */
+static int edit_source_next(edit_source *s, pymp3_header *header)
+{
+    while (1)
+    {
+        if (s->end - s->start < EDIT_MIN_DATA && !s->input.eof)
+        {
+            if (edit_source_fill(s) < 0)
+                return -1;
+            continue;
+        }
+
+        size_t available = s->end - s->start;
+        const unsigned char *data = s->buffer + s->start;
+
+        if (!s->started)
+        {
+            s->started = 1;
+            if (available >= PYMP3_ID3V2_HEADER_SIZE)
+                s->skip = pymp3_id3v2_size(data);
+        }
+
+        if (s->skip > 0)
+        {
+            size_t skipped = (size_t) s->skip < available ? (size_t) s->skip : available;
+            s->start += skipped;
+            s->skip -= skipped;
+            if (s->skip > 0 && s->input.eof)
+                return 0;
+            continue;
+        }
+
+        if (available < PYMP3_HEADER_SIZE)
+            return 0;
+
+        if (s->in_sync)
+        {
+            if (pymp3_parse_header(data, header) == 0 && edit_header_matches(s, header))
+            {
+                if ((size_t) header->frame_size <= available)
+                    return 1;
+                return 0;   // truncated frame at the end
+            }
+
+            /* Lost sync, the bit reservoir of the following frames is unknown */
+            s->in_sync = 0;
+            s->discontinuity = 1;
+            s->reservoir_size = 0;
+        }
+
+        /* Scan for the next consistent pair of frames */
+        const unsigned char *sync = memchr(data, 0xff, available - PYMP3_HEADER_SIZE + 1);
+        if (sync == NULL)
+        {
+            s->start = s->end - (PYMP3_HEADER_SIZE - 1);
+            if (s->input.eof)
+                return 0;
+            if (edit_source_fill(s) < 0)
+                return -1;
+            continue;
+        }
+
+        s->start += sync - data;
+        data = sync;
+        available = s->end - s->start;
+        if (available < EDIT_MIN_DATA && !s->input.eof)
+            continue;
+
+        if (pymp3_parse_header(data, header) == 0 && edit_header_matches(s, header))
+        {
+            size_t frame_size = header->frame_size;
+            pymp3_header next;
+
+            if (frame_size + PYMP3_HEADER_SIZE <= available)
+            {
+                if (pymp3_parse_header(data + frame_size, &next) == 0 && edit_header_matches(s, &next) &&
+                    next.version == header->version && next.layer == header->layer &&
+                    next.samplerate == header->samplerate && next.channels == header->channels)
+                {
+                    s->in_sync = 1;
+                    continue;
+                }
+            }
+            else if (s->input.eof && !s->have_format && s->start == 0 && frame_size == available)
+            {
+                /* The whole source is a single frame */
+                s->in_sync = 1;
+                continue;
+            }
+        }
+
+        s->start++;
+        if (s->have_format)
+            s->discontinuity = 1;
+    }
+}
+
+/**
+ * Skip the frame returned by edit_source_next(), keeping its main data in the bit reservoir
+ */
+static void edit_source_consume(edit_source *s, const pymp3_header *header)
+{
+    const unsigned char *frame = s->buffer + s->start;
+
+    if (header->layer == 3)
+    {
+        size_t offset = PYMP3_HEADER_SIZE + (header->protection ? 2 : 0) + pymp3_side_info_size(header);
+        size_t size = header->frame_size > (int) offset ? header->frame_size - offset : 0;
+
+        if (size >= EDIT_MAX_RESERVOIR)
+        {
+            memcpy(s->reservoir, frame + header->frame_size - EDIT_MAX_RESERVOIR, EDIT_MAX_RESERVOIR);
+            s->reservoir_size = EDIT_MAX_RESERVOIR;
+        }
+        else
+        {
+            size_t keep = s->reservoir_size + size > EDIT_MAX_RESERVOIR ? EDIT_MAX_RESERVOIR - size : s->reservoir_size;
+            memmove(s->reservoir, s->reservoir + s->reservoir_size - keep, keep);
+            memcpy(s->reservoir + keep, frame + offset, size);
+            s->reservoir_size = keep + size;
+        }
+    }
+
+    s->start += header->frame_size;
+}
+
+/**
+ * Read the next audio frame of the source, skipping ID3v2 tag, the Xing/Info/VBRI tag and junk data
+ *
+ * \return  1 if a frame is found, 0 at the end of the source, -1 on error (Python exception is set)
+ */
+static int edit_source_next_audio(edit_source *s, pymp3_header *header)
+{
+    while (1)
+    {
+        int result = edit_source_next(s, header);
+        if (result <= 0)
+            return result;
+
+        if (!s->have_format)
+        {
+            s->have_format = 1;
+            s->format = *header;
+
+            /* The tag describes the whole source, it is not valid after editing */
+            if (pymp3_has_vbr_tag(s->buffer + s->start, header->frame_size, header))
+            {
+                s->start += header->frame_size;
+                continue;
+            }
+        }
+
+        return 1;
+    }
+}
+
+/**
+ * Make sure the output buffer has room for `size` more bytes
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int edit_reserve_output(edit_output *o, size_t size)
+{
+    if (o->buffer_end + size > o->buffer_size)
+    {
+        size_t new_size = o->buffer_size * 2;
+        if (new_size < o->buffer_end + size)
+            new_size = o->buffer_end + size;
+
+        unsigned char *new_buffer = pymp3_mem_realloc(o->buffer, new_size);
+        if (new_buffer == NULL)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+        o->buffer = new_buffer;
+        o->buffer_size = new_size;
+    }
+
+    return 0;
+}
+
+/**
+ * Write the buffered frames to the destination (if any)
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int edit_write_output(edit_output *o)
+{
+    if (o->destination == NULL || o->buffer_end == 0)
+        return 0;
+
+    PyObject *o_write = PyObject_CallMethod(o->destination, "write", "y#", o->buffer, (Py_ssize_t) o->buffer_end);
+    if (o_write == NULL)
+        return -1;
+    Py_DECREF(o_write);
+
+    o->written += o->buffer_end;
+    o->buffer_end = 0;
+    return 0;
+}
+
+/**
+ * Write a silent frame (no CRC, zero side information), which carries the bit reservoir of the next frame.
+ * The smallest bit rate is selected, which has room for `size` bytes of the reservoir.
+ *
+ * \return  1 if the frame is written, 0 if no bit rate has enough room, -1 on error (Python exception is set)
+ */
+static int edit_write_reservoir_frame(edit_output *o, const unsigned char *frame, const unsigned char *reservoir, size_t size)
+{
+    unsigned char header_data[PYMP3_HEADER_SIZE];
+    pymp3_header header;
+
+    memcpy(header_data, frame, PYMP3_HEADER_SIZE);
+    header_data[1] |= 0x01;     // no CRC
+    header_data[2] &= ~0x02;    // no padding
+
+    for (int bitrate_index = 1; bitrate_index < 15; bitrate_index++)
+    {
+        header_data[2] = (header_data[2] & 0x0f) | (bitrate_index << 4);
+        if (pymp3_parse_header(header_data, &header) < 0)
+            return 0;
+
+        size_t offset = PYMP3_HEADER_SIZE + pymp3_side_info_size(&header);
+        if ((size_t) header.frame_size < offset + size)
+            continue;
+
+        if (edit_reserve_output(o, header.frame_size) < 0)
+            return -1;
+
+        unsigned char *output = o->buffer + o->buffer_end;
+        memcpy(output, header_data, PYMP3_HEADER_SIZE);
+        memset(output + PYMP3_HEADER_SIZE, 0, header.frame_size - PYMP3_HEADER_SIZE - size);
+        memcpy(output + header.frame_size - size, reservoir, size);
+        o->buffer_end += header.frame_size;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Copy the current frame of the source to the output. If the output is not continuous, the bit reservoir
+ * of the frame is written first as a silent frame; a frame without its bit reservoir in the source is dropped.
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int edit_copy_frame(edit_output *o, edit_source *s, const pymp3_header *header)
+{
+    const unsigned char *frame = s->buffer + s->start;
+
+    if (!o->have_format)
+    {
+        o->have_format = 1;
+        o->format = *header;
+    }
+    else if (header->version != o->format.version || header->layer != o->format.layer ||
+             header->samplerate != o->format.samplerate || header->channels != o->format.channels)
+    {
+        PyErr_SetString(PyExc_ValueError, "Sources must have the same MPEG version, layer, sample rate and number of channels");
+        return -1;
+    }
+
+    if (s->discontinuity)
+    {
+        s->discontinuity = 0;
+        o->continuous = 0;
+    }
+
+    if (!o->continuous)
+    {
+        size_t main_data_begin = pymp3_main_data_begin(frame, header);
+        if (main_data_begin > 0)
+        {
+            if (main_data_begin > s->reservoir_size)
+                return 0;   // the frame can't be decoded
+
+            int result = edit_write_reservoir_frame(o, frame, s->reservoir + s->reservoir_size - main_data_begin, main_data_begin);
+            if (result <= 0)
+                return result;
+        }
+        o->continuous = 1;
+    }
+
+    if (edit_reserve_output(o, header->frame_size) < 0)
+        return -1;
+    memcpy(o->buffer + o->buffer_end, frame, header->frame_size);
+    o->buffer_end += header->frame_size;
+
+    if (o->buffer_end >= EDIT_WRITE_SIZE)
+        return edit_write_output(o);
+    return 0;
+}
+
+/**
+ * Prepare the output
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int edit_output_open(edit_output *o, PyObject *destination)
+{
+    memset(o, 0, sizeof(edit_output));
+
+    if (destination != Py_None)
+    {
+        if (pymp3_check_method(destination, "write", "destination") < 0)
+            return -1;
+        o->destination = destination;
+    }
+
+    o->buffer_size = EDIT_WRITE_SIZE + 8 * 1024;
+    o->buffer = pymp3_mem_malloc(o->buffer_size);
+    if (o->buffer == NULL)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Flush the output
+ *
+ * \return  The number of bytes written to the destination, or the frames as bytes if there is no destination
+ */
+static PyObject* edit_output_close(edit_output *o)
+{
+    if (edit_write_output(o) < 0)
+        return NULL;
+
+    if (o->destination != NULL)
+        return PyLong_FromUnsignedLongLong(o->written);
+    else
+        return PyBytes_FromStringAndSize((const char *) o->buffer, o->buffer_end);
+}
+
+/**
+ * mp3.cut(source, destination, start=0.0, end=None)
+ *
+ * Copy MPEG frames, which overlap the time range [start, end) in seconds, without decoding.
+ * Returns the number of bytes written to `destination`, or the frames as bytes if `destination` is None.
+ */
+PyObject* pymp3_cut(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"source", "destination", "start", "end", NULL};
+
+    PyObject *source = NULL;
+    PyObject *destination = NULL;
+    double start = 0.0;
+    PyObject *o_end = Py_None;
+    double end = -1.0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|dO:cut", kwlist, &source, &destination, &start, &o_end))
+        return NULL;
+
+    if (o_end != Py_None)
+    {
+        end = PyFloat_AsDouble(o_end);
+        if (end == -1.0 && PyErr_Occurred())
+            return NULL;
+    }
+
+    if (start < 0.0 || (o_end != Py_None && end <= start))
+    {
+        PyErr_SetString(PyExc_ValueError, "start must not be negative, and end must be greater than start");
+        return NULL;
+    }
+
+    edit_source s;
+    edit_output o;
+    PyObject *result = NULL;
+
+    memset(&o, 0, sizeof(o));
+    if (edit_source_open(&s, source) < 0 || edit_output_open(&o, destination) < 0)
+        goto done;
+
+    pymp3_header header;
+    unsigned long long first_frame = 0;
+    unsigned long long last_frame = 0;    // the first frame after the range, 0 for no end
+    int found = 0;
+
+    while (1)
+    {
+        int next = edit_source_next_audio(&s, &header);
+        if (next < 0)
+            goto done;
+        if (next == 0)
+            break;
+
+        if (!found)
+        {
+            /* Frames overlapping the range, which is rounded to whole samples */
+            found = 1;
+            first_frame = (unsigned long long) (start * header.samplerate + 0.5) / header.samples;
+            if (o_end != Py_None)
+                last_frame = ((unsigned long long) (end * header.samplerate + 0.5) + header.samples - 1) / header.samples;
+        }
+
+        if (last_frame > 0 && s.frames >= last_frame)
+            break;
+
+        if (s.frames >= first_frame && edit_copy_frame(&o, &s, &header) < 0)
+            goto done;
+
+        edit_source_consume(&s, &header);
+        s.frames++;
+    }
+
+    if (!found)
+    {
+        PyErr_SetString(PyExc_ValueError, "No MPEG audio frames found in the source");
+        goto done;
+    }
+
+    result = edit_output_close(&o);
+
+done:
+    edit_source_close(&s);
+    pymp3_mem_free(o.buffer);
+    return result;
+}
+
+/**
+ * mp3.concat(sources, destination)
+ *
+ * Join MPEG frames of the sources without decoding.
+ * Returns the number of bytes written to `destination`, or the frames as bytes if `destination` is None.
+ */
+PyObject* pymp3_concat(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"sources", "destination", NULL};
+
+    PyObject *sources = NULL;
+    PyObject *destination = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO:concat", kwlist, &sources, &destination))
+        return NULL;
+
+    PyObject *iterator = PyObject_GetIter(sources);
+    if (iterator == NULL)
+        return NULL;
+
+    edit_output o;
+    PyObject *result = NULL;
+    PyObject *source;
+    Py_ssize_t index = 0;
+
+    if (edit_output_open(&o, destination) < 0)
+        goto done;
+
+    while ((source = PyIter_Next(iterator)) != NULL)
+    {
+        edit_source s;
+        pymp3_header header;
+        int next;
+
+        if (edit_source_open(&s, source) < 0)
+        {
+            edit_source_close(&s);
+            Py_DECREF(source);
+            goto done;
+        }
+
+        /* The first frame of the source doesn't continue the previous source */
+        o.continuous = 0;
+
+        while ((next = edit_source_next_audio(&s, &header)) > 0)
+        {
+            if (edit_copy_frame(&o, &s, &header) < 0)
+            {
+                next = -1;
+                break;
+            }
+            edit_source_consume(&s, &header);
+            s.frames++;
+        }
+
+        if (next == 0 && !s.have_format)
+        {
+            PyErr_Format(PyExc_ValueError, "No MPEG audio frames found in source %zd", index);
+            next = -1;
+        }
+
+        edit_source_close(&s);
+        Py_DECREF(source);
+        if (next < 0)
+            goto done;
+        index++;
+    }
+
+    if (PyErr_Occurred())
+        goto done;
+
+    if (index == 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "No sources to concatenate");
+        goto done;
+    }
+
+    result = edit_output_close(&o);
+
+done:
+    Py_DECREF(iterator);
+    pymp3_mem_free(o.buffer);
+    return result;
+}
@@ -1,57 +1,65 @@
 #include "mp3_encoder.h"
+#include "mp3_alloc.h"
 #include "py_module.h"
 
+/* Maximum number of idle encoders kept in the pool per configuration */
+#define ENCODER_POOL_MAX_IDLE 16
+
+/* Maximum number of samples (per channel) encoded at once, which bounds the size of the output buffer */
+#define ENCODER_MAX_CHUNK_SAMPLES (64*1152)
+
+/* Size of the output buffer for lame_encode_flush() */
+#define ENCODER_FLUSH_BUFFER_SIZE (8*1024)
+
 static PyMethodDef Encoder_methods[] = {
     { "set_channels", (PyCFunction) &Encoder_setChannels, METH_VARARGS, "Set the number of channels" },
     { "set_quality", (PyCFunction) &Encoder_setQuality, METH_VARARGS, "Set the encoder quality, 2 is highest; 7 is fastest (default is 5)" },
     { "set_bit_rate", (PyCFunction) &Encoder_setBitRate, METH_VARARGS, "Set the constant bit rate (in kbps)" },
     { "set_sample_rate", (PyCFunction) &Encoder_setInSampleRate, METH_VARARGS, "Set the input sample rate" },
     { "set_mode", (PyCFunction) &Encoder_setMode, METH_VARARGS, "Set the MPEG mode (MODE_STEREO, MODE_DUAL_CHANNEL, MODE_JOINT_STEREO, MODE_SINGLE_CHANNEL). Note, DUAL_CHANNEL is not supported by LAME!" },
-    { "write", (PyCFunction) &Encoder_write, METH_VARARGS, "Encode a block of PCM data and write to file" },
+    { "write", (PyCFunction) &Encoder_write, METH_FASTCALL, "Encode a block of PCM data and write to file" },
     { "flush", (PyCFunction) &Encoder_flush, METH_NOARGS, "Flush the last block of MP3 data to file" },
+    { "reset", (PyCFunction) &Encoder_reset, METH_VARARGS | METH_KEYWORDS, "Start a new MP3 stream with the same settings, written to another file-like object" },
+    { "set_vbr", (PyCFunction) &Encoder_setVbr, METH_VARARGS, "Enable variable bit rate with the given quality, 0 is highest; 9.999 is lowest" },
+    { "set_abr", (PyCFunction) &Encoder_setAbr, METH_VARARGS, "Enable average bit rate with the given target (in kbps)" },
+    { "set_min_bit_rate", (PyCFunction) &Encoder_setMinBitRate, METH_VARARGS, "Set the minimum bit rate (in kbps) of VBR/ABR" },
+    { "set_max_bit_rate", (PyCFunction) &Encoder_setMaxBitRate, METH_VARARGS, "Set the maximum bit rate (in kbps) of VBR/ABR" },
+    { "set_low_latency", (PyCFunction) &Encoder_setLowLatency, METH_VARARGS, "Enable the low-latency profile (no bit reservoir, every frame is written as soon as it is encoded)" },
+    { "get_buffered_samples", (PyCFunction) &Encoder_getBufferedSamples, METH_NOARGS, "Get the number of samples (per channel) buffered inside the encoder and not yet written as MP3 frames" },
+    { "get_encoder_delay", (PyCFunction) &Encoder_getEncoderDelay, METH_NOARGS, "Get the encoder delay (in samples)" },
+    { "get_frame_size", (PyCFunction) &Encoder_getFrameSize, METH_NOARGS, "Get the number of samples per MPEG frame" },
+    { "stats", (PyCFunction) &Encoder_stats, METH_NOARGS, "Get performance counters of the encoder" },
     { NULL, NULL, 0, NULL }
 };
 
-/** The Encoder class type */
-PyTypeObject EncoderType = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    "mp3.Encoder",                 /* tp_name */
-    sizeof(EncoderObject),         /* tp_basicsize */
-    0,                             /* tp_itemsize */
-    (destructor) Encoder_dealloc,  /* tp_dealloc */
-    0,                             /* tp_print */
-    0,                             /* tp_getattr */
-    0,                             /* tp_setattr */
-    0,                             /* tp_compare */
-    0,                             /* tp_repr */
-    0,                             /* tp_as_number */
-    0,                             /* tp_as_sequence */
-    0,                             /* tp_as_mapping */
-    0,                             /* tp_hash */
-    0,                             /* tp_call */
-    0,                             /* tp_str */
-    0,                             /* tp_getattro */
-    0,                             /* tp_setattro */
-    0,                             /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT,            /* tp_flags */
-    "MP3 encoder",                 /* tp_doc */
-    0,                             /* tp_traverse */
-    0,                             /* tp_clear */
-    0,                             /* tp_richcompare */
-    0,                             /* tp_weaklistoffset */
-    0,                             /* tp_iter */
-    0,                             /* tp_iternext */
-    Encoder_methods,               /* tp_methods */
-    0,                             /* tp_members */
-    0,                             /* tp_getset */
-    0,                             /* tp_base */
-    0,                             /* tp_dict */
-    0,                             /* tp_descr_get */
-    0,                             /* tp_descr_set */
-    0,                             /* tp_dictoffset */
-    (initproc) Encoder_init,       /* tp_init */
-    0,                             /* tp_alloc */
-    Encoder_new,                   /* tp_new */
+/** The Encoder class slots */
+static PyType_Slot Encoder_slots[] = {
+    { Py_tp_dealloc, (void *) Encoder_dealloc },
+    { Py_tp_doc, (void *) "MP3 encoder" },
+    { Py_tp_methods, (void *) Encoder_methods },
+    { Py_tp_init, (void *) Encoder_init },
+    { Py_tp_new, (void *) Encoder_new },
+    { 0, NULL }
+};
+
+/** The Encoder class type (heap type, created per module) */
+PyType_Spec EncoderType_spec = {
+    "mp3.Encoder",                 /* name */
+    sizeof(EncoderObject),         /* basicsize */
+    0,                             /* itemsize */
+    PYMP3_TPFLAGS,                 /* flags */
+    Encoder_slots,                 /* slots */
+};
+
+
+/* Default settings of a new encoder */
+static const encoder_config encoder_default_config = {
+    .channels = 2,
+    .sample_rate = 44100,
+    .bit_rate = 128,
+    .quality = 5,
+    .mode = NOT_SET,
+    .vbr = vbr_off,
 };
 
 
@@ -60,26 +68,88 @@ static void silentOutput(const char *format, va_list ap)
     return;
 }
 
-
 /**
- * Instantiates the new Encoder class memory
+ * Create a LAME encoder with the settings. lame_init_params() is called on the first write
+ *
+ * \return  The LAME encoder, or NULL if it can't be created or the settings are invalid
  */
-static PyObject* Encoder_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+static lame_global_flags* encoder_new_lame(const encoder_config *config)
 {
-    PyObject *fobject = NULL;
-    PyObject *fwrite = NULL;
+    lame_global_flags *lame = lame_init();
+    if (lame == NULL)
+        return NULL;
 
-    if (!PyArg_ParseTuple(args, "O:Encoder", &fobject)) {
-        PyErr_SetString(PyExc_ValueError, "File-like object must be provided in a constructor of Encoder");
+    // Redirect error/debug output to silent function
+    lame_set_errorf(lame, &silentOutput);
+    lame_set_debugf(lame, &silentOutput);
+    lame_set_msgf(lame, &silentOutput);
+
+    // We aren't providing a file interface, so don't output a blank frame
+    lame_set_bWriteVbrTag(lame, 0);
+
+    if (lame_set_num_channels(lame, config->channels) < 0 ||
+        lame_set_in_samplerate(lame, config->sample_rate) < 0 ||
+        lame_set_brate(lame, config->bit_rate) < 0 ||
+        lame_set_quality(lame, config->quality) < 0 ||
+        (config->mode != NOT_SET && lame_set_mode(lame, config->mode) < 0) ||
+        (config->vbr != vbr_off && lame_set_VBR(lame, config->vbr) < 0) ||
+        (config->vbr == vbr_mtrh && lame_set_VBR_quality(lame, config->vbr_quality) < 0) ||
+        (config->vbr == vbr_abr && lame_set_VBR_mean_bitrate_kbps(lame, config->abr_bit_rate) < 0) ||
+        (config->min_bit_rate != 0 && lame_set_VBR_min_bitrate_kbps(lame, config->min_bit_rate) < 0) ||
+        (config->max_bit_rate != 0 && lame_set_VBR_max_bitrate_kbps(lame, config->max_bit_rate) < 0) ||
+        (config->low_latency && lame_set_disable_reservoir(lame, 1) < 0))
+    {
+        lame_close(lame);
         return NULL;
     }
 
-    // Make sure the file-like object has callable `write` attribute
-    fwrite = PyObject_GetAttrString(fobject, "write");
+    return lame;
+}
+
+/**
+ * Whether two encoders have the same settings
+ */
+static int encoder_config_equal(const encoder_config *a, const encoder_config *b)
+{
+    return a->channels == b->channels && a->sample_rate == b->sample_rate && a->bit_rate == b->bit_rate &&
+           a->quality == b->quality && a->mode == b->mode && a->vbr == b->vbr && a->vbr_quality == b->vbr_quality &&
+           a->abr_bit_rate == b->abr_bit_rate && a->min_bit_rate == b->min_bit_rate && a->max_bit_rate == b->max_bit_rate &&
+           a->low_latency == b->low_latency;
+}
+
+/**
+ * Take the object lock of the encoder. An encoder released to the pool can't be used until it is acquired again
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int encoder_lock(EncoderObject* self)
+{
+    if (pymp3_lock_acquire(&self->lock, (PyObject *) self) < 0)
+        return -1;
+
+    if (self->pooled)
+    {
+        pymp3_lock_release(&self->lock);
+        PyErr_SetString(PyExc_RuntimeError, "The encoder was released to the pool, it can't be used until it is acquired again");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Make sure the file-like object has callable `write` attribute
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int encoder_check_fobject(PyObject *fobject)
+{
+    PyObject *fwrite = PyObject_GetAttrString(fobject, "write");
     if (fwrite == NULL)
     {
         PyErr_SetString(PyExc_TypeError, "File-like object must have a write method");
-        return NULL;
+        return -1;
     }
 
 
@@ -87,13 +157,32 @@ static PyObject* Encoder_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     Py_DECREF(fwrite);
     if (!isCallable) {
         PyErr_SetString(PyExc_TypeError, "write attribute of file-like object must be callable");
-        return NULL;
+        return -1;
     }
 
+    return 0;
+}
+
+/**
+ * Creates a new Encoder object for the file-like object
+ */
+static PyObject* Encoder_create(PyTypeObject *type, PyObject *fobject)
+{
+    if (encoder_check_fobject(fobject) < 0)
+        return NULL;
+
     EncoderObject* self = (EncoderObject*) type->tp_alloc(type, 0);
     if (self != NULL)
     {
-        self->lame = lame_init();
+        if (pymp3_lock_init(&self->lock) < 0)
+        {
+            Py_DECREF(self);
+            return NULL;
+        }
+
+        // Default settings
+        self->config = encoder_default_config;
+        self->lame = encoder_new_lame(&self->config);
         if (self->lame == NULL)
         {
             Py_CLEAR(self);
@@ -104,36 +193,74 @@ static PyObject* Encoder_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
         Py_INCREF(fobject);
         self->fobject = fobject;
 
-        // Default settings
-        lame_set_num_channels(self->lame, 2);
-        lame_set_in_samplerate(self->lame, 44100);
-        lame_set_brate(self->lame, 128);
-        lame_set_quality(self->lame, 5);
-        // We aren't providing a file interface, so don't output a blank frame
-        lame_set_bWriteVbrTag(self->lame, 0);
-
-        // Redirect error/debug output to silent function
-        lame_set_errorf(self->lame, &silentOutput);
-        lame_set_debugf(self->lame, &silentOutput);
-        lame_set_msgf(self->lame, &silentOutput);
-
         self->initialized = ENCODER_STATE_NON_INITIALIZED;
+        self->pending = 0;
+        self->pool_key = NULL;
+        self->pooled = 0;
+        self->output_buffer = NULL;
+        self->output_buffer_size = 0;
+
+        self->state = pymp3_get_state(type);
     }
     return (PyObject*) self;
 }
 
+/**
+ * Instantiates the new Encoder class memory
+ */
+static PyObject* Encoder_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *fobject = NULL;
+
+    if (!PyArg_ParseTuple(args, "O:Encoder", &fobject)) {
+        PyErr_SetString(PyExc_ValueError, "File-like object must be provided in a constructor of Encoder");
+        return NULL;
+    }
+
+    return Encoder_create(type, fobject);
+}
+
+#if PY_VERSION_HEX >= 0x03090000
+/**
+ * Vectorcall entry point of the Encoder class, i.e. a fast path for `mp3.Encoder(fp)`
+ */
+PyObject* Encoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames)
+{
+    Py_ssize_t nargs = PyVectorcall_NARGS(nargsf);
+
+    if (nargs == 1 && kwnames == NULL)
+    {
+        return Encoder_create((PyTypeObject *) type, args[0]);
+    }
+
+    return pymp3_vectorcall_fallback((PyTypeObject *) type, args, nargs, kwnames);
+}
+#endif
+
 /**
  * Destroy the Encoder class
  */
 static void Encoder_dealloc(EncoderObject* self)
 {
-    Py_DECREF(self->fobject);
+    pymp3_memory_publish(self->state, PYMP3_STATS_ENCODER, 0, &self->memory_published);
+    pymp3_buffer_free(self->output_buffer, self->output_buffer_size);
+    self->output_buffer = NULL;
+
+    Py_XDECREF(self->fobject);
     self->fobject = NULL;
 
+    Py_CLEAR(self->pool_key);
+
     self->initialized = ENCODER_STATE_ERROR;
 
-    lame_close(self->lame);
-    Py_TYPE(self)->tp_free((PyObject*) self);
+    if (self->lame != NULL)
+        lame_close(self->lame);
+
+    pymp3_lock_free(&self->lock);
+
+    PyTypeObject *type = Py_TYPE(self);
+    type->tp_free((PyObject*) self);
+    Py_DECREF(type);
 }
 
 /**
@@ -157,7 +284,16 @@ static PyObject* Encoder_setChannels(EncoderObject* self, PyObject* args)
         return NULL;
     }
 
-    if (lame_set_num_channels(self->lame, channels) < 0)
+    if (encoder_lock(self) < 0)
+    {
+        return NULL;
+    }
+    int ret = lame_set_num_channels(self->lame, channels);
+    if (ret >= 0)
+        self->config.channels = channels;
+    pymp3_lock_release(&self->lock);
+
+    if (ret < 0)
     {
         PyErr_SetString(PyExc_RuntimeError, "Unable to set the channels");
         return NULL;
@@ -178,7 +314,16 @@ static PyObject* Encoder_setBitRate(EncoderObject* self, PyObject* args)
         return NULL;
     }
 
-    if (lame_set_brate(self->lame, bitrate) < 0)
+    if (encoder_lock(self) < 0)
+    {
+        return NULL;
+    }
+    int ret = lame_set_brate(self->lame, bitrate);
+    if (ret >= 0)
+        self->config.bit_rate = bitrate;
+    pymp3_lock_release(&self->lock);
+
+    if (ret < 0)
     {
         PyErr_SetString(PyExc_RuntimeError, "Unable to set the bit rate");
         return NULL;
@@ -199,7 +344,16 @@ static PyObject* Encoder_setInSampleRate(EncoderObject* self, PyObject* args)
         return NULL;
     }
 
-    if (lame_set_in_samplerate(self->lame, insamplerate) < 0)
+    if (encoder_lock(self) < 0)
+    {
+        return NULL;
+    }
+    int ret = lame_set_in_samplerate(self->lame, insamplerate);
+    if (ret >= 0)
+        self->config.sample_rate = insamplerate;
+    pymp3_lock_release(&self->lock);
+
+    if (ret < 0)
     {
         PyErr_SetString(PyExc_RuntimeError, "Unable to set the input sample rate");
         return NULL;
@@ -220,7 +374,16 @@ static PyObject* Encoder_setQuality(EncoderObject* self, PyObject* args)
         return NULL;
     }
 
-    if (lame_set_quality(self->lame, quality) < 0)
+    if (encoder_lock(self) < 0)
+    {
+        return NULL;
+    }
+    int ret = lame_set_quality(self->lame, quality);
+    if (ret >= 0)
+        self->config.quality = quality;
+    pymp3_lock_release(&self->lock);
+
+    if (ret < 0)
     {
         PyErr_SetString(PyExc_RuntimeError, "Unable to set the quality");
         return NULL;
@@ -261,7 +424,16 @@ static PyObject* Encoder_setMode(EncoderObject* self, PyObject* args)
             return NULL;
     }
 
-    if (lame_set_mode(self->lame, lame_mode) < 0)
+    if (encoder_lock(self) < 0)
+    {
+        return NULL;
+    }
+    int ret = lame_set_mode(self->lame, lame_mode);
+    if (ret >= 0)
+        self->config.mode = lame_mode;
+    pymp3_lock_release(&self->lock);
+
+    if (ret < 0)
     {
         PyErr_SetString(PyExc_RuntimeError, "Unable to set the MPEG mode");
         return NULL;
@@ -272,176 +444,1001 @@ static PyObject* Encoder_setMode(EncoderObject* self, PyObject* args)
 
 
 /**
- * Encode a block of PCM data into MP3
+ * Apply a setting of the bit rate mode, which must be set before the first write. `value` is stored to `setting` of the settings of the encoder
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
  */
-static PyObject* Encoder_write(EncoderObject* self, PyObject* args)
+static int encoder_set_rate_control(EncoderObject* self, int (*setter)(lame_global_flags *, int), int *setting, int value, vbr_mode mode, float quality)
 {
-    short int* inputSamplesArray;
-    Py_ssize_t inputSamplesLength;
-    Py_ssize_t sampleCount;
-    const char * outputBuffer = NULL;
-    Py_ssize_t outputBufferSize;
-    int channels;
+    int ret = -1;
 
-    if (!PyArg_ParseTuple(args, "s#", &inputSamplesArray, &inputSamplesLength))
+    if (encoder_lock(self) < 0)
     {
-        return NULL;
+        return -1;
     }
-    /* inputSamplesArray is a 16-bit PCM integer, but s gives the length in bytes */
-    if (inputSamplesLength % 2 != 0)
+
+    if (encoder_stream_started(self))
     {
-        PyErr_SetString(PyExc_RuntimeError, "Input data must be 16-bit PCM data");
-        return NULL;
+        PyErr_SetString(PyExc_RuntimeError, "The bit rate mode must be set before the first write");
     }
-    inputSamplesLength /= 2;
-
-    channels = lame_get_num_channels(self->lame);
-
-    /* Initialise the encoder if this is our first call */
-    if (self->initialized == ENCODER_STATE_NON_INITIALIZED)
+    else if (mode != vbr_off && lame_set_VBR(self->lame, mode) < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to set the bit rate mode");
+    }
+    else if (mode == vbr_mtrh && lame_set_VBR_quality(self->lame, quality) < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to set the VBR quality");
+    }
+    else if (setter != NULL && setter(self->lame, value) < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to set the bit rate");
+    }
+    else
     {
-        int ret;
+        if (mode != vbr_off)
+            self->config.vbr = mode;
+        if (mode == vbr_mtrh)
+            self->config.vbr_quality = quality;
+        if (setting != NULL)
+            *setting = value;
+        ret = 0;
+    }
 
-        Py_BEGIN_ALLOW_THREADS
-        if (channels == 1 && lame_get_mode(self->lame) != MONO)
-        {
-            /* Default is JOINT_STEREO which makes no sense for mono */
-            lame_set_mode(self->lame, MONO);
-        }
-        else if (lame_get_mode(self->lame) == MONO)
-        {
-            lame_set_mode(self->lame, STEREO);
-        }
-        ret = lame_init_params(self->lame);
-        Py_END_ALLOW_THREADS
+    pymp3_lock_release(&self->lock);
+    return ret;
+}
 
-        if (ret >= 0)
-        {
-            self->initialized = ENCODER_STATE_INITIALIZED;
-        }
-        else
-        {
-            PyErr_SetString(PyExc_RuntimeError, "Error initialising the encoder");
-            self->initialized = ENCODER_STATE_ERROR;
-            return NULL;
-        }
+/**
+ * Enable variable bit rate (the fastest and the best VBR algorithm of LAME, same as `lame -V`)
+ */
+static PyObject* Encoder_setVbr(EncoderObject* self, PyObject* args)
+{
+    double quality;
+
+    if (!PyArg_ParseTuple(args, "d", &quality))
+    {
+        return NULL;
     }
 
-    /* The encoder is in an erroneous state */
-    if (self->initialized != ENCODER_STATE_INITIALIZED)
+    if (quality < 0 || quality >= 10)
     {
-        PyErr_SetString(PyExc_RuntimeError, "Encoder not initialized");
+        PyErr_SetString(PyExc_ValueError, "VBR quality must be in range from 0 (highest) to 9.999 (lowest)");
         return NULL;
     }
-    
-    /* Do the encoding */
-    sampleCount = inputSamplesLength / channels;
-    if (inputSamplesLength % channels != 0)
+
+    if (encoder_set_rate_control(self, NULL, NULL, 0, vbr_mtrh, (float) quality) < 0)
     {
-        PyErr_SetString(PyExc_RuntimeError, "The input data must be interleaved 16-bit PCM");
         return NULL;
     }
 
-    /* Allocate temporary buffer to encoded data */
-    outputBufferSize = sampleCount + (sampleCount / 4) + 7200;
-    outputBuffer = malloc(outputBufferSize);
-    if (outputBuffer == NULL) {
-        PyErr_SetString(PyExc_MemoryError, "Could not allocate memory for output buffer");
+    Py_RETURN_NONE;
+}
+
+/**
+ * Enable average bit rate
+ */
+static PyObject* Encoder_setAbr(EncoderObject* self, PyObject* args)
+{
+    int bitrate;
+
+    if (!PyArg_ParseTuple(args, "i", &bitrate))
+    {
         return NULL;
     }
 
-    Py_ssize_t outputBytes;
-    Py_BEGIN_ALLOW_THREADS
-    if (channels > 1)
+    if (bitrate < 8 || bitrate > 320)
     {
-        outputBytes = lame_encode_buffer_interleaved(
-            self->lame,
-            inputSamplesArray, sampleCount,
-            outputBuffer, outputBufferSize
-        );
+        PyErr_SetString(PyExc_ValueError, "ABR bit rate must be in range from 8 to 320 kbps");
+        return NULL;
     }
-    else
+
+    if (encoder_set_rate_control(self, lame_set_VBR_mean_bitrate_kbps, &self->config.abr_bit_rate, bitrate, vbr_abr, 0) < 0)
     {
-        outputBytes = lame_encode_buffer(
-            self->lame,
-            inputSamplesArray, inputSamplesArray, sampleCount,
-            outputBuffer, outputBufferSize
-        );
+        return NULL;
     }
-    Py_END_ALLOW_THREADS
 
-    /* Call write() method on the file-like object */
-    PyObject * o_write = PyObject_CallMethod(self->fobject, "write", "y#", outputBuffer, outputBytes);
-    if (o_write == NULL) {
+    Py_RETURN_NONE;
+}
 
-# if 0 // Unfortunately, _PyErr_ChainExceptions() is not supported in PyPy interpreter
-        // Chain the previous exception to a new exception RuntimeError
-        PyObject *exc, *val, *tb;
-        PyErr_Fetch(&exc, &val, &tb);
-        PyErr_Format(PyExc_RuntimeError, "Failure in calling write() method of the file-like object (%d bytes)", outputBytes);
-        _PyErr_ChainExceptions(exc, val, tb);
-# else
-        PyErr_Format(PyExc_RuntimeError, "Failure in calling write() method of the file-like object (%d bytes)", outputBytes);
-# endif
+/**
+ * Set the minimum bit rate of VBR/ABR
+ */
+static PyObject* Encoder_setMinBitRate(EncoderObject* self, PyObject* args)
+{
+    int bitrate;
 
-        free(outputBuffer);
+    if (!PyArg_ParseTuple(args, "i", &bitrate))
+    {
         return NULL;
     }
-    Py_DECREF(o_write);
 
-    free(outputBuffer);  // release memory
-    return PyLong_FromLong(inputSamplesLength*2);   // return how many bytes are processed
-}
+    if (encoder_set_rate_control(self, lame_set_VBR_min_bitrate_kbps, &self->config.min_bit_rate, bitrate, vbr_off, 0) < 0)
+    {
+        return NULL;
+    }
 
+    Py_RETURN_NONE;
+}
 
 /**
- * Finalise the the MP3 encoder
+ * Set the maximum bit rate of VBR/ABR
  */
-static PyObject* Encoder_flush(EncoderObject* self, PyObject* args)
+static PyObject* Encoder_setMaxBitRate(EncoderObject* self, PyObject* args)
 {
-    if (self->initialized == ENCODER_STATE_INITIALIZED)
+    int bitrate;
+
+    if (!PyArg_ParseTuple(args, "i", &bitrate))
     {
-        Py_ssize_t outputBufferSize = 8 * 1024;
-        const char * outputBuffer = malloc(outputBufferSize);
-        if (outputBuffer == NULL) {
-            PyErr_SetString(PyExc_MemoryError, "Could not allocate memory for output buffer");
-            return NULL;
-        }
+        return NULL;
+    }
 
-        Py_ssize_t outputBytes = 0;
+    if (encoder_set_rate_control(self, lame_set_VBR_max_bitrate_kbps, &self->config.max_bit_rate, bitrate, vbr_off, 0) < 0)
+    {
+        return NULL;
+    }
 
-        Py_BEGIN_ALLOW_THREADS
-        outputBytes = lame_encode_flush(self->lame, outputBuffer, outputBufferSize);
-        Py_END_ALLOW_THREADS
+    Py_RETURN_NONE;
+}
 
-        if (outputBytes > 0)
-        {
-            /* Call write() method on the file-like object */
-            PyObject * o_write = PyObject_CallMethod(self->fobject, "write", "y#", outputBuffer, outputBytes);
-            if (o_write == NULL) {
+/**
+ * Enable/disable the low-latency profile
+ */
+static PyObject* Encoder_setLowLatency(EncoderObject* self, PyObject* args)
+{
+    int enabled;
 
-# if 0 // Unfortunately, _PyErr_ChainExceptions() is not supported in PyPy interpreter
-                // Chain the previous exception to a new exception RuntimeError
-                PyObject *exc, *val, *tb;
-                PyErr_Fetch(&exc, &val, &tb);
-                PyErr_Format(PyExc_RuntimeError, "Failure in calling write() method of the file-like object (%d bytes)", outputBytes);
-                _PyErr_ChainExceptions(exc, val, tb);
-# else
-                PyErr_Format(PyExc_RuntimeError, "Failure in calling write() method of the file-like object (%d bytes)", outputBytes);
-# endif
+    if (!PyArg_ParseTuple(args, "p", &enabled))
+    {
+        return NULL;
+    }
 
-                free(outputBuffer);
-                return NULL;
-            }
-            Py_DECREF(o_write);
-        }
+    if (encoder_lock(self) < 0)
+    {
+        return NULL;
+    }
 
-        free(outputBuffer);  // release memory
-        return PyBool_FromLong(outputBytes);   // return how many bytes were flushed
+    int ret = -1;
+    if (encoder_stream_started(self))
+    {
+        PyErr_SetString(PyExc_RuntimeError, "The low-latency profile must be set before the first write");
+    }
+    /* The bit reservoir makes the encoder hold back frames until the following frames are encoded */
+    else if (lame_set_disable_reservoir(self->lame, enabled) < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to set the low-latency profile");
     }
     else
     {
-        PyErr_SetString(PyExc_RuntimeError, "Not currently encoding");
+        self->config.low_latency = enabled;
+        ret = 0;
+    }
+
+    pymp3_lock_release(&self->lock);
+
+    if (ret < 0)
+    {
         return NULL;
     }
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * Get the number of samples (per channel) buffered inside LAME, which are not yet written as MP3 frames.
+ * This includes the encoder delay and the look-ahead of the psychoacoustic model.
+ */
+static PyObject* Encoder_getBufferedSamples(EncoderObject* self, PyObject* args)
+{
+    if (encoder_lock(self) < 0)
+    {
+        return NULL;
+    }
+
+    int samples = self->initialized == ENCODER_STATE_INITIALIZED ? lame_get_mf_samples_to_encode(self->lame) : 0;
+
+    pymp3_lock_release(&self->lock);
+    return PyLong_FromLong(samples);
+}
+
+/**
+ * Get the encoder delay (in samples)
+ */
+static PyObject* Encoder_getEncoderDelay(EncoderObject* self, PyObject* args)
+{
+    return encoder_get_param(self, lame_get_encoder_delay);
+}
+
+/**
+ * Get the number of samples per MPEG frame
+ */
+static PyObject* Encoder_getFrameSize(EncoderObject* self, PyObject* args)
+{
+    return encoder_get_param(self, lame_get_framesize);
+}
+
+
+/**
+ * Get performance counters of the encoder, as published at the end of the last call.
+ * The object lock is not taken, so the counters can be scraped while another thread is encoding.
+ */
+static PyObject* Encoder_stats(EncoderObject* self, PyObject* args)
+{
+    pymp3_stats stats;
+    pymp3_stats_snapshot(self->state, &self->published, &stats);
+    return pymp3_stats_to_dict(&stats, PYMP3_STATS_ENCODER);
+}
+
+
+/**
+ * Encode a block of PCM data into MP3
+ */
+static PyObject* Encoder_write(EncoderObject* self, PyObject *const *args, Py_ssize_t nargs)
+{
+    Py_buffer view;
+
+    if (nargs != 1)
+    {
+        PyErr_Format(PyExc_TypeError, "write() takes exactly one argument (%zd given)", nargs);
+        return NULL;
+    }
+
+    /* Any object supporting the buffer protocol is accepted (bytes, bytearray, memoryview, array, etc.) */
+    if (PyObject_GetBuffer(args[0], &view, PyBUF_SIMPLE) < 0)
+    {
+        return NULL;
+    }
+
+    PyObject * result = NULL;
+    if (encoder_lock(self) == 0)
+    {
+        result = encoder_write_samples(self, (short int *) view.buf, view.len);
+        pymp3_stats_publish(self->state, PYMP3_STATS_ENCODER, &self->stats, &self->published);
+        pymp3_lock_release(&self->lock);
+    }
+    PyBuffer_Release(&view);
+
+    return result;
+}
+
+/**
+ * Get the current position of a seekable file-like object
+ *
+ * \return  The position, or -1 if the file-like object is not seekable (no exception is set)
+ */
+static long long encoder_tell(EncoderObject* self)
+{
+    long long position = -1;
+
+    PyObject * o_seekable = PyObject_CallMethod(self->fobject, "seekable", NULL);
+    if (o_seekable != NULL && PyObject_IsTrue(o_seekable) == 1)
+    {
+        PyObject * o_tell = PyObject_CallMethod(self->fobject, "tell", NULL);
+        if (o_tell != NULL)
+        {
+            position = PyLong_AsLongLong(o_tell);
+            Py_DECREF(o_tell);
+        }
+    }
+    Py_XDECREF(o_seekable);
+
+    if (PyErr_Occurred())
+    {
+        /* Not a file (no seekable()/tell() methods), or it is a pipe/socket */
+        PyErr_Clear();
+        position = -1;
+    }
+
+    return position;
+}
+
+/**
+ * Write the final Xing/LAME tag of VBR/ABR stream over its placeholder frame at the beginning of the stream,
+ * then restore the file position
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int encoder_write_vbr_tag(EncoderObject* self)
+{
+    unsigned char tag[2880];   // larger than the largest MPEG frame
+
+    if (self->tag_offset < 0)
+        return 0;
+
+    size_t tagSize = lame_get_lametag_frame(self->lame, tag, sizeof(tag));
+    if (tagSize == 0 || tagSize > sizeof(tag))
+        return 0;
+
+    PyObject * o_end = PyObject_CallMethod(self->fobject, "tell", NULL);
+    if (o_end == NULL)
+        return -1;
+
+    PyObject * o_result = PyObject_CallMethod(self->fobject, "seek", "L", self->tag_offset);
+    if (o_result != NULL)
+    {
+        Py_DECREF(o_result);
+        o_result = PyObject_CallMethod(self->fobject, "write", "y#", tag, (Py_ssize_t) tagSize);
+    }
+    if (o_result != NULL)
+    {
+        Py_DECREF(o_result);
+        o_result = PyObject_CallMethod(self->fobject, "seek", "O", o_end);
+    }
+    Py_DECREF(o_end);
+
+    if (o_result == NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Failure in writing VBR tag to the file-like object");
+        return -1;
+    }
+    Py_DECREF(o_result);
+
+    /* The tag is written once per stream */
+    self->tag_offset = -1;
+    return 0;
+}
+
+/**
+ * Make sure the output buffer has at least `size` bytes
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int encoder_reserve_output(EncoderObject* self, size_t size)
+{
+    if (size <= self->output_buffer_size)
+        return 0;
+
+    /* The buffer has the size of a size class of the pool of buffers */
+    size = pymp3_buffer_round(size);
+    unsigned char * new_buffer = self->output_buffer == NULL ? pymp3_buffer_alloc(size) : pymp3_mem_realloc(self->output_buffer, size);
+    if (new_buffer == NULL)
+    {
+        PyErr_SetString(PyExc_MemoryError, "Could not allocate memory for output buffer");
+        return -1;
+    }
+    self->output_buffer = new_buffer;
+    self->output_buffer_size = size;
+
+    pymp3_memory_publish(self->state, PYMP3_STATS_ENCODER, self->output_buffer_size, &self->memory_published);
+    return 0;
+}
+
+/**
+ * Initialise LAME with the settings of the encoder (on the first write, or when a parameter computed by LAME is requested).
+ * The settings of the bit rate mode can't be changed after that. Called with the object lock held
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int encoder_init_params(EncoderObject* self)
+{
+    int ret;
+    int channels = lame_get_num_channels(self->lame);
+
+    /* The Xing/LAME tag of VBR/ABR stream is known at the end only, it is written over
+    *  a placeholder frame at the beginning of the stream, if the file-like object is seekable
+    */
+    self->vbr_tag = 0;
+    if (lame_get_VBR(self->lame) != vbr_off)
+    {
+        self->tag_offset = encoder_tell(self);
+        self->vbr_tag = self->tag_offset >= 0;
+    }
+    lame_set_bWriteVbrTag(self->lame, self->vbr_tag);
+
+    Py_BEGIN_ALLOW_THREADS
+    if (channels == 1 && lame_get_mode(self->lame) != MONO)
+    {
+        /* Default is JOINT_STEREO which makes no sense for mono */
+        lame_set_mode(self->lame, MONO);
+    }
+    else if (lame_get_mode(self->lame) == MONO)
+    {
+        lame_set_mode(self->lame, STEREO);
+    }
+    ret = lame_init_params(self->lame);
+    Py_END_ALLOW_THREADS
+
+    if (ret < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Error initialising the encoder");
+        self->initialized = ENCODER_STATE_ERROR;
+        return -1;
+    }
+
+    self->lame_config = self->config;
+    self->initialized = ENCODER_STATE_INITIALIZED;
+    return 0;
+}
+
+/**
+ * Make sure LAME is initialised with the current settings before encoding or getting a parameter computed by LAME.
+ * Settings changed after reset() and before the first write of the new stream are applied by a fresh LAME state.
+ * Called with the object lock held
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int encoder_prepare(EncoderObject* self)
+{
+    if (self->initialized == ENCODER_STATE_INITIALIZED && !encoder_stream_started(self) &&
+        !encoder_config_equal(&self->config, &self->lame_config) && encoder_recycle(self) < 0)
+    {
+        return -1;
+    }
+
+    if (self->initialized == ENCODER_STATE_NON_INITIALIZED)
+        return encoder_init_params(self);
+
+    return 0;
+}
+
+/**
+ * Whether the current stream has data, so the settings of the bit rate mode can't be changed anymore.
+ * An encoder restarted by reset() keeps its initialised LAME encoder, but its stream is empty until the first write
+ */
+static int encoder_stream_started(EncoderObject* self)
+{
+    if (self->initialized == ENCODER_STATE_NON_INITIALIZED)
+        return 0;
+    if (self->initialized == ENCODER_STATE_ERROR)
+        return 1;
+    return self->pending || lame_get_frameNum(self->lame) > 0;
+}
+
+/**
+ * Get a parameter computed by lame_init_params(), LAME is initialised first if needed
+ */
+static PyObject* encoder_get_param(EncoderObject* self, int (*getter)(const lame_global_flags *))
+{
+    if (encoder_lock(self) < 0)
+    {
+        return NULL;
+    }
+
+    PyObject * result = NULL;
+    if (encoder_prepare(self) == 0 && self->initialized == ENCODER_STATE_INITIALIZED)
+    {
+        result = PyLong_FromLong(getter(self->lame));
+    }
+    else if (!PyErr_Occurred())
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Encoder not initialized");
+    }
+
+    pymp3_lock_release(&self->lock);
+    return result;
+}
+
+/**
+ * Encode a block of 16-bit PCM data (`inputSamplesLength` is in bytes) and write MP3 frames to the file-like object
+ */
+static PyObject* encoder_write_samples(EncoderObject* self, short int* inputSamplesArray, Py_ssize_t inputSamplesLength)
+{
+    Py_ssize_t sampleCount;
+    const char * outputBuffer = NULL;
+    Py_ssize_t outputBufferSize;
+    int channels;
+
+    /* inputSamplesArray is a 16-bit PCM integer, but s gives the length in bytes */
+    if (inputSamplesLength % 2 != 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Input data must be 16-bit PCM data");
+        return NULL;
+    }
+    inputSamplesLength /= 2;
+
+    /* Initialise the encoder if this is our first call */
+    if (encoder_prepare(self) < 0)
+    {
+        return NULL;
+    }
+
+    /* The encoder is in an erroneous state */
+    if (self->initialized != ENCODER_STATE_INITIALIZED)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Encoder not initialized");
+        return NULL;
+    }
+
+    channels = lame_get_num_channels(self->lame);
+
+    /* Do the encoding */
+    sampleCount = inputSamplesLength / channels;
+    if (inputSamplesLength % channels != 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "The input data must be interleaved 16-bit PCM");
+        return NULL;
+    }
+
+    /* In low-latency mode, every MPEG frame is written to the file as soon as it is encoded.
+    *  Large blocks are encoded in chunks, so the output buffer doesn't grow with the size of the input
+    */
+    Py_ssize_t chunkSize = sampleCount < ENCODER_MAX_CHUNK_SAMPLES ? sampleCount : ENCODER_MAX_CHUNK_SAMPLES;
+    if (self->config.low_latency)
+    {
+        Py_ssize_t frameSize = lame_get_framesize(self->lame);
+        if (frameSize > 0 && frameSize < chunkSize)
+            chunkSize = frameSize;
+    }
+
+    /* The worst case size of the encoded data of a chunk, as recommended by LAME */
+    outputBufferSize = chunkSize + (chunkSize / 4) + 7200;
+    if (encoder_reserve_output(self, outputBufferSize) < 0)
+        return NULL;
+    outputBuffer = (const char *) self->output_buffer;
+
+    int timers = PYMP3_TIMERS_ENABLED(self->state);
+    unsigned long long started;
+    int frameNum = lame_get_frameNum(self->lame);
+
+    self->stats.bytes_in += inputSamplesLength * 2;
+    if (sampleCount > 0)
+        self->pending = 1;
+
+    Py_ssize_t offset = 0;
+    while (offset < sampleCount)
+    {
+        Py_ssize_t count = sampleCount - offset;
+        if (count > chunkSize)
+            count = chunkSize;
+
+        short int* chunkSamples = inputSamplesArray + offset * channels;
+        offset += count;
+
+        Py_ssize_t outputBytes;
+        started = PYMP3_TIMER_START(timers);
+        Py_BEGIN_ALLOW_THREADS
+        if (channels > 1)
+        {
+            outputBytes = lame_encode_buffer_interleaved(
+                self->lame,
+                chunkSamples, count,
+                outputBuffer, outputBufferSize
+            );
+        }
+        else
+        {
+            outputBytes = lame_encode_buffer(
+                self->lame,
+                chunkSamples, chunkSamples, count,
+                outputBuffer, outputBufferSize
+            );
+        }
+        Py_END_ALLOW_THREADS
+        PYMP3_TIMER_STOP(timers, started, self->stats.codec_ns);
+
+        self->stats.frames += lame_get_frameNum(self->lame) - frameNum;
+        frameNum = lame_get_frameNum(self->lame);
+
+        if (outputBytes < 0)
+        {
+            PyErr_Format(PyExc_RuntimeError, "Error encoding PCM data (lame error code %zd)", outputBytes);
+            return NULL;
+        }
+
+        if (outputBytes == 0)
+            continue;
+
+        self->stats.bytes_out += outputBytes;
+
+        /* Call write() method on the file-like object */
+        started = PYMP3_TIMER_START(timers);
+        PyObject * o_write = PyObject_CallMethod(self->fobject, "write", "y#", outputBuffer, outputBytes);
+        PYMP3_TIMER_STOP(timers, started, self->stats.io_ns);
+        self->stats.io_calls++;
+        if (o_write == NULL) {
+
+# if 0 // Unfortunately, _PyErr_ChainExceptions() is not supported in PyPy interpreter
+            // Chain the previous exception to a new exception RuntimeError
+            PyObject *exc, *val, *tb;
+            PyErr_Fetch(&exc, &val, &tb);
+            PyErr_Format(PyExc_RuntimeError, "Failure in calling write() method of the file-like object (%zd bytes)", outputBytes);
+            _PyErr_ChainExceptions(exc, val, tb);
+# else
+            PyErr_Format(PyExc_RuntimeError, "Failure in calling write() method of the file-like object (%zd bytes)", outputBytes);
+# endif
+
+            return NULL;
+        }
+        Py_DECREF(o_write);
+    }
+
+    return PyLong_FromLong(inputSamplesLength*2);   // return how many bytes are processed
+}
+
+
+/**
+ * Finalise the the MP3 encoder
+ */
+static PyObject* Encoder_flush(EncoderObject* self, PyObject* args)
+{
+    if (encoder_lock(self) < 0)
+    {
+        return NULL;
+    }
+
+    PyObject * result = encoder_flush(self);
+
+    pymp3_stats_publish(self->state, PYMP3_STATS_ENCODER, &self->stats, &self->published);
+    pymp3_lock_release(&self->lock);
+    return result;
+}
+
+/**
+ * Flush the encoder and write the last MP3 frames to the file-like object, called with the object lock held
+ */
+static PyObject* encoder_flush(EncoderObject* self)
+{
+    if (self->initialized == ENCODER_STATE_INITIALIZED)
+    {
+        self->pending = 0;
+
+        if (encoder_reserve_output(self, ENCODER_FLUSH_BUFFER_SIZE) < 0)
+            return NULL;
+        Py_ssize_t outputBufferSize = self->output_buffer_size;
+        const char * outputBuffer = (const char *) self->output_buffer;
+
+        Py_ssize_t outputBytes = 0;
+        int timers = PYMP3_TIMERS_ENABLED(self->state);
+        int frameNum = lame_get_frameNum(self->lame);
+
+        unsigned long long started = PYMP3_TIMER_START(timers);
+        Py_BEGIN_ALLOW_THREADS
+        outputBytes = lame_encode_flush(self->lame, outputBuffer, outputBufferSize);
+        Py_END_ALLOW_THREADS
+        PYMP3_TIMER_STOP(timers, started, self->stats.codec_ns);
+
+        self->stats.frames += lame_get_frameNum(self->lame) - frameNum;
+
+        if (outputBytes > 0)
+        {
+            self->stats.bytes_out += outputBytes;
+
+            /* Call write() method on the file-like object */
+            started = PYMP3_TIMER_START(timers);
+            PyObject * o_write = PyObject_CallMethod(self->fobject, "write", "y#", outputBuffer, outputBytes);
+            PYMP3_TIMER_STOP(timers, started, self->stats.io_ns);
+            self->stats.io_calls++;
+            if (o_write == NULL) {
+
+# if 0 // Unfortunately, _PyErr_ChainExceptions() is not supported in PyPy interpreter
+                // Chain the previous exception to a new exception RuntimeError
+                PyObject *exc, *val, *tb;
+                PyErr_Fetch(&exc, &val, &tb);
+                PyErr_Format(PyExc_RuntimeError, "Failure in calling write() method of the file-like object (%d bytes)", outputBytes);
+                _PyErr_ChainExceptions(exc, val, tb);
+# else
+                PyErr_Format(PyExc_RuntimeError, "Failure in calling write() method of the file-like object (%d bytes)", outputBytes);
+# endif
+
+                return NULL;
+            }
+            Py_DECREF(o_write);
+        }
+
+        if (self->vbr_tag && encoder_write_vbr_tag(self) < 0)
+            return NULL;
+
+        return PyBool_FromLong(outputBytes);   // return how many bytes were flushed
+    }
+    else
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Not currently encoding");
+        return NULL;
+    }
+}
+
+
+/**
+ * Start a new MP3 stream with the same settings, written to `fobject` (may be None for an idle encoder).
+ * Not flushed data of the current stream is flushed to the current file-like object first.
+ * The initialised LAME encoder is reused, unless `fresh` is set. Called with the object lock held.
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int encoder_reset(EncoderObject* self, PyObject *fobject, int fresh)
+{
+    if (fobject != Py_None && encoder_check_fobject(fobject) < 0)
+        return -1;
+
+    if (self->initialized == ENCODER_STATE_ERROR)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Encoder not initialized");
+        return -1;
+    }
+
+    if (self->initialized == ENCODER_STATE_INITIALIZED && self->pending)
+    {
+        PyObject * result = encoder_flush(self);
+        if (result == NULL)
+            return -1;
+        Py_DECREF(result);
+    }
+
+    Py_INCREF(fobject);
+    Py_SETREF(self->fobject, fobject);
+
+    if (self->initialized == ENCODER_STATE_INITIALIZED)
+    {
+        return fresh ? encoder_recycle(self) : encoder_restart(self);
+    }
+
+    return 0;
+}
+
+/**
+ * Start a new stream with the initialised LAME encoder, which keeps the tables built by lame_init_params().
+ * lame_init_bitstream() resets the frame counter and the histograms of LAME, and writes a new placeholder
+ * of the Xing/LAME tag. LAME keeps the padding of its look-ahead buffer and the state of the psychoacoustic model,
+ * so the stream starts with a little extra silence and isn't byte-identical to the output of a new encoder.
+ * A VBR/ABR encoder gets a fresh LAME state if the tag can be written into one of the files only.
+ * Called with the object lock held, after the previous stream is flushed
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int encoder_restart(EncoderObject* self)
+{
+    long long tag_offset = -1;
+    if (self->lame_config.vbr != vbr_off)
+    {
+        tag_offset = encoder_tell(self);
+        if ((tag_offset >= 0) != self->vbr_tag)
+            return encoder_recycle(self);
+    }
+
+    if (lame_init_bitstream(self->lame) < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to reset the encoder");
+        self->initialized = ENCODER_STATE_ERROR;
+        return -1;
+    }
+
+    self->pending = 0;
+    self->tag_offset = tag_offset;
+    return 0;
+}
+
+/**
+ * Replace the LAME encoder with a new one with the current settings. Its output is the same as of a new encoder,
+ * and lame_init_params() runs again on the first write. Called with the object lock held
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int encoder_recycle(EncoderObject* self)
+{
+    lame_global_flags *lame = encoder_new_lame(&self->config);
+    if (lame == NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to reset the encoder");
+        return -1;
+    }
+
+    lame_close(self->lame);
+    self->lame = lame;
+    self->initialized = ENCODER_STATE_NON_INITIALIZED;
+    self->pending = 0;
+    self->vbr_tag = 0;
+    self->tag_offset = -1;
+    return 0;
+}
+
+/**
+ * Start a new MP3 stream with the same settings: reset(fobject, fresh=False)
+ */
+static PyObject* Encoder_reset(EncoderObject* self, PyObject* args, PyObject* kwds)
+{
+    static char *kwlist[] = {"fobject", "fresh", NULL};
+
+    PyObject *fobject = NULL;
+    int fresh = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|p:reset", kwlist, &fobject, &fresh))
+    {
+        return NULL;
+    }
+
+    if (encoder_lock(self) < 0)
+    {
+        return NULL;
+    }
+
+    int ret = encoder_reset(self, fobject, fresh);
+
+    pymp3_stats_publish(self->state, PYMP3_STATS_ENCODER, &self->stats, &self->published);
+    pymp3_lock_release(&self->lock);
+
+    if (ret < 0)
+    {
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+
+/**
+ * Get an encoder from the pool of the module, or create a new one:
+ * mp3.acquire_encoder(fobject, sample_rate=44100, channels=2, bit_rate=128, quality=5)
+ */
+PyObject* pymp3_acquire_encoder(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"fobject", "sample_rate", "channels", "bit_rate", "quality", NULL};
+
+    pymp3_state *state = (pymp3_state *) PyModule_GetState(module);
+    PyObject *fobject = NULL;
+    int sample_rate = 44100, channels = 2, bit_rate = 128, quality = 5;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|iiii:acquire_encoder", kwlist,
+                                     &fobject, &sample_rate, &channels, &bit_rate, &quality))
+    {
+        return NULL;
+    }
+
+    if (channels != 1 && channels != 2)
+    {
+        PyErr_SetString(PyExc_ValueError, "channels must be 1 or 2");
+        return NULL;
+    }
+
+    if (encoder_check_fobject(fobject) < 0)
+        return NULL;
+
+    PyObject *key = Py_BuildValue("(iiii)", sample_rate, channels, bit_rate, quality);
+    if (key == NULL)
+        return NULL;
+
+    /* Take an idle encoder of this configuration */
+    EncoderObject *self = NULL;
+
+    PyThread_acquire_lock(state->pool_lock, WAIT_LOCK);
+    PyObject *idle = PyDict_GetItemWithError(state->encoder_pool, key);
+    if (idle != NULL && PyList_GET_SIZE(idle) > 0)
+    {
+        Py_ssize_t last = PyList_GET_SIZE(idle) - 1;
+        self = (EncoderObject *) PyList_GET_ITEM(idle, last);
+        Py_INCREF(self);
+        PyList_SetSlice(idle, last, last + 1, NULL);
+    }
+    PyThread_release_lock(state->pool_lock);
+
+    if (PyErr_Occurred())
+    {
+        Py_XDECREF(self);
+        Py_DECREF(key);
+        return NULL;
+    }
+
+    if (self != NULL)
+    {
+        Py_DECREF(key);
+
+        if (pymp3_lock_acquire(&self->lock, (PyObject *) self) < 0)
+        {
+            Py_DECREF(self);
+            return NULL;
+        }
+        /* The idle encoder was restarted with the settings of the configuration by release_encoder() */
+        self->pooled = 0;
+        int ret = encoder_reset(self, fobject, 0);
+        pymp3_lock_release(&self->lock);
+
+        if (ret < 0)
+        {
+            Py_DECREF(self);
+            return NULL;
+        }
+        return (PyObject *) self;
+    }
+
+    /* Nothing in the pool, create a new encoder */
+    self = (EncoderObject *) Encoder_create((PyTypeObject *) state->EncoderType, fobject);
+    if (self == NULL)
+    {
+        Py_DECREF(key);
+        return NULL;
+    }
+
+    encoder_config config = encoder_default_config;
+    config.sample_rate = sample_rate;
+    config.channels = channels;
+    config.bit_rate = bit_rate;
+    config.quality = quality;
+    config.mode = channels == 1 ? MONO : JOINT_STEREO;
+
+    lame_global_flags *lame = encoder_new_lame(&config);
+    if (lame == NULL)
+    {
+        PyErr_SetString(PyExc_ValueError, "Invalid encoder settings");
+        Py_DECREF(key);
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    lame_close(self->lame);
+    self->lame = lame;
+    self->config = config;
+    self->pool_config = config;
+    self->pool_key = key;
+    return (PyObject *) self;
+}
+
+/**
+ * Return an encoder to the pool of the module: mp3.release_encoder(encoder).
+ * Not flushed data is flushed, and the encoder releases its file-like object. Settings changed after acquire_encoder()
+ * are reverted to the configuration of the pool, and the encoder can't be used until it is acquired again.
+ */
+PyObject* pymp3_release_encoder(PyObject *module, PyObject *encoder)
+{
+    pymp3_state *state = (pymp3_state *) PyModule_GetState(module);
+
+    if (!PyObject_TypeCheck(encoder, (PyTypeObject *) state->EncoderType))
+    {
+        PyErr_SetString(PyExc_TypeError, "release_encoder() argument must be an Encoder");
+        return NULL;
+    }
+
+    EncoderObject *self = (EncoderObject *) encoder;
+    if (self->pool_key == NULL)
+    {
+        PyErr_SetString(PyExc_ValueError, "The encoder was not created by acquire_encoder()");
+        return NULL;
+    }
+
+    if (pymp3_lock_acquire(&self->lock, (PyObject *) self) < 0)
+    {
+        return NULL;
+    }
+
+    if (self->pooled)
+    {
+        pymp3_lock_release(&self->lock);
+        PyErr_SetString(PyExc_ValueError, "The encoder is already released to the pool");
+        return NULL;
+    }
+
+    int ret = encoder_reset(self, Py_None, 0);
+    if (ret == 0 && !encoder_config_equal(&self->config, &self->pool_config))
+    {
+        self->config = self->pool_config;
+        ret = encoder_recycle(self);
+    }
+    if (ret == 0)
+        self->pooled = 1;
+    pymp3_stats_publish(self->state, PYMP3_STATS_ENCODER, &self->stats, &self->published);
+    pymp3_lock_release(&self->lock);
+
+    if (ret < 0)
+    {
+        return NULL;
+    }
+
+    /* A list for the first idle encoder of this configuration. It is created before taking the pool lock,
+    *  because allocation of a GC object may run finalizers, which could call release_encoder() again.
+    */
+    PyObject *new_list = PyList_New(0);
+    if (new_list == NULL)
+    {
+        return NULL;
+    }
+
+    /* Keep a limited number of idle encoders, the extra ones are destroyed */
+    PyThread_acquire_lock(state->pool_lock, WAIT_LOCK);
+    PyObject *idle = PyDict_GetItemWithError(state->encoder_pool, self->pool_key);
+    if (idle == NULL && !PyErr_Occurred())
+    {
+        if (PyDict_SetItem(state->encoder_pool, self->pool_key, new_list) == 0)
+            idle = new_list;
+    }
+    if (idle != NULL && PyList_GET_SIZE(idle) < ENCODER_POOL_MAX_IDLE)
+    {
+        PyList_Append(idle, encoder);
+    }
+    PyThread_release_lock(state->pool_lock);
+
+    Py_DECREF(new_list);
+
+    if (PyErr_Occurred())
+    {
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
 }
@@ -4,6 +4,8 @@
 #include <Python.h>
 #include <lame/lame.h>
 
+#include "py_module.h"
+
 
 typedef enum encoder_state {
   ENCODER_STATE_NON_INITIALIZED = 0,
@@ -12,8 +14,26 @@ typedef enum encoder_state {
 } encoder_state_t;
 
 
+/* Settings of an encoder, which are applied to a new LAME encoder when the encoder is recycled */
+typedef struct {
+    int channels;
+    int sample_rate;
+    int bit_rate;
+    int quality;
+    MPEG_mode mode;                 /* NOT_SET for LAME's default */
+    vbr_mode vbr;
+    float vbr_quality;              /* Quality of vbr_mtrh */
+    int abr_bit_rate;               /* Target bit rate of vbr_abr */
+    int min_bit_rate;               /* Minimum/maximum bit rate of VBR/ABR, 0 for LAME's default */
+    int max_bit_rate;
+    int low_latency;                /* Write every MPEG frame as soon as it is encoded (no bit reservoir) */
+} encoder_config;
+
+
 typedef struct {
     PyObject_HEAD
+    /* Serializes method calls, the lock is held while the GIL is released for encoding */
+    pymp3_lock lock;
 
     /* File-like object that will be written */
     PyObject *fobject;
@@ -22,6 +42,35 @@ typedef struct {
     lame_global_flags* lame;
 
     encoder_state_t initialized;
+
+    /* Settings of the encoder, kept by reset(), and the settings LAME was initialised with by lame_init_params() */
+    encoder_config config;
+    encoder_config lame_config;
+
+    /* Data was written after the last flush */
+    int pending;
+
+    /* The Xing/LAME tag of VBR/ABR stream is written at `tag_offset` of the file-like object after flush */
+    int vbr_tag;
+    long long tag_offset;
+
+    /* Configuration (sample_rate, channels, bit_rate, quality) of an encoder created by mp3.acquire_encoder(),
+    *  its settings are restored when it is released to the pool */
+    PyObject *pool_key;
+    encoder_config pool_config;
+
+    /* The encoder is idle in the pool (released and not acquired again), its methods raise RuntimeError */
+    int pooled;
+
+    /* Buffer of encoded MP3 data, kept between calls, and its size added to the module-wide memory usage */
+    unsigned char *output_buffer;
+    size_t output_buffer_size;
+    size_t memory_published;
+
+    /* Performance counters, and the part of them already added to the module-wide aggregates */
+    pymp3_state *state;
+    pymp3_stats stats;
+    pymp3_stats published;
 } EncoderObject;
 
 /* Instantiates the new Encoder class memory */
@@ -33,11 +82,51 @@ static void Encoder_dealloc(EncoderObject* self);
 /* Initialises a new encoder */
 static int Encoder_init(EncoderObject* self, PyObject* args, PyObject* kwds);
 
+/* Encodes a block of PCM data and writes MP3 frames to the file-like object */
+static PyObject* encoder_write_samples(EncoderObject* self, short int* inputSamplesArray, Py_ssize_t inputSamplesLength);
+
+/* Initialises LAME with the settings, and gets a parameter computed by LAME */
+static int encoder_init_params(EncoderObject* self);
+static int encoder_prepare(EncoderObject* self);
+static int encoder_stream_started(EncoderObject* self);
+static PyObject* encoder_get_param(EncoderObject* self, int (*getter)(const lame_global_flags *));
+
+/* Makes sure the output buffer has at least `size` bytes */
+static int encoder_reserve_output(EncoderObject* self, size_t size);
+
+/* Flushes the encoder and writes the last MP3 frames to the file-like object */
+static PyObject* encoder_flush(EncoderObject* self);
+
+/* Position of a seekable file-like object, and writing of the VBR tag */
+static long long encoder_tell(EncoderObject* self);
+static int encoder_write_vbr_tag(EncoderObject* self);
+
+/* Starts a new MP3 stream with the same settings, reusing the initialised LAME encoder unless `fresh` is set */
+static int encoder_reset(EncoderObject* self, PyObject *fobject, int fresh);
+static int encoder_restart(EncoderObject* self);
+
+/* Creates a LAME encoder with the settings, and replaces the LAME encoder with a new one */
+static lame_global_flags* encoder_new_lame(const encoder_config *config);
+static int encoder_recycle(EncoderObject* self);
+
+/* Takes the object lock of an encoder, which is not idle in the pool */
+static int encoder_lock(EncoderObject* self);
+
 /** The methods in the Encoder class */
 static PyObject* Encoder_setChannels(EncoderObject* self, PyObject* args);
 static PyObject* Encoder_setQuality(EncoderObject* self, PyObject* args);
 static PyObject* Encoder_setBitRate(EncoderObject* self, PyObject* args);
 static PyObject* Encoder_setMode(EncoderObject* self, PyObject* args);
 static PyObject* Encoder_setInSampleRate(EncoderObject* self, PyObject* args);
-static PyObject* Encoder_write(EncoderObject* self, PyObject* args);
+static PyObject* Encoder_write(EncoderObject* self, PyObject *const *args, Py_ssize_t nargs);
 static PyObject* Encoder_flush(EncoderObject* self, PyObject* args);
+static PyObject* Encoder_reset(EncoderObject* self, PyObject* args, PyObject* kwds);
+static PyObject* Encoder_setVbr(EncoderObject* self, PyObject* args);
+static PyObject* Encoder_setAbr(EncoderObject* self, PyObject* args);
+static PyObject* Encoder_setMinBitRate(EncoderObject* self, PyObject* args);
+static PyObject* Encoder_setMaxBitRate(EncoderObject* self, PyObject* args);
+static PyObject* Encoder_setLowLatency(EncoderObject* self, PyObject* args);
+static PyObject* Encoder_getBufferedSamples(EncoderObject* self, PyObject* args);
+static PyObject* Encoder_getEncoderDelay(EncoderObject* self, PyObject* args);
+static PyObject* Encoder_getFrameSize(EncoderObject* self, PyObject* args);
+static PyObject* Encoder_stats(EncoderObject* self, PyObject* args);
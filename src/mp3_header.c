@@ -0,0 +1,390 @@
+#include "mp3_header.h"
+#include "py_module.h"
+
+#define PROBE_DEFAULT_MAX_BYTES (64*1024)   // Default amount of data read by mp3.probe()
+#define PROBE_DEFAULT_FRAMES 4              // Default number of consecutive frames, which must be found by mp3.probe()
+#define ID3V1_TAG_SIZE 128
+#define APE_HEADER_SIZE 32                  // Size of the header and of the footer of APE tag
+
+
+/* Bit rates (in kbps) by [MPEG-1 or MPEG-2/2.5][layer - 1][bitrate index] */
+static const short bitrate_table[2][3][15] = {
+    {
+        { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+        { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384 },
+        { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320 },
+    },
+    {
+        { 0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256 },
+        { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160 },
+        { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160 },
+    },
+};
+
+/* Sample rates (in Hz) of MPEG-1 by sample rate index, divided by 2 for MPEG-2 and by 4 for MPEG-2.5 */
+static const int samplerate_table[3] = { 44100, 48000, 32000 };
+
+/* MPEG modes by the mode bits of the header */
+static const int mode_table[4] = { MODE_STEREO, MODE_JOINT_STEREO, MODE_DUAL_CHANNEL, MODE_SINGLE_CHANNEL };
+
+
+/**
+ * Parse the frame header at `data` (at least PYMP3_HEADER_SIZE bytes)
+ *
+ * \return  0 if the header is valid, -1 otherwise
+ */
+int pymp3_parse_header(const unsigned char *data, pymp3_header *header)
+{
+    /* 11 bits of frame sync */
+    if (data[0] != 0xff || (data[1] & 0xe0) != 0xe0)
+        return -1;
+
+    int version_bits = (data[1] >> 3) & 0x03;
+    int layer_bits = (data[1] >> 1) & 0x03;
+    int bitrate_index = (data[2] >> 4) & 0x0f;
+    int samplerate_index = (data[2] >> 2) & 0x03;
+    int emphasis = data[3] & 0x03;
+
+    /* Reserved values */
+    if (version_bits == 1 || layer_bits == 0 || bitrate_index == 15 || samplerate_index == 3 || emphasis == 2)
+        return -1;
+
+    int lsf = version_bits != 3;    // MPEG-2 or MPEG-2.5 (low sampling frequencies)
+
+    header->version = version_bits == 3 ? 10 : (version_bits == 2 ? 20 : 25);
+    header->layer = 4 - layer_bits;
+    header->protection = !(data[1] & 0x01);
+    header->bitrate = bitrate_table[lsf][header->layer - 1][bitrate_index];
+    header->samplerate = samplerate_table[samplerate_index] >> (version_bits == 3 ? 0 : (version_bits == 2 ? 1 : 2));
+    header->padding = (data[2] >> 1) & 0x01;
+    header->mode = mode_table[(data[3] >> 6) & 0x03];
+    header->channels = header->mode == MODE_SINGLE_CHANNEL ? 1 : 2;
+
+    if (header->layer == 1)
+        header->samples = 384;
+    else if (header->layer == 3 && lsf)
+        header->samples = 576;
+    else
+        header->samples = 1152;
+
+    if (header->bitrate == 0)
+        header->frame_size = 0;     // free format, the size is known from the distance to the next frame
+    else if (header->layer == 1)
+        header->frame_size = (12 * header->bitrate * 1000 / header->samplerate + header->padding) * 4;
+    else
+        header->frame_size = header->samples / 8 * header->bitrate * 1000 / header->samplerate + header->padding;
+
+    return 0;
+}
+
+/**
+ * Size of ID3v2 tag at `data` (at least 10 bytes)
+ *
+ * \return  The size of the tag including its header and footer, or 0 if there is no tag
+ */
+Py_ssize_t pymp3_id3v2_size(const unsigned char *data)
+{
+    if (data[0] != 'I' || data[1] != 'D' || data[2] != '3' || data[3] == 0xff || data[4] == 0xff)
+        return 0;
+
+    /* The size is a "syncsafe" integer, 7 bits per byte */
+    if ((data[6] | data[7] | data[8] | data[9]) & 0x80)
+        return 0;
+
+    Py_ssize_t size = ((Py_ssize_t) data[6] << 21) | ((Py_ssize_t) data[7] << 14) | ((Py_ssize_t) data[8] << 7) | data[9];
+    size += PYMP3_ID3V2_HEADER_SIZE;
+    if (data[5] & 0x10)
+        size += PYMP3_ID3V2_HEADER_SIZE;  // footer
+    return size;
+}
+
+/**
+ * Size of ID3v2, APE or ID3v1 tag at `data` (`size` bytes available).
+ * The size of APE tag read from its footer includes the items before the footer
+ *
+ * \return  The size of the tag, or 0 if there is no tag or not enough data to recognise it
+ */
+Py_ssize_t pymp3_tag_size(const unsigned char *data, Py_ssize_t size)
+{
+    if (size >= PYMP3_ID3V2_HEADER_SIZE && data[0] == 'I')
+        return pymp3_id3v2_size(data);
+
+    if (size >= APE_HEADER_SIZE && memcmp(data, "APETAGEX", 8) == 0)
+    {
+        /* Little endian size of the items and the footer, and flags: bit 29 is set in the header */
+        Py_ssize_t tag_size = (Py_ssize_t) data[12] | ((Py_ssize_t) data[13] << 8) | ((Py_ssize_t) data[14] << 16) | ((Py_ssize_t) data[15] << 24);
+        if (tag_size < APE_HEADER_SIZE)
+            return 0;
+        return (data[23] & 0x20) ? tag_size + APE_HEADER_SIZE : tag_size;
+    }
+
+    if (size >= 3 && data[0] == 'T' && data[1] == 'A' && data[2] == 'G')
+        return ID3V1_TAG_SIZE;
+
+    return 0;
+}
+
+/**
+ * Size of Layer III side information, which follows the header and CRC of the frame
+ */
+int pymp3_side_info_size(const pymp3_header *header)
+{
+    if (header->version == 10)
+        return header->channels == 1 ? 17 : 32;
+    else
+        return header->channels == 1 ? 9 : 17;
+}
+
+/**
+ * Layer III main_data_begin, i.e. how many bytes of the main data of the frame are stored in preceding frames (bit reservoir)
+ *
+ * \return  The number of bytes, 0 for Layer I and II
+ */
+int pymp3_main_data_begin(const unsigned char *frame, const pymp3_header *header)
+{
+    if (header->layer != 3)
+        return 0;
+
+    const unsigned char *side_info = frame + PYMP3_HEADER_SIZE + (header->protection ? 2 : 0);
+
+    /* 9 bits in MPEG-1, 8 bits in MPEG-2/2.5 */
+    if (header->version == 10)
+        return (side_info[0] << 1) | (side_info[1] >> 7);
+    else
+        return side_info[0];
+}
+
+/**
+ * Whether the first frame contains a Xing/Info or VBRI tag (the frame contains no audio)
+ */
+int pymp3_has_vbr_tag(const unsigned char *frame, Py_ssize_t size, const pymp3_header *header)
+{
+    if (header->layer != 3)
+        return 0;
+
+    /* The Xing tag follows the side information */
+    Py_ssize_t offset = PYMP3_HEADER_SIZE + (header->protection ? 2 : 0) + pymp3_side_info_size(header);
+
+    if (offset + 4 <= size && (memcmp(frame + offset, "Xing", 4) == 0 || memcmp(frame + offset, "Info", 4) == 0))
+        return 1;
+
+    /* The VBRI tag of Fraunhofer encoder is at the fixed position */
+    offset = PYMP3_HEADER_SIZE + 32;
+    if (offset + 4 <= size && memcmp(frame + offset, "VBRI", 4) == 0)
+        return 1;
+
+    return 0;
+}
+
+/**
+ * Search for `nframes` consecutive frames with consistent headers (the same version, layer and sample rate).
+ *
+ * \return  An offset of the first frame, or -1 if not found. `reason` is set to a description of the last failure.
+ */
+static Py_ssize_t find_frames(const unsigned char *data, Py_ssize_t size, int nframes, int eof,
+                              pymp3_header *first, const char **reason)
+{
+    *reason = "no MPEG audio frame sync found";
+
+    for (Py_ssize_t offset = 0; offset + PYMP3_HEADER_SIZE <= size; offset++)
+    {
+        /* Fast scan for the first byte of sync */
+        const unsigned char *sync = memchr(data + offset, 0xff, size - offset - PYMP3_HEADER_SIZE + 1);
+        if (sync == NULL)
+            break;
+        offset = sync - data;
+
+        if (pymp3_parse_header(data + offset, first) < 0)
+            continue;
+
+        if (first->frame_size == 0)
+        {
+            *reason = "free format bit rate is not supported";
+            continue;
+        }
+
+        /* Follow the chain of frames */
+        Py_ssize_t position = offset + first->frame_size;
+        int found = 1;
+        while (found < nframes && position + PYMP3_HEADER_SIZE <= size)
+        {
+            pymp3_header next;
+            if (pymp3_parse_header(data + position, &next) < 0 ||
+                next.version != first->version || next.layer != first->layer || next.samplerate != first->samplerate ||
+                next.frame_size == 0)
+            {
+                break;
+            }
+            found++;
+            position += next.frame_size;
+        }
+
+        if (found >= nframes)
+            return offset;
+
+        /* A short file may contain less frames than requested. A single frame is accepted only if it is the whole input */
+        if (eof && position + PYMP3_HEADER_SIZE > size && (found > 1 || (offset == 0 && position == size)))
+            return offset;
+
+        if (position + PYMP3_HEADER_SIZE <= size)
+            *reason = "inconsistent MPEG audio frame headers";
+        else if (eof)
+            *reason = "too few MPEG audio frames";
+        else
+            *reason = "not enough data to validate MPEG audio frames (increase max_bytes)";
+    }
+
+    return -1;
+}
+
+/**
+ * Read up to `size` bytes from a file-like object
+ *
+ * \return  A new reference to bytes, or NULL on error (Python exception is set)
+ */
+static PyObject* read_bytes(PyObject *fobject, Py_ssize_t size)
+{
+    PyObject *data = PyObject_CallMethod(fobject, "read", "n", size);
+    if (data != NULL && !PyBytes_Check(data))
+    {
+        Py_DECREF(data);
+        PyErr_SetString(PyExc_TypeError, "read() method of file-like object must return bytes (Is it opened in binary mode?)");
+        return NULL;
+    }
+    return data;
+}
+
+/**
+ * Validate MPEG audio stream by frame headers only, without decoding:
+ * mp3.probe(source, max_bytes=65536, frames=4)
+ */
+PyObject* pymp3_probe(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"source", "max_bytes", "frames", NULL};
+
+    PyObject *source = NULL;
+    Py_ssize_t max_bytes = PROBE_DEFAULT_MAX_BYTES;
+    int nframes = PROBE_DEFAULT_FRAMES;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|ni:probe", kwlist, &source, &max_bytes, &nframes))
+    {
+        return NULL;
+    }
+
+    if (max_bytes < PYMP3_ID3V2_HEADER_SIZE || nframes < 1)
+    {
+        PyErr_SetString(PyExc_ValueError, "max_bytes must be at least 10 and frames must be positive");
+        return NULL;
+    }
+
+    /* The source is either a bytes-like object, or a file-like object, which is read once (twice if ID3v2 tag is skipped) */
+    Py_buffer view;
+    PyObject *data = NULL;
+    const unsigned char *buffer;
+    Py_ssize_t size;
+    int eof;
+    Py_ssize_t base = 0;       // offset of the buffer in the source
+
+    int is_buffer = PyObject_CheckBuffer(source);
+    if (is_buffer)
+    {
+        if (PyObject_GetBuffer(source, &view, PyBUF_SIMPLE) < 0)
+            return NULL;
+        buffer = view.buf;
+        size = view.len < max_bytes ? view.len : max_bytes;
+        eof = view.len <= max_bytes;
+    }
+    else
+    {
+        data = read_bytes(source, max_bytes);
+        if (data == NULL)
+            return NULL;
+        buffer = (const unsigned char *) PyBytes_AS_STRING(data);
+        size = PyBytes_GET_SIZE(data);
+        eof = size < max_bytes;
+    }
+
+    PyObject *result = NULL;
+    const char *reason = NULL;
+    Py_ssize_t offset = 0;
+
+    if (size == 0)
+    {
+        reason = "empty input";
+        goto done;
+    }
+
+    /* Skip ID3v2 tag, which may be large (album art) */
+    Py_ssize_t id3_size = size >= PYMP3_ID3V2_HEADER_SIZE ? pymp3_id3v2_size(buffer) : 0;
+    if (id3_size > 0)
+    {
+        if (id3_size + PYMP3_HEADER_SIZE <= size)
+        {
+            offset = id3_size;
+        }
+        else if (is_buffer)
+        {
+            if (id3_size < view.len)
+            {
+                /* The whole input is in memory, probe the data after the tag */
+                base = id3_size;
+                buffer = (const unsigned char *) view.buf + id3_size;
+                size = view.len - id3_size < max_bytes ? view.len - id3_size : max_bytes;
+                eof = view.len - id3_size <= max_bytes;
+            }
+            else
+            {
+                reason = "no MPEG audio frames after ID3v2 tag";
+                goto done;
+            }
+        }
+        else
+        {
+            /* Skip the rest of the tag with seek(), and read the data after it */
+            PyObject *o_seek = PyObject_CallMethod(source, "seek", "ni", id3_size - size, 1);
+            if (o_seek == NULL)
+            {
+                PyErr_Clear();
+                reason = "ID3v2 tag is larger than max_bytes";
+                goto done;
+            }
+            Py_DECREF(o_seek);
+
+            Py_SETREF(data, read_bytes(source, max_bytes));
+            if (data == NULL)
+                goto done;
+            base = id3_size;
+            buffer = (const unsigned char *) PyBytes_AS_STRING(data);
+            size = PyBytes_GET_SIZE(data);
+            eof = size < max_bytes;
+        }
+    }
+
+    pymp3_header header;
+    Py_ssize_t found = find_frames(buffer + offset, size - offset, nframes, eof, &header, &reason);
+    if (found < 0)
+        goto done;
+
+    offset += found;
+    result = Py_BuildValue("{s:O,s:d,s:i,s:i,s:i,s:i,s:i,s:i,s:n,s:n,s:O}",
+        "valid", Py_True,
+        "version", header.version / 10.0,
+        "layer", header.layer,
+        "bit_rate", header.bitrate,
+        "sample_rate", header.samplerate,
+        "channels", header.channels,
+        "mode", header.mode,
+        "samples_per_frame", header.samples,
+        "offset", base + offset,
+        "id3v2_size", id3_size,
+        "vbr_tag", pymp3_has_vbr_tag(buffer + offset, size - offset, &header) ? Py_True : Py_False);
+
+done:
+    if (result == NULL && !PyErr_Occurred())
+        result = Py_BuildValue("{s:O,s:s}", "valid", Py_False, "reason", reason);
+
+    Py_XDECREF(data);
+    if (is_buffer)
+        PyBuffer_Release(&view);
+    return result;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+
+/* Size of MPEG audio frame header */
+#define PYMP3_HEADER_SIZE 4
+
+/* Size of ID3v2 tag header (and footer) */
+#define PYMP3_ID3V2_HEADER_SIZE 10
+
+/* Number of bytes, which are enough to recognise a tag by pymp3_tag_size() */
+#define PYMP3_TAG_HEADER_SIZE 32
+
+/* MPEG audio frame header */
+typedef struct {
+    int version;            /* 10 for MPEG-1, 20 for MPEG-2, 25 for MPEG-2.5 */
+    int layer;              /* 1, 2 or 3 */
+    int protection;         /* CRC follows the header */
+    int bitrate;            /* in kbps, 0 for free format */
+    int samplerate;         /* in Hz */
+    int padding;
+    int mode;               /* MODE_STEREO, MODE_JOINT_STEREO, MODE_DUAL_CHANNEL or MODE_SINGLE_CHANNEL */
+    int channels;
+    int samples;            /* samples per channel in the frame */
+    int frame_size;         /* size of the frame in bytes (including the header), 0 for free format */
+} pymp3_header;
+
+/* Parse the frame header at `data` (at least PYMP3_HEADER_SIZE bytes). Returns 0 if the header is valid, -1 otherwise */
+int pymp3_parse_header(const unsigned char *data, pymp3_header *header);
+
+/* Size of ID3v2 tag at `data` (at least 10 bytes) including its header and footer, or 0 if there is no tag */
+Py_ssize_t pymp3_id3v2_size(const unsigned char *data);
+
+/* Size of ID3v2, APE or ID3v1 tag at `data` (`size` bytes available), or 0 if there is no tag */
+Py_ssize_t pymp3_tag_size(const unsigned char *data, Py_ssize_t size);
+
+/* Size of Layer III side information following the header (and CRC) of the frame */
+int pymp3_side_info_size(const pymp3_header *header);
+
+/* Layer III main_data_begin: number of bytes of the frame's main data stored in preceding frames (bit reservoir), 0 for Layer I/II */
+int pymp3_main_data_begin(const unsigned char *frame, const pymp3_header *header);
+
+/* Whether the frame (`size` bytes available) contains a Xing/Info or VBRI tag instead of audio */
+int pymp3_has_vbr_tag(const unsigned char *frame, Py_ssize_t size, const pymp3_header *header);
@@ -0,0 +1,50 @@
+#include "mp3_alloc.h"
+#include "mp3_minimp3.h"
+
+#define MINIMP3_IMPLEMENTATION
+#include <minimp3.h>
+
+
+struct pymp3_minimp3 {
+    mp3dec_t dec;
+};
+
+
+pymp3_minimp3* pymp3_minimp3_new(void)
+{
+    pymp3_minimp3 *decoder = pymp3_mem_malloc(sizeof(pymp3_minimp3));
+    if (decoder != NULL)
+        mp3dec_init(&decoder->dec);
+    return decoder;
+}
+
+void pymp3_minimp3_free(pymp3_minimp3 *decoder)
+{
+    pymp3_mem_free(decoder);
+}
+
+size_t pymp3_minimp3_size(void)
+{
+    return sizeof(pymp3_minimp3);
+}
+
+void pymp3_minimp3_reset(pymp3_minimp3 *decoder)
+{
+    mp3dec_init(&decoder->dec);
+}
+
+int pymp3_minimp3_decode(pymp3_minimp3 *decoder, const unsigned char *data, size_t size, int16_t *pcm, pymp3_minimp3_info *info)
+{
+    mp3dec_frame_info_t frame_info;
+
+    int samples = mp3dec_decode_frame(&decoder->dec, data, (int) size, pcm, &frame_info);
+
+    info->frame_bytes = frame_info.frame_bytes;
+    info->frame_offset = frame_info.frame_offset;
+    info->channels = samples > 0 ? frame_info.channels : 0;
+    info->samplerate = frame_info.hz;
+    info->layer = frame_info.layer;
+    info->bitrate = frame_info.bitrate_kbps;
+
+    return samples;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Floating-point decoder backend (minimp3, SIMD synthesis on SSE2/NEON), built with -DPYMP3_WITH_MINIMP3 */
+
+/* Maximum number of samples (of all channels) in one decoded frame */
+#define PYMP3_MINIMP3_MAX_SAMPLES (1152*2)
+
+/* Minimum amount of input data for reliable frame sync (several frames at the highest bit rate) */
+#define PYMP3_MINIMP3_INPUT_SIZE (16*1024)
+
+typedef struct pymp3_minimp3 pymp3_minimp3;
+
+/* Decoded frame */
+typedef struct {
+    int frame_bytes;        /* number of consumed bytes, including data skipped before the frame */
+    int frame_offset;       /* offset of the frame header in the input data */
+    int channels;           /* 0 if no frame is decoded */
+    int samplerate;         /* in Hz */
+    int layer;
+    int bitrate;            /* in kbps */
+} pymp3_minimp3_info;
+
+/* Allocate a decoder, returns NULL if memory is not available */
+pymp3_minimp3* pymp3_minimp3_new(void);
+
+/* Free the decoder */
+void pymp3_minimp3_free(pymp3_minimp3 *decoder);
+
+/* Size of the memory allocated for a decoder */
+size_t pymp3_minimp3_size(void);
+
+/* Reset the decoder state (bit reservoir, synthesis filter) to decode another stream */
+void pymp3_minimp3_reset(pymp3_minimp3 *decoder);
+
+/**
+ * Decode the first frame in `data` into 16-bit interleaved samples.
+ * Returns the number of samples per channel (0 if data before the frame is skipped, or more data is needed when info->frame_bytes is 0)
+ */
+int pymp3_minimp3_decode(pymp3_minimp3 *decoder, const unsigned char *data, size_t size, int16_t *pcm, pymp3_minimp3_info *info);
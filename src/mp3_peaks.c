@@ -0,0 +1,260 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <math.h>
+#include <mad.h>
+
+#include "py_module.h"
+#include "mp3_alloc.h"
+#include "mp3_source.h"
+#include "pcm_convert.h"
+
+#define PEAKS_READ_SIZE (64*1024)           // Size of blocks read from the source
+#define PEAKS_DEFAULT_SAMPLES_PER_POINT 256
+#define PEAKS_VALUES_PER_POINT 3            // min, max, RMS
+
+
+/* State of the waveform summary: libmad decoder, and the point being accumulated */
+typedef struct {
+    pymp3_source source;
+
+    struct mad_stream stream;
+    struct mad_frame frame;
+    struct mad_synth synth;
+    unsigned char *input_buffer;
+    unsigned long long frames;
+
+    /* Samples (per channel) of one point, and the summary of the samples of the current point so far */
+    unsigned int samples_per_point;
+    unsigned int point_samples;
+    mad_fixed_t point_min;
+    mad_fixed_t point_max;
+    double point_energy;
+    unsigned int point_values;
+
+    /* Points as int16 triplets of (min, max, RMS) */
+    int16_t *points;
+    size_t points_size;
+    size_t points_end;
+
+    /* Error detected while the GIL is released, the exception is raised after the GIL is acquired */
+    PyObject *error_type;
+    const char *error_message;
+
+    pymp3_stats decoder_stats;
+} peaks_state;
+
+
+/* The fixed point sample as a 16-bit PCM value (truncated and clipped) */
+static int16_t peaks_to_int16(mad_fixed_t sample)
+{
+    sample = sample < -MAD_F_ONE ? -MAD_F_ONE : sample;
+    sample = sample > MAD_F_ONE - 1 ? MAD_F_ONE - 1 : sample;
+    return (int16_t) (sample >> (MAD_F_FRACBITS + 1 - 16));
+}
+
+/**
+ * Append the summary of the current point to the output, and start a new point (called without the GIL)
+ *
+ * \return  0 on success, -1 on error (p->error_* is set)
+ */
+static int peaks_emit_point(peaks_state *p)
+{
+    if (p->points_end + PEAKS_VALUES_PER_POINT > p->points_size)
+    {
+        size_t new_size = p->points_size * 2;
+        int16_t *new_points = pymp3_mem_realloc(p->points, new_size * sizeof(int16_t));
+        if (new_points == NULL)
+        {
+            p->error_type = PyExc_MemoryError;
+            p->error_message = "Could not allocate memory for the peaks";
+            return -1;
+        }
+        p->points = new_points;
+        p->points_size = new_size;
+    }
+
+    double rms = sqrt(p->point_energy / p->point_values) * 32768.0;
+
+    p->points[p->points_end++] = peaks_to_int16(p->point_min);
+    p->points[p->points_end++] = peaks_to_int16(p->point_max);
+    p->points[p->points_end++] = (int16_t) (rms < 32767.0 ? rms : 32767.0);
+
+    p->point_samples = 0;
+    p->point_min = MAD_F_MAX;
+    p->point_max = MAD_F_MIN;
+    p->point_energy = 0.0;
+    p->point_values = 0;
+    return 0;
+}
+
+/**
+ * Decode all frames of the input buffer and reduce their samples to points (called without the GIL)
+ *
+ * \return  0 when more input is needed, -1 on error (p->error_* is set)
+ */
+static int peaks_process_input(peaks_state *p)
+{
+    while (1)
+    {
+        if (mad_frame_decode(&p->frame, &p->stream))
+        {
+            if (MAD_RECOVERABLE(p->stream.error))
+            {
+                p->decoder_stats.sync_errors++;
+                continue;
+            }
+
+            if (p->stream.error == MAD_ERROR_BUFLEN)
+                return 0;
+
+            p->error_type = PyExc_RuntimeError;
+            p->error_message = "Unrecoverable mpeg frame level error";
+            return -1;
+        }
+
+        mad_synth_frame(&p->synth, &p->frame);
+
+        /* The samples are reduced in the fixed point format, i.e. without PCM conversion */
+        struct mad_pcm *pcm = &p->synth.pcm;
+        unsigned int position = 0;
+
+        while (position < pcm->length)
+        {
+            unsigned int nsamples = p->samples_per_point - p->point_samples;
+            if (nsamples > pcm->length - position)
+                nsamples = pcm->length - position;
+
+            for (unsigned int ch = 0; ch < pcm->channels; ch++)
+                pymp3_fixed_summary(pcm->samples[ch] + position, nsamples, &p->point_min, &p->point_max, &p->point_energy);
+
+            p->point_samples += nsamples;
+            p->point_values += nsamples * pcm->channels;
+            position += nsamples;
+
+            if (p->point_samples == p->samples_per_point && peaks_emit_point(p) < 0)
+                return -1;
+        }
+
+        p->frames++;
+        p->decoder_stats.frames++;
+    }
+}
+
+/**
+ * Summarize the whole source
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int peaks_run(peaks_state *p)
+{
+    int result;
+
+    while (1)
+    {
+        result = pymp3_source_fill_stream(&p->source, &p->stream, p->input_buffer, PEAKS_READ_SIZE, &p->decoder_stats);
+        if (result < 0)
+            return -1;
+        if (result == 0)
+            break;
+
+        Py_BEGIN_ALLOW_THREADS
+        result = peaks_process_input(p);
+        Py_END_ALLOW_THREADS
+
+        if (result < 0)
+        {
+            PyErr_SetString(p->error_type, p->error_message);
+            return -1;
+        }
+    }
+
+    if (p->frames == 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "No MPEG audio frames found in the source");
+        return -1;
+    }
+
+    /* The last point covers the rest of the samples */
+    if (p->point_samples > 0 && peaks_emit_point(p) < 0)
+    {
+        PyErr_SetString(p->error_type, p->error_message);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * mp3.peaks(source, samples_per_point=256)
+ *
+ * Decode MP3 data and summarize each `samples_per_point` samples (per channel) of all channels as (min, max, RMS).
+ * Returns bytes of 16-bit signed triplets, so the memory used doesn't depend on the length of the source beyond the result.
+ */
+PyObject* pymp3_peaks(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"source", "samples_per_point", NULL};
+
+    PyObject *source = NULL;
+    int samples_per_point = PEAKS_DEFAULT_SAMPLES_PER_POINT;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i:peaks", kwlist, &source, &samples_per_point))
+        return NULL;
+
+    if (samples_per_point <= 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "samples_per_point must be positive");
+        return NULL;
+    }
+
+    peaks_state *p = pymp3_mem_calloc(1, sizeof(peaks_state));
+    if (p == NULL)
+        return PyErr_NoMemory();
+
+    p->samples_per_point = samples_per_point;
+    p->point_min = MAD_F_MAX;
+    p->point_max = MAD_F_MIN;
+
+    mad_stream_init(&p->stream);
+    mad_frame_init(&p->frame);
+    mad_synth_init(&p->synth);
+
+    PyObject *result = NULL;
+
+    if (pymp3_source_open(&p->source, source, "source") < 0)
+        goto done;
+
+    p->input_buffer = pymp3_mem_malloc(PEAKS_READ_SIZE + MAD_BUFFER_GUARD);
+    p->points_size = 1024 * PEAKS_VALUES_PER_POINT;
+    p->points = pymp3_mem_malloc(p->points_size * sizeof(int16_t));
+    if (p->input_buffer == NULL || p->points == NULL)
+    {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    if (peaks_run(p) < 0)
+        goto done;
+
+    result = PyBytes_FromStringAndSize((const char *) p->points, p->points_end * sizeof(int16_t));
+
+done:
+    {
+        pymp3_state *state = (pymp3_state *) PyModule_GetState(module);
+        pymp3_stats published;
+
+        memset(&published, 0, sizeof(published));
+        pymp3_stats_publish(state, PYMP3_STATS_DECODER, &p->decoder_stats, &published);
+    }
+
+    mad_synth_finish(&p->synth);
+    mad_frame_finish(&p->frame);
+    mad_stream_finish(&p->stream);
+
+    pymp3_source_close(&p->source);
+
+    pymp3_mem_free(p->input_buffer);
+    pymp3_mem_free(p->points);
+    pymp3_mem_free(p);
+
+    return result;
+}
@@ -0,0 +1,339 @@
+#include "mp3_readahead.h"
+#include "mp3_alloc.h"
+#include "mp3_stats.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+struct pymp3_readahead {
+#ifdef _WIN32
+    HANDLE file;                    /* Separate handle of the file (ReOpenFile()) with its own file pointer, owned by the read-ahead */
+#else
+    int fd;                         /* Duplicate of the file descriptor, owned by the read-ahead */
+#endif
+    long long offset;               /* Offset of the next read of the thread */
+    int depth;
+    unsigned char *chunks;          /* `depth` chunks of PYMP3_READAHEAD_CHUNK_SIZE bytes */
+    size_t *lengths;                /* Number of bytes read into each chunk */
+
+    /* Filled chunks are `count` chunks from `tail`, the thread reads into `head`. The chunk at `tail` is owned by the consumer */
+    int head;
+    int tail;
+    int count;
+    size_t position;                /* Position of the consumer in the chunk at `tail` */
+
+    int eof;
+    int error;                      /* errno of a failed read */
+    int stop;
+
+#ifdef _WIN32
+    CRITICAL_SECTION mutex;
+    CONDITION_VARIABLE filled;      /* Signaled by the thread when a chunk is filled, at EOF or on error */
+    CONDITION_VARIABLE consumed;    /* Signaled by the consumer when a chunk is consumed, and on stop */
+    HANDLE thread;
+#else
+    pthread_mutex_t mutex;
+    pthread_cond_t filled;
+    pthread_cond_t consumed;
+    pthread_t thread;
+#endif
+};
+
+
+#ifdef _WIN32
+#define RA_LOCK(ra) EnterCriticalSection(&(ra)->mutex)
+#define RA_UNLOCK(ra) LeaveCriticalSection(&(ra)->mutex)
+#define RA_WAIT(ra, cond) SleepConditionVariableCS(&(ra)->cond, &(ra)->mutex, INFINITE)
+#define RA_SIGNAL(ra, cond) WakeConditionVariable(&(ra)->cond)
+#else
+#define RA_LOCK(ra) pthread_mutex_lock(&(ra)->mutex)
+#define RA_UNLOCK(ra) pthread_mutex_unlock(&(ra)->mutex)
+#define RA_WAIT(ra, cond) pthread_cond_wait(&(ra)->cond, &(ra)->mutex)
+#define RA_SIGNAL(ra, cond) pthread_cond_signal(&(ra)->cond)
+#endif
+
+
+/**
+ * Read up to `size` bytes at `offset` of the file. pread() doesn't change the position of the file descriptor.
+ * On Windows, ReadFile() at an offset moves the file pointer of the handle, so the handle of the read-ahead is not
+ * shared with the file object (see pymp3_readahead_start())
+ *
+ * \return  A number of bytes read, 0 at the end of the file, -1 on error (errno is set)
+ */
+static ptrdiff_t readahead_pread(pymp3_readahead *ra, unsigned char *buffer, size_t size, long long offset)
+{
+#ifdef _WIN32
+    OVERLAPPED overlapped;
+    DWORD nread;
+
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset = (DWORD) offset;
+    overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+    if (!ReadFile(ra->file, buffer, (DWORD) size, &nread, &overlapped))
+    {
+        if (GetLastError() == ERROR_HANDLE_EOF)
+            return 0;
+        errno = EIO;
+        return -1;
+    }
+    return (ptrdiff_t) nread;
+#else
+    ssize_t nread;
+    do
+    {
+        nread = pread(ra->fd, buffer, size, (off_t) offset);
+    } while (nread < 0 && errno == EINTR);
+    return (ptrdiff_t) nread;
+#endif
+}
+
+/**
+ * The thread: fill free chunks of the ring until the end of the file, an error or stop
+ */
+static void readahead_run(pymp3_readahead *ra)
+{
+    RA_LOCK(ra);
+    while (!ra->stop)
+    {
+        if (ra->count == ra->depth)
+        {
+            RA_WAIT(ra, consumed);
+            continue;
+        }
+
+        /* The chunk at `head` is free, it is filled without the lock */
+        int slot = ra->head;
+        long long offset = ra->offset;
+        RA_UNLOCK(ra);
+
+        ptrdiff_t nread = readahead_pread(ra, ra->chunks + (size_t) slot * PYMP3_READAHEAD_CHUNK_SIZE, PYMP3_READAHEAD_CHUNK_SIZE, offset);
+        int error = errno;
+
+        RA_LOCK(ra);
+        if (nread <= 0)
+        {
+            ra->eof = nread == 0;
+            ra->error = nread < 0 ? error : 0;
+            RA_SIGNAL(ra, filled);
+            break;
+        }
+
+        ra->lengths[slot] = (size_t) nread;
+        ra->offset += nread;
+        ra->head = (ra->head + 1) % ra->depth;
+        ra->count++;
+        RA_SIGNAL(ra, filled);
+    }
+    RA_UNLOCK(ra);
+}
+
+#ifdef _WIN32
+static unsigned __stdcall readahead_thread(void *arg)
+{
+    readahead_run((pymp3_readahead *) arg);
+    return 0;
+}
+#else
+static void* readahead_thread(void *arg)
+{
+    readahead_run((pymp3_readahead *) arg);
+    return NULL;
+}
+#endif
+
+/**
+ * Destroy the synchronization objects, close the file descriptor and free the ring. The thread must not be running
+ */
+static void readahead_free(pymp3_readahead *ra)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(&ra->mutex);
+    CloseHandle(ra->file);
+#else
+    pthread_cond_destroy(&ra->filled);
+    pthread_cond_destroy(&ra->consumed);
+    pthread_mutex_destroy(&ra->mutex);
+    close(ra->fd);
+#endif
+
+    pymp3_mem_free(ra->chunks);
+    pymp3_mem_free(ra->lengths);
+    pymp3_mem_free(ra);
+}
+
+/**
+ * Start reading the file `fd` from `offset` with `depth` chunks. The file descriptor is duplicated (on Windows,
+ * the file is reopened with a separate file pointer), so the file can be closed by its owner while the read-ahead is running
+ *
+ * \return  The read-ahead, or NULL on error (errno is set)
+ */
+pymp3_readahead* pymp3_readahead_start(int fd, long long offset, int depth)
+{
+    if (depth <= 0 || (size_t) depth > SIZE_MAX / PYMP3_READAHEAD_CHUNK_SIZE)
+    {
+        errno = depth <= 0 ? EINVAL : ENOMEM;
+        return NULL;
+    }
+
+    pymp3_readahead *ra = pymp3_mem_calloc(1, sizeof(pymp3_readahead));
+    if (ra == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ra->offset = offset;
+    ra->depth = depth;
+    ra->chunks = pymp3_mem_malloc((size_t) depth * PYMP3_READAHEAD_CHUNK_SIZE);
+    ra->lengths = pymp3_mem_calloc(depth, sizeof(size_t));
+#ifdef _WIN32
+    /* A duplicate of the CRT descriptor would share the file pointer moved by ReadFile() */
+    HANDLE handle = (HANDLE) _get_osfhandle(fd);
+    ra->file = handle == INVALID_HANDLE_VALUE ? INVALID_HANDLE_VALUE :
+               ReOpenFile(handle, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0);
+    int opened = ra->file != INVALID_HANDLE_VALUE;
+    int open_error = EBADF;
+#else
+    ra->fd = dup(fd);
+    int opened = ra->fd >= 0;
+    int open_error = errno;
+#endif
+
+    if (ra->chunks == NULL || ra->lengths == NULL || !opened)
+    {
+        int error = !opened ? open_error : ENOMEM;
+        if (opened)
+#ifdef _WIN32
+            CloseHandle(ra->file);
+#else
+            close(ra->fd);
+#endif
+        pymp3_mem_free(ra->chunks);
+        pymp3_mem_free(ra->lengths);
+        pymp3_mem_free(ra);
+        errno = error;
+        return NULL;
+    }
+
+#ifdef _WIN32
+    InitializeCriticalSection(&ra->mutex);
+    InitializeConditionVariable(&ra->filled);
+    InitializeConditionVariable(&ra->consumed);
+    ra->thread = (HANDLE) _beginthreadex(NULL, 0, &readahead_thread, ra, 0, NULL);
+    int started = ra->thread != 0;
+#else
+    pthread_mutex_init(&ra->mutex, NULL);
+    pthread_cond_init(&ra->filled, NULL);
+    pthread_cond_init(&ra->consumed, NULL);
+    int started = pthread_create(&ra->thread, NULL, &readahead_thread, ra) == 0;
+#endif
+
+    if (!started)
+    {
+        /* No thread to stop or join, free the resources only */
+        readahead_free(ra);
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    return ra;
+}
+
+/**
+ * Copy up to `size` bytes of the next data into `buffer`, waiting for the thread if `wait` is set
+ *
+ * \return  A number of bytes, 0 at the end of the file, -1 on error (errno is set), or PYMP3_READAHEAD_WAIT
+ */
+ptrdiff_t pymp3_readahead_read(pymp3_readahead *ra, unsigned char *buffer, size_t size, int wait, unsigned long long *stall_ns)
+{
+    RA_LOCK(ra);
+    if (ra->count == 0 && !ra->eof && !ra->error)
+    {
+        if (!wait)
+        {
+            RA_UNLOCK(ra);
+            return PYMP3_READAHEAD_WAIT;
+        }
+
+        unsigned long long started = pymp3_clock_ns();
+        while (ra->count == 0 && !ra->eof && !ra->error)
+            RA_WAIT(ra, filled);
+        *stall_ns += pymp3_clock_ns() - started;
+    }
+
+    if (ra->count == 0)
+    {
+        /* The chunks read before an error are consumed first */
+        int error = ra->error;
+        RA_UNLOCK(ra);
+        if (error == 0)
+            return 0;
+        errno = error;
+        return -1;
+    }
+    RA_UNLOCK(ra);
+
+    /* The chunk at `tail` is not touched by the thread until it is released */
+    size_t length = ra->lengths[ra->tail];
+    size_t n = length - ra->position;
+    if (n > size)
+        n = size;
+
+    memcpy(buffer, ra->chunks + (size_t) ra->tail * PYMP3_READAHEAD_CHUNK_SIZE + ra->position, n);
+    ra->position += n;
+
+    if (ra->position == length)
+    {
+        RA_LOCK(ra);
+        ra->tail = (ra->tail + 1) % ra->depth;
+        ra->count--;
+        ra->position = 0;
+        RA_SIGNAL(ra, consumed);
+        RA_UNLOCK(ra);
+    }
+
+    return (ptrdiff_t) n;
+}
+
+/**
+ * Size of the memory allocated for the ring
+ */
+size_t pymp3_readahead_memory(const pymp3_readahead *ra)
+{
+    return (size_t) ra->depth * (PYMP3_READAHEAD_CHUNK_SIZE + sizeof(size_t)) + sizeof(pymp3_readahead);
+}
+
+/**
+ * Stop the thread, close the file descriptor and free the ring
+ */
+void pymp3_readahead_stop(pymp3_readahead *ra)
+{
+    if (ra == NULL)
+        return;
+
+    RA_LOCK(ra);
+    ra->stop = 1;
+    RA_SIGNAL(ra, consumed);
+    RA_UNLOCK(ra);
+
+#ifdef _WIN32
+    WaitForSingleObject(ra->thread, INFINITE);
+    CloseHandle(ra->thread);
+#else
+    pthread_join(ra->thread, NULL);
+#endif
+
+    readahead_free(ra);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Read-ahead of a file by a background native thread: a ring of `depth` chunks is kept filled
+ * with positional reads (pread()) of a duplicate of the file descriptor (on Windows, of a reopened handle of the file
+ * with its own file pointer), so the decoder takes input data
+ * from memory while the next chunks are being read. The thread doesn't call Python code nor take the GIL.
+ */
+
+/* Size of the chunks of the ring */
+#define PYMP3_READAHEAD_CHUNK_SIZE (64*1024)
+
+/* pymp3_readahead_read() would wait for the thread */
+#define PYMP3_READAHEAD_WAIT (-2)
+
+typedef struct pymp3_readahead pymp3_readahead;
+
+/* Start reading the file `fd` from `offset` with `depth` chunks, return NULL on error (errno is set) */
+pymp3_readahead* pymp3_readahead_start(int fd, long long offset, int depth);
+
+/**
+ * Copy up to `size` bytes of the next data into `buffer`.
+ * If no data is read yet, waits for the thread when `wait` is set (adding the time waited to `stall_ns`),
+ * otherwise returns PYMP3_READAHEAD_WAIT. Returns the number of bytes, 0 at the end of the file, -1 on error (errno is set)
+ */
+ptrdiff_t pymp3_readahead_read(pymp3_readahead *ra, unsigned char *buffer, size_t size, int wait, unsigned long long *stall_ns);
+
+/* Size of the memory allocated for the ring */
+size_t pymp3_readahead_memory(const pymp3_readahead *ra);
+
+/* Stop the thread, close the file descriptor and free the ring (waits for the pending read) */
+void pymp3_readahead_stop(pymp3_readahead *ra);
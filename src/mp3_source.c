@@ -0,0 +1,142 @@
+#include "mp3_source.h"
+
+
+/* Whether the object has callable attribute `method` */
+static int source_has_method(PyObject *object, const char *method)
+{
+    PyObject *attr = PyObject_GetAttrString(object, method);
+    int callable = attr != NULL && PyCallable_Check(attr);
+    Py_XDECREF(attr);
+    return callable;
+}
+
+/**
+ * Make sure the object has callable attribute `method`
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+int pymp3_check_method(PyObject *object, const char *method, const char *argument)
+{
+    if (!source_has_method(object, method))
+    {
+        PyErr_Format(PyExc_TypeError, "%s must be a file-like object with %s method", argument, method);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Open a bytes-like object (its view is held until pymp3_source_close()), or a file-like object with read() method
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+int pymp3_source_open(pymp3_source *source, PyObject *object, const char *argument)
+{
+    memset(source, 0, sizeof(pymp3_source));
+    source->object = object;
+
+    if (PyObject_CheckBuffer(object))
+    {
+        if (PyObject_GetBuffer(object, &source->view, PyBUF_SIMPLE) < 0)
+            return -1;
+        source->is_buffer = 1;
+    }
+    else if (!source_has_method(object, "read"))
+    {
+        PyErr_Format(PyExc_TypeError, "%s must be a bytes-like object or a file-like object with read method", argument);
+        return -1;
+    }
+
+    return 0;
+}
+
+void pymp3_source_close(pymp3_source *source)
+{
+    if (source->is_buffer)
+        PyBuffer_Release(&source->view);
+    source->is_buffer = 0;
+}
+
+/**
+ * Read up to `size` bytes of the source into `buffer`. At the end of the source `eof` is set
+ *
+ * \return  A number of bytes read, 0 at the end of the source, -1 on error (Python exception is set)
+ */
+Py_ssize_t pymp3_source_read(pymp3_source *source, unsigned char *buffer, size_t size, pymp3_stats *stats)
+{
+    Py_ssize_t readsize;
+
+    if (source->is_buffer)
+    {
+        readsize = source->view.len - source->view_offset;
+        if (readsize > (Py_ssize_t) size)
+            readsize = size;
+        memcpy(buffer, (const char *) source->view.buf + source->view_offset, readsize);
+        source->view_offset += readsize;
+    }
+    else
+    {
+        char *data;
+        PyObject *o_read = PyObject_CallMethod(source->object, "read", "n", (Py_ssize_t) size);
+        if (stats != NULL)
+            stats->io_calls++;
+        if (o_read == NULL)
+            return -1;
+
+        if (PyBytes_AsStringAndSize(o_read, &data, &readsize) < 0)
+        {
+            Py_DECREF(o_read);
+            PyErr_SetString(PyExc_RuntimeError, "Failure in reading bytes from file-like object (Is it opened in binary mode?)");
+            return -1;
+        }
+
+        if (readsize > (Py_ssize_t) size)
+            readsize = size;
+        memcpy(buffer, data, readsize);
+        Py_DECREF(o_read);
+    }
+
+    if (stats != NULL)
+        stats->bytes_in += readsize;
+    if (readsize == 0)
+        source->eof = 1;
+
+    return readsize;
+}
+
+/**
+ * Read the next block of the source into the input buffer of libmad, keeping the incomplete frame.
+ * At the end of the source, MAD_BUFFER_GUARD zero bytes are appended, so libmad decodes the last frame.
+ *
+ * \return  1 if new data is available, 0 at the end of the source, -1 on error (Python exception is set)
+ */
+int pymp3_source_fill_stream(pymp3_source *source, struct mad_stream *stream, unsigned char *buffer, size_t size, pymp3_stats *stats)
+{
+    size_t remaining = 0;
+
+    if (source->eof)
+        return 0;
+
+    if (stream->buffer != NULL && stream->next_frame != NULL)
+    {
+        remaining = stream->bufend - stream->next_frame;
+        memmove(buffer, stream->next_frame, remaining);
+    }
+
+    Py_ssize_t readsize = pymp3_source_read(source, buffer + remaining, size - remaining, stats);
+    if (readsize < 0)
+        return -1;
+
+    size_t length = remaining + readsize;
+    if (readsize == 0)
+    {
+        memset(buffer + length, 0, MAD_BUFFER_GUARD);
+        length += MAD_BUFFER_GUARD;
+    }
+
+    mad_stream_buffer(stream, buffer, length);
+    stream->error = MAD_ERROR_NONE;
+
+    return 1;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <mad.h>
+
+#include "mp3_stats.h"
+
+
+/* Source of MPEG data of the module functions: a bytes-like object (view), or a file-like object with read() method */
+typedef struct {
+    PyObject *object;
+    Py_buffer view;
+    int is_buffer;
+    Py_ssize_t view_offset;
+    int eof;
+} pymp3_source;
+
+/* Make sure the object has callable attribute `method`, `argument` names the object in the error message. Returns 0 on success, -1 on error */
+int pymp3_check_method(PyObject *object, const char *method, const char *argument);
+
+/* Open a bytes-like or file-like object for reading. Returns 0 on success, -1 on error (Python exception is set) */
+int pymp3_source_open(pymp3_source *source, PyObject *object, const char *argument);
+
+/* Release the view of a bytes-like object */
+void pymp3_source_close(pymp3_source *source);
+
+/* Read up to `size` bytes into `buffer`, counting read() calls and bytes in `stats` (can be NULL). Returns a number of bytes, 0 at the end, -1 on error */
+Py_ssize_t pymp3_source_read(pymp3_source *source, unsigned char *buffer, size_t size, pymp3_stats *stats);
+
+/* Refill the input buffer of libmad (`size` bytes plus MAD_BUFFER_GUARD) keeping the incomplete frame. Returns 1 if new data is available, 0 at the end, -1 on error */
+int pymp3_source_fill_stream(pymp3_source *source, struct mad_stream *stream, unsigned char *buffer, size_t size, pymp3_stats *stats);
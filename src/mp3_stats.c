@@ -0,0 +1,195 @@
+#include "mp3_stats.h"
+#include "py_module.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+
+/**
+ * Monotonic clock in nanoseconds
+ */
+unsigned long long pymp3_clock_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (unsigned long long) (counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+           (unsigned long long) (counter.QuadPart % frequency.QuadPart) * 1000000000ULL / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+#endif
+}
+
+/**
+ * Convert statistics into a dict with key names of the given kind of objects
+ */
+PyObject* pymp3_stats_to_dict(const pymp3_stats *stats, pymp3_stats_kind_t kind)
+{
+    if (kind == PYMP3_STATS_DECODER)
+    {
+        return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K}",
+            "bytes_in", stats->bytes_in,
+            "bytes_out", stats->bytes_out,
+            "frames", stats->frames,
+            "sync_errors", stats->sync_errors,
+            "read_calls", stats->io_calls,
+            "read_ns", stats->io_ns,
+            "read_stalls", stats->stalls,
+            "read_stall_ns", stats->stall_ns,
+            "decode_ns", stats->codec_ns,
+            "synth_ns", stats->synth_ns,
+            "convert_ns", stats->convert_ns);
+    }
+
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K}",
+        "bytes_in", stats->bytes_in,
+        "bytes_out", stats->bytes_out,
+        "frames", stats->frames,
+        "write_calls", stats->io_calls,
+        "write_ns", stats->io_ns,
+        "encode_ns", stats->codec_ns);
+}
+
+/**
+ * Add the counters of an object collected since the last call to the module-wide aggregates
+ */
+void pymp3_stats_publish(pymp3_state *state, pymp3_stats_kind_t kind, const pymp3_stats *stats, pymp3_stats *published)
+{
+    if (state == NULL || state->stats_lock == NULL)
+        return;
+
+    pymp3_stats *total = kind == PYMP3_STATS_DECODER ? &state->decoder_stats : &state->encoder_stats;
+
+    PyThread_acquire_lock(state->stats_lock, WAIT_LOCK);
+    total->bytes_in    += stats->bytes_in    - published->bytes_in;
+    total->bytes_out   += stats->bytes_out   - published->bytes_out;
+    total->frames      += stats->frames      - published->frames;
+    total->sync_errors += stats->sync_errors - published->sync_errors;
+    total->io_calls    += stats->io_calls    - published->io_calls;
+    total->stalls      += stats->stalls      - published->stalls;
+    total->stall_ns    += stats->stall_ns    - published->stall_ns;
+    total->io_ns       += stats->io_ns       - published->io_ns;
+    total->codec_ns    += stats->codec_ns    - published->codec_ns;
+    total->synth_ns    += stats->synth_ns    - published->synth_ns;
+    total->convert_ns  += stats->convert_ns  - published->convert_ns;
+
+    /* The published counters are read by pymp3_stats_snapshot() under the lock */
+    *published = *stats;
+    PyThread_release_lock(state->stats_lock);
+}
+
+/**
+ * Copy the counters of an object published by the end of its last call. Unlike the counters being updated,
+ * they can be read while another thread is in a method of the object (e.g. decoding with the GIL released)
+ */
+void pymp3_stats_snapshot(pymp3_state *state, const pymp3_stats *published, pymp3_stats *snapshot)
+{
+    if (state == NULL || state->stats_lock == NULL)
+    {
+        *snapshot = *published;
+        return;
+    }
+
+    PyThread_acquire_lock(state->stats_lock, WAIT_LOCK);
+    *snapshot = *published;
+    PyThread_release_lock(state->stats_lock);
+}
+
+/**
+ * Update the module-wide memory usage with the current size of native buffers of an object.
+ * `published` is the size added by the previous call, an object publishes 0 when it is destroyed
+ */
+void pymp3_memory_publish(pymp3_state *state, pymp3_stats_kind_t kind, size_t memory, size_t *published)
+{
+    if (state == NULL || state->stats_lock == NULL || memory == *published)
+        return;
+
+    unsigned long long *total = kind == PYMP3_STATS_DECODER ? &state->decoder_memory : &state->encoder_memory;
+
+    PyThread_acquire_lock(state->stats_lock, WAIT_LOCK);
+    *total += memory;
+    *total -= *published;
+    PyThread_release_lock(state->stats_lock);
+
+    *published = memory;
+}
+
+/**
+ * Get the native memory held by all live objects: mp3.memory_usage()
+ */
+PyObject* pymp3_module_memory_usage(PyObject *module, PyObject *args)
+{
+    pymp3_state *state = (pymp3_state *) PyModule_GetState(module);
+    unsigned long long decoder_memory, encoder_memory;
+
+    PyThread_acquire_lock(state->stats_lock, WAIT_LOCK);
+    decoder_memory = state->decoder_memory;
+    encoder_memory = state->encoder_memory;
+    PyThread_release_lock(state->stats_lock);
+
+    return Py_BuildValue("{s:K,s:K,s:K}",
+        "decoder", decoder_memory,
+        "encoder", encoder_memory,
+        "total", decoder_memory + encoder_memory);
+}
+
+/**
+ * Get the module-wide statistics: mp3.stats()
+ */
+PyObject* pymp3_module_stats(PyObject *module, PyObject *args)
+{
+    pymp3_state *state = (pymp3_state *) PyModule_GetState(module);
+    pymp3_stats decoder_stats, encoder_stats;
+
+    /* Copy under the lock, the lock must not be held while allocating Python objects */
+    PyThread_acquire_lock(state->stats_lock, WAIT_LOCK);
+    decoder_stats = state->decoder_stats;
+    encoder_stats = state->encoder_stats;
+    PyThread_release_lock(state->stats_lock);
+
+    return Py_BuildValue("{s:N,s:N,s:O}",
+        "decoder", pymp3_stats_to_dict(&decoder_stats, PYMP3_STATS_DECODER),
+        "encoder", pymp3_stats_to_dict(&encoder_stats, PYMP3_STATS_ENCODER),
+        "timers", PYMP3_ATOMIC_LOAD_INT(&state->timers) ? Py_True : Py_False);
+}
+
+/**
+ * Reset the module-wide statistics: mp3.reset_stats()
+ */
+PyObject* pymp3_module_reset_stats(PyObject *module, PyObject *args)
+{
+    pymp3_state *state = (pymp3_state *) PyModule_GetState(module);
+
+    PyThread_acquire_lock(state->stats_lock, WAIT_LOCK);
+    memset(&state->decoder_stats, 0, sizeof(pymp3_stats));
+    memset(&state->encoder_stats, 0, sizeof(pymp3_stats));
+    PyThread_release_lock(state->stats_lock);
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * Enable/disable timers: mp3.enable_timers(enabled), return the previous setting
+ */
+PyObject* pymp3_module_enable_timers(PyObject *module, PyObject *args)
+{
+    pymp3_state *state = (pymp3_state *) PyModule_GetState(module);
+    int enabled;
+
+    if (!PyArg_ParseTuple(args, "p:enable_timers", &enabled))
+    {
+        return NULL;
+    }
+
+    int previous = PYMP3_ATOMIC_EXCHANGE_INT(&state->timers, enabled);
+
+    return PyBool_FromLong(previous);
+}
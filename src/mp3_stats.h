@@ -0,0 +1,39 @@
+#pragma once
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+
+/* Kind of objects, which statistics are collected */
+typedef enum pymp3_stats_kind {
+    PYMP3_STATS_DECODER = 0,
+    PYMP3_STATS_ENCODER = 1,
+} pymp3_stats_kind_t;
+
+/* Performance counters of an Encoder/Decoder object (and module-wide aggregates of them) */
+typedef struct {
+    unsigned long long bytes_in;        /* MP3 bytes read (decoder), PCM bytes written (encoder) */
+    unsigned long long bytes_out;       /* PCM bytes decoded (decoder), MP3 bytes encoded (encoder) */
+    unsigned long long frames;          /* MPEG frames decoded/encoded */
+    unsigned long long sync_errors;     /* recoverable errors, i.e. lost sync or corrupted frames (decoder only) */
+    unsigned long long io_calls;        /* calls of read()/write() methods of the file-like object */
+    unsigned long long stalls;          /* waits for the read-ahead thread (decoder only) */
+    unsigned long long stall_ns;        /* time waited for the read-ahead thread, in nanoseconds, always collected (decoder only) */
+
+    /* Timers (in nanoseconds), collected only when enabled with mp3.enable_timers() */
+    unsigned long long io_ns;           /* read()/write() methods of the file-like object */
+    unsigned long long codec_ns;        /* mad_frame_decode() (decoder) or lame_encode_*() (encoder) */
+    unsigned long long synth_ns;        /* mad_synth_frame() (decoder only) */
+    unsigned long long convert_ns;      /* conversion of samples into 16-bit PCM (decoder only) */
+} pymp3_stats;
+
+/* Monotonic clock in nanoseconds */
+unsigned long long pymp3_clock_ns(void);
+
+/* Start/stop a timer, which adds the elapsed time to a counter when timers are enabled */
+#define PYMP3_TIMER_START(enabled) ((enabled) ? pymp3_clock_ns() : 0)
+#define PYMP3_TIMER_STOP(enabled, start, counter) \
+    do { if (enabled) (counter) += pymp3_clock_ns() - (start); } while (0)
+
+/* Convert statistics into a dict with key names of the given kind of objects */
+PyObject* pymp3_stats_to_dict(const pymp3_stats *stats, pymp3_stats_kind_t kind);
@@ -0,0 +1,394 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <mad.h>
+#include <lame/lame.h>
+
+#include "py_module.h"
+#include "mp3_alloc.h"
+#include "mp3_source.h"
+#include "pcm_convert.h"
+
+#define TRANSCODE_READ_SIZE (64*1024)       // Size of blocks read from the source
+#define TRANSCODE_WRITE_SIZE (64*1024)      // Encoded data is written to the destination in blocks of at least this size
+#define TRANSCODE_MAX_FRAME_SAMPLES 1152    // Maximum number of samples (per channel) in one MPEG frame
+#define TRANSCODE_DEFAULT_BIT_RATE 128
+#define TRANSCODE_DEFAULT_QUALITY 5
+
+
+/* State of one transcoding pipeline: libmad decoder connected to LAME encoder */
+typedef struct {
+    pymp3_source source;
+
+    /* Destination: a file-like object with write() method, or NULL to return bytes */
+    PyObject *destination;
+    unsigned long long written;
+
+    /* Format of the output, 0 to keep the format of the source */
+    int bit_rate;
+    int sample_rate;
+    int channels;
+    int quality;
+
+    struct mad_stream stream;
+    struct mad_frame frame;
+    struct mad_synth synth;
+    unsigned char *input_buffer;
+    unsigned int samplerate;        /* Sample rate of the source (of the first frame) */
+
+    lame_global_flags *lame;
+    int pcm_left[TRANSCODE_MAX_FRAME_SAMPLES];
+    int pcm_right[TRANSCODE_MAX_FRAME_SAMPLES];
+
+    /* Encoded data not written to the destination yet */
+    unsigned char *output_buffer;
+    size_t output_buffer_size;
+    size_t output_buffer_end;
+
+    /* Error detected while the GIL is released, the exception is raised after the GIL is acquired */
+    PyObject *error_type;
+    const char *error_message;
+
+    pymp3_stats decoder_stats;
+    pymp3_stats encoder_stats;
+} transcoder;
+
+
+static void transcode_silent_output(const char *format, va_list ap)
+{
+    return;
+}
+
+/**
+ * Make sure the output buffer has room for `size` more bytes (called without the GIL)
+ *
+ * \return  0 on success, -1 on error (t->error_* is set)
+ */
+static int transcode_reserve_output(transcoder *t, size_t size)
+{
+    if (t->output_buffer_end + size > t->output_buffer_size)
+    {
+        size_t new_size = t->output_buffer_size * 2;
+        if (new_size < t->output_buffer_end + size)
+            new_size = t->output_buffer_end + size;
+
+        unsigned char *new_buffer = pymp3_mem_realloc(t->output_buffer, new_size);
+        if (new_buffer == NULL)
+        {
+            t->error_type = PyExc_MemoryError;
+            t->error_message = "Could not allocate memory for output buffer";
+            return -1;
+        }
+        t->output_buffer = new_buffer;
+        t->output_buffer_size = new_size;
+    }
+
+    return 0;
+}
+
+/**
+ * Create LAME encoder for the format of the first decoded frame (called without the GIL).
+ * LAME resamples the audio and mixes stereo down to mono (2 input channels with MONO mode).
+ *
+ * \return  0 on success, -1 on error (t->error_* is set)
+ */
+static int transcode_init_encoder(transcoder *t)
+{
+    int in_channels = MAD_NCHANNELS(&t->frame.header);
+    int out_channels = t->channels ? t->channels : in_channels;
+
+    t->samplerate = t->frame.header.samplerate;
+
+    t->lame = lame_init();
+    if (t->lame == NULL)
+    {
+        t->error_type = PyExc_MemoryError;
+        t->error_message = "Could not allocate memory for the encoder";
+        return -1;
+    }
+
+    lame_set_errorf(t->lame, &transcode_silent_output);
+    lame_set_debugf(t->lame, &transcode_silent_output);
+    lame_set_msgf(t->lame, &transcode_silent_output);
+
+    lame_set_num_channels(t->lame, (in_channels == 1 && out_channels == 1) ? 1 : 2);
+    lame_set_mode(t->lame, out_channels == 1 ? MONO : JOINT_STEREO);
+    lame_set_in_samplerate(t->lame, t->samplerate);
+    lame_set_out_samplerate(t->lame, t->sample_rate ? t->sample_rate : (int) t->samplerate);
+    lame_set_brate(t->lame, t->bit_rate);
+    lame_set_quality(t->lame, t->quality);
+    lame_set_bWriteVbrTag(t->lame, 0);
+
+    if (lame_init_params(t->lame) < 0)
+    {
+        t->error_type = PyExc_ValueError;
+        t->error_message = "Error initialising the encoder (unsupported combination of bit rate and sample rate?)";
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Decode all frames of the input buffer and encode them (called without the GIL)
+ *
+ * \return  0 when more input is needed, -1 on error (t->error_* is set)
+ */
+static int transcode_process_input(transcoder *t)
+{
+    while (1)
+    {
+        if (mad_frame_decode(&t->frame, &t->stream))
+        {
+            if (MAD_RECOVERABLE(t->stream.error))
+            {
+                t->decoder_stats.sync_errors++;
+                continue;
+            }
+
+            if (t->stream.error == MAD_ERROR_BUFLEN)
+                return 0;
+
+            t->error_type = PyExc_RuntimeError;
+            t->error_message = "Unrecoverable mpeg frame level error";
+            return -1;
+        }
+
+        if (t->lame == NULL)
+        {
+            if (transcode_init_encoder(t) < 0)
+                return -1;
+        }
+        else if (t->frame.header.samplerate != t->samplerate)
+        {
+            // LAME can't change the input sample rate in the middle of the stream
+            t->decoder_stats.sync_errors++;
+            continue;
+        }
+
+        mad_synth_frame(&t->synth, &t->frame);
+
+        struct mad_pcm *pcm = &t->synth.pcm;
+        unsigned int nsamples = pcm->length;
+
+        pymp3_fixed_to_int32(t->pcm_left, pcm->samples[0], nsamples);
+        if (pcm->channels == 2)
+            pymp3_fixed_to_int32(t->pcm_right, pcm->samples[1], nsamples);
+
+        t->decoder_stats.frames++;
+        t->decoder_stats.bytes_out += nsamples * pcm->channels * sizeof(short);
+
+        /* The worst case of the output size, recommended by LAME */
+        size_t size = 5 * nsamples / 4 + 7200;
+        if (transcode_reserve_output(t, size) < 0)
+            return -1;
+
+        int frameNum = lame_get_frameNum(t->lame);
+        int outputBytes = lame_encode_buffer_int(t->lame, t->pcm_left, pcm->channels == 2 ? t->pcm_right : t->pcm_left, nsamples,
+                                                 t->output_buffer + t->output_buffer_end, (int) size);
+        if (outputBytes < 0)
+        {
+            t->error_type = PyExc_RuntimeError;
+            t->error_message = "Error encoding PCM data";
+            return -1;
+        }
+
+        t->output_buffer_end += outputBytes;
+        t->encoder_stats.bytes_in += nsamples * lame_get_num_channels(t->lame) * sizeof(short);
+        t->encoder_stats.bytes_out += outputBytes;
+        t->encoder_stats.frames += lame_get_frameNum(t->lame) - frameNum;
+    }
+}
+
+/**
+ * Write the encoded data to the destination (if any)
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int transcode_write_output(transcoder *t)
+{
+    if (t->destination == NULL || t->output_buffer_end == 0)
+        return 0;
+
+    PyObject *o_write = PyObject_CallMethod(t->destination, "write", "y#", t->output_buffer, (Py_ssize_t) t->output_buffer_end);
+    t->encoder_stats.io_calls++;
+    if (o_write == NULL)
+        return -1;
+    Py_DECREF(o_write);
+
+    t->written += t->output_buffer_end;
+    t->output_buffer_end = 0;
+    return 0;
+}
+
+/**
+ * Transcode the whole source
+ *
+ * \return  0 on success, -1 on error (Python exception is set)
+ */
+static int transcode_run(transcoder *t)
+{
+    int result;
+
+    while (1)
+    {
+        result = pymp3_source_fill_stream(&t->source, &t->stream, t->input_buffer, TRANSCODE_READ_SIZE, &t->decoder_stats);
+        if (result < 0)
+            return -1;
+        if (result == 0)
+            break;
+
+        Py_BEGIN_ALLOW_THREADS
+        result = transcode_process_input(t);
+        Py_END_ALLOW_THREADS
+
+        if (result < 0)
+        {
+            PyErr_SetString(t->error_type, t->error_message);
+            return -1;
+        }
+
+        if (t->output_buffer_end >= TRANSCODE_WRITE_SIZE && transcode_write_output(t) < 0)
+            return -1;
+    }
+
+    if (t->lame == NULL)
+    {
+        PyErr_SetString(PyExc_ValueError, "No MPEG audio frames found in the source");
+        return -1;
+    }
+
+    /* Flush the samples buffered by the encoder */
+    Py_BEGIN_ALLOW_THREADS
+    result = transcode_reserve_output(t, 7200);
+    if (result == 0)
+    {
+        result = lame_encode_flush(t->lame, t->output_buffer + t->output_buffer_end, 7200);
+        if (result < 0)
+        {
+            t->error_type = PyExc_RuntimeError;
+            t->error_message = "Error flushing the encoder";
+        }
+        else
+        {
+            t->output_buffer_end += result;
+            t->encoder_stats.bytes_out += result;
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    if (result < 0)
+    {
+        PyErr_SetString(t->error_type, t->error_message);
+        return -1;
+    }
+
+    return transcode_write_output(t);
+}
+
+/**
+ * mp3.transcode(source, destination, bit_rate=128, sample_rate=0, channels=0, quality=5)
+ *
+ * Decode MP3 data and encode it again with another bit rate, sample rate or number of channels.
+ * The PCM samples go from libmad's synthesis straight into LAME, and the GIL is released except for calls of read()/write().
+ * Returns the number of bytes written to `destination`, or the encoded data if `destination` is None.
+ */
+PyObject* pymp3_transcode(PyObject *module, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"source", "destination", "bit_rate", "sample_rate", "channels", "quality", NULL};
+
+    PyObject *source = NULL;
+    PyObject *destination = NULL;
+    int bit_rate = TRANSCODE_DEFAULT_BIT_RATE;
+    int sample_rate = 0;
+    int channels = 0;
+    int quality = TRANSCODE_DEFAULT_QUALITY;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|iiii:transcode", kwlist, &source, &destination, &bit_rate, &sample_rate, &channels, &quality))
+        return NULL;
+
+    if (bit_rate <= 0 || sample_rate < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "bit_rate must be positive, and sample_rate must be positive or 0 (the sample rate of the source)");
+        return NULL;
+    }
+
+    if (channels < 0 || channels > 2)
+    {
+        PyErr_SetString(PyExc_ValueError, "channels must be 1, 2 or 0 (the number of channels of the source)");
+        return NULL;
+    }
+
+    if (quality < 0 || quality > 9)
+    {
+        PyErr_SetString(PyExc_ValueError, "quality must be in the range 0-9");
+        return NULL;
+    }
+
+    transcoder *t = pymp3_mem_calloc(1, sizeof(transcoder));
+    if (t == NULL)
+        return PyErr_NoMemory();
+
+    t->bit_rate = bit_rate;
+    t->sample_rate = sample_rate;
+    t->channels = channels;
+    t->quality = quality;
+
+    mad_stream_init(&t->stream);
+    mad_frame_init(&t->frame);
+    mad_synth_init(&t->synth);
+
+    PyObject *result = NULL;
+
+    if (pymp3_source_open(&t->source, source, "source") < 0)
+        goto done;
+
+    if (destination != Py_None)
+    {
+        if (pymp3_check_method(destination, "write", "destination") < 0)
+            goto done;
+        t->destination = destination;
+    }
+
+    t->input_buffer = pymp3_mem_malloc(TRANSCODE_READ_SIZE + MAD_BUFFER_GUARD);
+    t->output_buffer_size = TRANSCODE_WRITE_SIZE + 8 * 1024;
+    t->output_buffer = pymp3_mem_malloc(t->output_buffer_size);
+    if (t->input_buffer == NULL || t->output_buffer == NULL)
+    {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    if (transcode_run(t) < 0)
+        goto done;
+
+    if (t->destination != NULL)
+        result = PyLong_FromUnsignedLongLong(t->written);
+    else
+        result = PyBytes_FromStringAndSize((const char *) t->output_buffer, t->output_buffer_end);
+
+done:
+    {
+        pymp3_state *state = (pymp3_state *) PyModule_GetState(module);
+        pymp3_stats published;
+
+        memset(&published, 0, sizeof(published));
+        pymp3_stats_publish(state, PYMP3_STATS_DECODER, &t->decoder_stats, &published);
+        memset(&published, 0, sizeof(published));
+        pymp3_stats_publish(state, PYMP3_STATS_ENCODER, &t->encoder_stats, &published);
+    }
+
+    if (t->lame != NULL)
+        lame_close(t->lame);
+
+    mad_synth_finish(&t->synth);
+    mad_frame_finish(&t->frame);
+    mad_stream_finish(&t->stream);
+
+    pymp3_source_close(&t->source);
+
+    pymp3_mem_free(t->input_buffer);
+    pymp3_mem_free(t->output_buffer);
+    pymp3_mem_free(t);
+
+    return result;
+}
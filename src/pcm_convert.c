@@ -0,0 +1,139 @@
+#include "pcm_convert.h"
+
+
+/* convert the MAD fixed point format to a signed 16 bit int */
+static inline int16_t fixed_to_int16(mad_fixed_t sample)
+{
+    /* A fixed point number is formed of the following bit pattern:
+    *
+    * SWWWFFFFFFFFFFFFFFFFFFFFFFFFFFFF
+    * MSB                          LSB
+    * S = sign
+    * W = whole part bits
+    * F = fractional part bits
+    *
+    * This pattern contains MAD_F_FRACBITS fractional bits, one should
+    * always use this macro when working on the bits of a fixed point
+    * number.  It is not guaranteed to be constant over the different
+    * platforms supported by libmad.
+    *
+    * The int16_t value is formed by the least significant
+    * whole part bit, followed by the 15 most significant fractional
+    * part bits.
+    *
+    * This algorithm was taken from input/mad/mad_engine.c in alsaplayer,
+    * which scales and rounds samples to 16 bits, unlike the version in
+    * madlld.
+    *
+    * Clipping is branchless (min/max), so the loops below are vectorized.
+    */
+
+    /* round */
+    sample += (1L << (MAD_F_FRACBITS - 16));
+
+    /* clip */
+    sample = sample < -MAD_F_ONE ? -MAD_F_ONE : sample;
+    sample = sample > MAD_F_ONE - 1 ? MAD_F_ONE - 1 : sample;
+
+    /* quantize */
+    return (int16_t) (sample >> (MAD_F_FRACBITS + 1 - 16));
+}
+
+PYMP3_TARGET_CLONES
+static void fixed_to_int16_mono(int16_t * restrict output, const mad_fixed_t * restrict left, unsigned int nsamples)
+{
+    for (unsigned int i = 0; i < nsamples; i++)
+        output[i] = fixed_to_int16(left[i]);
+}
+
+/* Both samples of a stereo frame in one 32-bit word, so the interleaving loop is vectorized */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PACK_STEREO(left, right) (((uint32_t) (uint16_t) (left) << 16) | (uint16_t) (right))
+#else
+#define PACK_STEREO(left, right) ((uint16_t) (left) | ((uint32_t) (uint16_t) (right) << 16))
+#endif
+
+PYMP3_TARGET_CLONES
+static void fixed_to_int16_stereo(uint32_t * restrict output, const mad_fixed_t * restrict left, const mad_fixed_t * restrict right, unsigned int nsamples)
+{
+    for (unsigned int i = 0; i < nsamples; i++)
+        output[i] = PACK_STEREO(fixed_to_int16(left[i]), fixed_to_int16(right[i]));
+}
+
+void pymp3_fixed_to_int16(int16_t *output, const mad_fixed_t *left, const mad_fixed_t *right, unsigned int nsamples, int channels)
+{
+    if (channels == 1)
+        fixed_to_int16_mono(output, left, nsamples);
+    else
+        fixed_to_int16_stereo((uint32_t *) output, left, right, nsamples);
+}
+
+PYMP3_TARGET_CLONES
+void pymp3_fixed_to_int32(int * restrict output, const mad_fixed_t * restrict input, unsigned int nsamples)
+{
+    for (unsigned int i = 0; i < nsamples; i++)
+    {
+        mad_fixed_t sample = input[i];
+
+        /* clip to [-1.0, 1.0) and scale the fractional bits to 31 bits */
+        sample = sample < -MAD_F_ONE ? -MAD_F_ONE : sample;
+        sample = sample > MAD_F_ONE - 1 ? MAD_F_ONE - 1 : sample;
+        output[i] = (int) (sample * (1 << (31 - MAD_F_FRACBITS)));
+    }
+}
+
+PYMP3_TARGET_CLONES
+double pymp3_fixed_energy(const mad_fixed_t * restrict input, unsigned int nsamples)
+{
+    /* 20 fractional bits: a square fits 46 bits, so the sum of up to 2^17 samples doesn't overflow */
+    int64_t sum = 0;
+    for (unsigned int i = 0; i < nsamples; i++)
+    {
+        int64_t sample = input[i] >> (MAD_F_FRACBITS - 20);
+        sum += sample * sample;
+    }
+
+    return (double) sum / (double) (1LL << 40);
+}
+
+PYMP3_TARGET_CLONES
+void pymp3_fixed_summary(const mad_fixed_t * restrict input, unsigned int nsamples, mad_fixed_t * restrict min, mad_fixed_t * restrict max, double * restrict energy)
+{
+    /* Local accumulators, so the loop is reduced in vector registers */
+    mad_fixed_t lo = *min;
+    mad_fixed_t hi = *max;
+    int64_t sum = 0;
+    for (unsigned int i = 0; i < nsamples; i++)
+    {
+        mad_fixed_t value = input[i];
+        lo = value < lo ? value : lo;
+        hi = value > hi ? value : hi;
+
+        int64_t sample = value >> (MAD_F_FRACBITS - 20);
+        sum += sample * sample;
+    }
+
+    *min = lo;
+    *max = hi;
+    *energy += (double) sum / (double) (1LL << 40);
+}
+
+PYMP3_TARGET_CLONES
+double pymp3_int16_energy(const int16_t * restrict input, size_t nsamples)
+{
+    int64_t sum = 0;
+    for (size_t i = 0; i < nsamples; i++)
+        sum += (int32_t) input[i] * input[i];
+
+    return (double) sum / (32768.0 * 32768.0);
+}
+
+PYMP3_TARGET_CLONES
+void pymp3_int16_deinterleave(int16_t * restrict left, int16_t * restrict right, const int16_t * restrict input, size_t nsamples)
+{
+    for (size_t i = 0; i < nsamples; i++)
+    {
+        left[i] = input[2 * i];
+        right[i] = input[2 * i + 1];
+    }
+}
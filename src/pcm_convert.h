@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mad.h>
+
+
+/*
+ * Function multiversioning of the PCM conversion kernels: on x86-64 Linux with glibc (GCC/Clang with ifunc support)
+ * an AVX2 clone is built next to the baseline version, and the loader picks one by the CPU features.
+ * Wheels built for the generic baseline still use AVX2 when it is available. musl has no ifunc, and CMake probes
+ * the attribute with the toolchain as well. Define PYMP3_NO_TARGET_CLONES to build the baseline version only.
+ */
+#if defined(__x86_64__) && defined(__linux__) && defined(__GLIBC__) && defined(__has_attribute) && !defined(PYMP3_NO_TARGET_CLONES)
+#if __has_attribute(target_clones)
+#define PYMP3_TARGET_CLONES __attribute__((target_clones("avx2", "default")))
+#endif
+#endif
+
+#ifndef PYMP3_TARGET_CLONES
+#define PYMP3_TARGET_CLONES
+#endif
+
+
+/**
+ * Convert `nsamples` samples of libmad's fixed point format to 16-bit signed PCM (rounded and clipped).
+ * `channels` is 1 (only the `left` channel is written) or 2 (interleaved `left` and `right` channels, pass `left` twice for a mono frame).
+ * For 2 channels `output` must be aligned to 4 bytes, i.e. to a stereo sample
+ */
+void pymp3_fixed_to_int16(int16_t *output, const mad_fixed_t *left, const mad_fixed_t *right, unsigned int nsamples, int channels);
+
+/**
+ * Convert `nsamples` samples of libmad's fixed point format to full scale 32-bit integers (clipped), as accepted by lame_encode_buffer_int()
+ */
+void pymp3_fixed_to_int32(int *output, const mad_fixed_t *input, unsigned int nsamples);
+
+/**
+ * Sum of squares of `nsamples` samples of libmad's fixed point format, in units of full scale (1.0).
+ * Samples below 2^-20 of full scale (-120 dB) are ignored
+ */
+double pymp3_fixed_energy(const mad_fixed_t *input, unsigned int nsamples);
+
+/**
+ * Update the minimum, the maximum and the sum of squares (in units of full scale, as pymp3_fixed_energy())
+ * with `nsamples` samples of libmad's fixed point format
+ */
+void pymp3_fixed_summary(const mad_fixed_t *input, unsigned int nsamples, mad_fixed_t *min, mad_fixed_t *max, double *energy);
+
+/**
+ * Sum of squares of `nsamples` 16-bit PCM samples, in units of full scale (1.0)
+ */
+double pymp3_int16_energy(const int16_t *input, size_t nsamples);
+
+/**
+ * Split `nsamples` interleaved stereo samples into the `left` and `right` channels
+ */
+void pymp3_int16_deinterleave(int16_t *left, int16_t *right, const int16_t *input, size_t nsamples);
@@ -2,6 +2,7 @@
 #include <Python.h>
 
 #include "py_module.h"
+#include "mp3_alloc.h"
 #include "mp3_encoder.h"
 #include "mp3_decoder.h"
 
@@ -16,75 +17,335 @@ static char DecoderClassName[] = "Decoder";
 /** The docstring description of the module */
 PyDoc_STRVAR(module_docstring, "This module provides an interface to encode/decode between PCM and MP3 data");
 
-/** No methods in the module, only a class */
+/** The module functions */
 static PyMethodDef module_methods[] = {
+    { "stats", (PyCFunction) &pymp3_module_stats, METH_NOARGS, "Get performance counters aggregated over all Encoder and Decoder objects" },
+    { "reset_stats", (PyCFunction) &pymp3_module_reset_stats, METH_NOARGS, "Reset the aggregated performance counters" },
+    { "probe", (PyCFunction) &pymp3_probe, METH_VARARGS | METH_KEYWORDS, "Check if the data is a valid MPEG audio stream by frame headers only (without decoding), return the format or a reason of rejection" },
+    { "transcode", (PyCFunction) &pymp3_transcode, METH_VARARGS | METH_KEYWORDS, "Decode MP3 data and encode it with another bit rate, sample rate or number of channels, without passing PCM data through Python" },
+    { "cut", (PyCFunction) &pymp3_cut, METH_VARARGS | METH_KEYWORDS, "Copy MPEG frames of the time range [start, end) in seconds, without decoding and re-encoding" },
+    { "concat", (PyCFunction) &pymp3_concat, METH_VARARGS | METH_KEYWORDS, "Join MPEG frames of the sources, without decoding and re-encoding" },
+    { "peaks", (PyCFunction) &pymp3_peaks, METH_VARARGS | METH_KEYWORDS, "Decode MP3 data and summarize each block of samples as (min, max, RMS) 16-bit values, for waveform display" },
+    { "acquire_encoder", (PyCFunction) &pymp3_acquire_encoder, METH_VARARGS | METH_KEYWORDS, "Get a ready encoder of the given configuration from the pool, or create a new one" },
+    { "release_encoder", (PyCFunction) &pymp3_release_encoder, METH_O, "Flush the encoder and return it to the pool" },
+    { "memory_usage", (PyCFunction) &pymp3_module_memory_usage, METH_NOARGS, "Get the native memory (in bytes) held by all live Decoder and Encoder objects" },
+    { "enable_buffer_pool", (PyCFunction) &pymp3_module_enable_buffer_pool, METH_VARARGS, "Enable/disable per-thread pools of decoder/encoder buffers, return the previous setting" },
+    { "enable_timers", (PyCFunction) &pymp3_module_enable_timers, METH_VARARGS, "Enable/disable collection of timers (in nanoseconds) in addition to counters, return the previous setting" },
     { NULL, NULL, 0, NULL }
 };
 
-/** The module definition */
-static struct PyModuleDef pymp3_module = {
-    PyModuleDef_HEAD_INIT,
-    module_name,
-    module_docstring,
-    -1,
-    module_methods
-};
+#if PY_VERSION_HEX < 0x03090000
+/* Python before 3.9 doesn't link heap types with their module, there is only the main interpreter's module */
+static pymp3_state *pymp3_legacy_state = NULL;
+#endif
 
-extern PyTypeObject EncoderType;
-extern PyTypeObject DecoderType;
+extern PyType_Spec EncoderType_spec;
+extern PyType_Spec DecoderType_spec;
+
+#if PY_VERSION_HEX >= 0x03090000
+extern PyObject* Encoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames);
+extern PyObject* Decoder_vectorcall(PyObject *type, PyObject *const *args, size_t nargsf, PyObject *kwnames);
+#endif
 
 /**
- * Module initialisation function
+ * Call the regular constructor (tp_new and tp_init) of a type with vectorcall arguments.
+ * Used by vectorcall entry points of the classes for calls, which are not handled by their fast path.
+ */
+PyObject* pymp3_vectorcall_fallback(PyTypeObject *type, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
+{
+    PyObject *argtuple = NULL, *kwdict = NULL, *obj = NULL;
+    Py_ssize_t i;
+
+    argtuple = PyTuple_New(nargs);
+    if (argtuple == NULL)
+        return NULL;
+
+    for (i = 0; i < nargs; i++)
+    {
+        Py_INCREF(args[i]);
+        PyTuple_SET_ITEM(argtuple, i, args[i]);
+    }
+
+    if (kwnames != NULL && PyTuple_GET_SIZE(kwnames) > 0)
+    {
+        kwdict = PyDict_New();
+        if (kwdict == NULL)
+            goto done;
+
+        for (i = 0; i < PyTuple_GET_SIZE(kwnames); i++)
+        {
+            if (PyDict_SetItem(kwdict, PyTuple_GET_ITEM(kwnames, i), args[nargs + i]) < 0)
+                goto done;
+        }
+    }
+
+    obj = type->tp_new(type, argtuple, kwdict);
+    if (obj != NULL && type->tp_init != NULL && PyObject_TypeCheck(obj, type))
+    {
+        if (type->tp_init(obj, argtuple, kwdict) < 0)
+            Py_CLEAR(obj);
+    }
+
+done:
+    Py_XDECREF(kwdict);
+    Py_DECREF(argtuple);
+    return obj;
+}
+
+/**
+ * Initialise a per-object lock
  *
- * \return  The created module
+ * \return  0 on success, -1 on error (Python exception is set)
  */
-PyMODINIT_FUNC PyInit_mp3(void)
+int pymp3_lock_init(pymp3_lock *lock)
 {
-    PyObject *module, *dict;
+    lock->owner = 0;
+    lock->lock = PyThread_allocate_lock();
+    if (lock->lock == NULL)
+    {
+        PyErr_SetString(PyExc_MemoryError, "Unable to allocate lock");
+        return -1;
+    }
+    return 0;
+}
 
-    /* Create the module with no methods in it */
-    module = PyModule_Create(&pymp3_module);
+/**
+ * Destroy a per-object lock
+ */
+void pymp3_lock_free(pymp3_lock *lock)
+{
+    if (lock->lock != NULL)
+    {
+        PyThread_free_lock(lock->lock);
+        lock->lock = NULL;
+    }
+}
 
-    /* Define constants */
-    dict = PyModule_GetDict(module);
+/**
+ * Acquire a per-object lock. The lock stays held while the GIL is released during encoding/decoding,
+ * so concurrent calls on the same object are serialized with or without the GIL.
+ *
+ * \return  0 on success, -1 on a reentrant call from the same thread (Python exception is set)
+ */
+int pymp3_lock_acquire(pymp3_lock *lock, PyObject *obj)
+{
+    unsigned long ident = PyThread_get_thread_ident();
+
+    if (PYMP3_ATOMIC_LOAD_ULONG(&lock->owner) == ident)
+    {
+        /* For example, a read() method of a file-like object calls back the decoder */
+        PyErr_Format(PyExc_RuntimeError, "reentrant call inside %R", obj);
+        return -1;
+    }
+
+    if (!PyThread_acquire_lock(lock->lock, NOWAIT_LOCK))
+    {
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(lock->lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+
+    PYMP3_ATOMIC_STORE_ULONG(&lock->owner, ident);
+    return 0;
+}
+
+/**
+ * Release a per-object lock
+ */
+void pymp3_lock_release(pymp3_lock *lock)
+{
+    PYMP3_ATOMIC_STORE_ULONG(&lock->owner, 0);
+    PyThread_release_lock(lock->lock);
+}
+
+/**
+ * Get the state of the module, which defines the type
+ */
+pymp3_state* pymp3_get_state(PyTypeObject *type)
+{
+#if PY_VERSION_HEX >= 0x03090000
+    return (pymp3_state *) PyType_GetModuleState(type);
+#else
+    return pymp3_legacy_state;
+#endif
+}
+
+/**
+ * Create a class from its spec and add it to the module
+ */
+static PyObject* add_type(PyObject *module, PyType_Spec *spec, const char *name)
+{
+#if PY_VERSION_HEX >= 0x03090000
+    PyObject *type = PyType_FromModuleAndSpec(module, spec, NULL);
+#else
+    PyObject *type = PyType_FromSpec(spec);
+#endif
+    if (type == NULL)
+        return NULL;
 
-    PyDict_SetItemString(dict, "LAYER_I", PyLong_FromLong(LAYER_I));
-    PyDict_SetItemString(dict, "LAYER_II", PyLong_FromLong(LAYER_II));
-    PyDict_SetItemString(dict, "LAYER_III", PyLong_FromLong(LAYER_III));
+    Py_INCREF(type);
+    if (PyModule_AddObject(module, name, type) < 0)
+    {
+        Py_DECREF(type);
+        Py_DECREF(type);
+        return NULL;
+    }
 
-    PyDict_SetItemString(dict, "MODE_SINGLE_CHANNEL", PyLong_FromLong(MODE_SINGLE_CHANNEL));
-    PyDict_SetItemString(dict, "MODE_DUAL_CHANNEL", PyLong_FromLong(MODE_DUAL_CHANNEL));
-    PyDict_SetItemString(dict, "MODE_JOINT_STEREO", PyLong_FromLong(MODE_JOINT_STEREO));
-    PyDict_SetItemString(dict, "MODE_STEREO", PyLong_FromLong(MODE_STEREO));
+    return type;
+}
 
-    /* Initialise the class */
-    if (PyType_Ready(&EncoderType) < 0)
+/**
+ * Module execution function (multi-phase initialisation)
+ *
+ * \return  0 on success, -1 on error
+ */
+static int pymp3_exec(PyObject *module)
+{
+    pymp3_state *state = (pymp3_state *) PyModule_GetState(module);
+
+    /* Define constants */
+    if (PyModule_AddIntConstant(module, "LAYER_I", LAYER_I) < 0 ||
+        PyModule_AddIntConstant(module, "LAYER_II", LAYER_II) < 0 ||
+        PyModule_AddIntConstant(module, "LAYER_III", LAYER_III) < 0 ||
+        PyModule_AddIntConstant(module, "MODE_SINGLE_CHANNEL", MODE_SINGLE_CHANNEL) < 0 ||
+        PyModule_AddIntConstant(module, "MODE_DUAL_CHANNEL", MODE_DUAL_CHANNEL) < 0 ||
+        PyModule_AddIntConstant(module, "MODE_JOINT_STEREO", MODE_JOINT_STEREO) < 0 ||
+        PyModule_AddIntConstant(module, "MODE_STEREO", MODE_STEREO) < 0 ||
+        PyModule_AddIntConstant(module, "BACKEND_LIBMAD", BACKEND_LIBMAD) < 0 ||
+        PyModule_AddIntConstant(module, "BACKEND_MINIMP3", BACKEND_MINIMP3) < 0)
     {
-        Py_CLEAR(module);
+        return -1;
     }
-    else
+
+    /* Decoder backends built in the module */
+    PyObject *backends = PYMP3_HAVE_MINIMP3 ? Py_BuildValue("(ii)", BACKEND_LIBMAD, BACKEND_MINIMP3) : Py_BuildValue("(i)", BACKEND_LIBMAD);
+    if (backends == NULL || PyModule_AddObject(module, "BACKENDS", backends) < 0)
     {
-        /* Add the Encoder class to the module */
-        Py_INCREF(&EncoderType);
-        if (PyModule_AddObject(module, EncoderClassName, (PyObject*) &EncoderType) == -1)
-        {
-            Py_CLEAR(module);
-        }
+        Py_XDECREF(backends);
+        return -1;
     }
 
-    if (PyType_Ready(&DecoderType) < 0)
+    /* Performance counters */
+    state->stats_lock = PyThread_allocate_lock();
+    if (state->stats_lock == NULL)
     {
-        Py_CLEAR(module);
+        PyErr_SetString(PyExc_MemoryError, "Unable to allocate lock");
+        return -1;
     }
-    else
+    memset(&state->decoder_stats, 0, sizeof(pymp3_stats));
+    memset(&state->encoder_stats, 0, sizeof(pymp3_stats));
+    state->decoder_memory = 0;
+    state->encoder_memory = 0;
+    state->timers = 0;
+
+    /* Pool of encoders */
+    state->encoder_pool = PyDict_New();
+    if (state->encoder_pool == NULL)
+        return -1;
+
+    state->pool_lock = PyThread_allocate_lock();
+    if (state->pool_lock == NULL)
     {
-        /* Add the Decoder class to the module */
-        Py_INCREF(&DecoderType);
-        if (PyModule_AddObject(module, DecoderClassName, (PyObject*) &DecoderType) == -1)
-        {
-            Py_CLEAR(module);
-        }
+        PyErr_SetString(PyExc_MemoryError, "Unable to allocate lock");
+        return -1;
     }
 
-    return module;
+#if PY_VERSION_HEX < 0x03090000
+    pymp3_legacy_state = state;
+#endif
+
+    /* Initialise the classes */
+    state->EncoderType = add_type(module, &EncoderType_spec, EncoderClassName);
+    if (state->EncoderType == NULL)
+        return -1;
+
+    state->DecoderType = add_type(module, &DecoderType_spec, DecoderClassName);
+    if (state->DecoderType == NULL)
+        return -1;
+
+#if PY_VERSION_HEX >= 0x03090000
+    /* Calls of the classes (constructors) bypass building of an argument tuple */
+    ((PyTypeObject *) state->EncoderType)->tp_vectorcall = Encoder_vectorcall;
+    ((PyTypeObject *) state->DecoderType)->tp_vectorcall = Decoder_vectorcall;
+#endif
+
+    return 0;
+}
+
+static int pymp3_traverse(PyObject *module, visitproc visit, void *arg)
+{
+    pymp3_state *state = (pymp3_state *) PyModule_GetState(module);
+    Py_VISIT(state->EncoderType);
+    Py_VISIT(state->DecoderType);
+    Py_VISIT(state->encoder_pool);
+    return 0;
+}
+
+static int pymp3_clear(PyObject *module)
+{
+    pymp3_state *state = (pymp3_state *) PyModule_GetState(module);
+    Py_CLEAR(state->EncoderType);
+    Py_CLEAR(state->DecoderType);
+    Py_CLEAR(state->encoder_pool);
+    return 0;
+}
+
+static void pymp3_free(void *module)
+{
+    pymp3_state *state = (pymp3_state *) PyModule_GetState((PyObject *) module);
+
+    pymp3_clear((PyObject *) module);
+
+    if (state != NULL && state->stats_lock != NULL)
+    {
+        PyThread_free_lock(state->stats_lock);
+        state->stats_lock = NULL;
+    }
+
+    if (state != NULL && state->pool_lock != NULL)
+    {
+        PyThread_free_lock(state->pool_lock);
+        state->pool_lock = NULL;
+    }
+
+#if PY_VERSION_HEX < 0x03090000
+    if (pymp3_legacy_state == state)
+        pymp3_legacy_state = NULL;
+#endif
+}
+
+static PyModuleDef_Slot pymp3_slots[] = {
+    { Py_mod_exec, (void *) pymp3_exec },
+#ifdef Py_mod_multiple_interpreters
+    /* No global state: each interpreter has its own classes in the module state */
+    { Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED },
+#endif
+#ifdef Py_mod_gil
+    /* Encoder/Decoder objects are protected by per-object locks */
+    { Py_mod_gil, Py_MOD_GIL_NOT_USED },
+#endif
+    { 0, NULL }
+};
+
+/** The module definition */
+static struct PyModuleDef pymp3_module = {
+    PyModuleDef_HEAD_INIT,
+    module_name,
+    module_docstring,
+    sizeof(pymp3_state),
+    module_methods,
+    pymp3_slots,
+    pymp3_traverse,
+    pymp3_clear,
+    pymp3_free
+};
+
+/**
+ * Module initialisation function
+ *
+ * \return  The module definition (multi-phase initialisation)
+ */
+PyMODINIT_FUNC PyInit_mp3(void)
+{
+    return PyModuleDef_Init(&pymp3_module);
 }
@@ -1,5 +1,10 @@
 #pragma once
 
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "mp3_stats.h"
+
 enum pymp3_mpeg_layer {
   LAYER_I   = 1,			/* Layer I */
   LAYER_II  = 2,			/* Layer II */
@@ -11,4 +16,117 @@ enum pymp3_mpeg_mode {
   MODE_DUAL_CHANNEL	  = 1,		/* dual channel */
   MODE_JOINT_STEREO	  = 2,		/* joint (MS/intensity) stereo */
   MODE_STEREO	  = 3		/* normal LR stereo */
-};
\ No newline at end of file
+};
+
+enum pymp3_decoder_backend {
+  BACKEND_LIBMAD  = 0,		/* libmad, fixed-point synthesis (default) */
+  BACKEND_MINIMP3 = 1		/* minimp3, floating-point SIMD synthesis */
+};
+
+/* Whether the optional decoder backends are built in */
+#ifdef PYMP3_WITH_MINIMP3
+#define PYMP3_HAVE_MINIMP3 1
+#else
+#define PYMP3_HAVE_MINIMP3 0
+#endif
+
+
+/* Flags of the heap types exported by the module */
+#ifdef Py_TPFLAGS_IMMUTABLETYPE
+#define PYMP3_TPFLAGS (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE)
+#else
+#define PYMP3_TPFLAGS Py_TPFLAGS_DEFAULT
+#endif
+
+/* Per-module state */
+typedef struct {
+    PyObject *EncoderType;
+    PyObject *DecoderType;
+
+    /* Module-wide aggregates of performance counters of all objects, protected by stats_lock */
+    PyThread_type_lock stats_lock;
+    pymp3_stats decoder_stats;
+    pymp3_stats encoder_stats;
+
+    /* Native memory (in bytes) held by all live Decoder/Encoder objects, protected by stats_lock */
+    unsigned long long decoder_memory;
+    unsigned long long encoder_memory;
+
+    /* Collect timers in addition to counters (atomic) */
+    int timers;
+
+    /* Idle encoders: dict of (sample_rate, channels, bit_rate, quality) -> list of encoders, protected by pool_lock */
+    PyObject *encoder_pool;
+    PyThread_type_lock pool_lock;
+} pymp3_state;
+
+/* Relaxed atomic access to fields, which are read and written by threads without a common lock (free-threaded builds) */
+#if PY_VERSION_HEX >= 0x030D0000 && !defined(PYPY_VERSION)
+#define PYMP3_ATOMIC_LOAD_INT(ptr) _Py_atomic_load_int_relaxed(ptr)
+#define PYMP3_ATOMIC_STORE_INT(ptr, value) _Py_atomic_store_int_relaxed(ptr, value)
+#define PYMP3_ATOMIC_EXCHANGE_INT(ptr, value) _Py_atomic_exchange_int(ptr, value)
+#define PYMP3_ATOMIC_LOAD_ULONG(ptr) _Py_atomic_load_ulong_relaxed(ptr)
+#define PYMP3_ATOMIC_STORE_ULONG(ptr, value) _Py_atomic_store_ulong_relaxed(ptr, value)
+#else
+/* The GIL serializes the access */
+#define PYMP3_ATOMIC_LOAD_INT(ptr) (*(ptr))
+#define PYMP3_ATOMIC_STORE_INT(ptr, value) (*(ptr) = (value))
+#define PYMP3_ATOMIC_EXCHANGE_INT(ptr, value) pymp3_exchange_int(ptr, value)
+#define PYMP3_ATOMIC_LOAD_ULONG(ptr) (*(ptr))
+#define PYMP3_ATOMIC_STORE_ULONG(ptr, value) (*(ptr) = (value))
+
+static inline int pymp3_exchange_int(int *ptr, int value)
+{
+    int previous = *ptr;
+    *ptr = value;
+    return previous;
+}
+#endif
+
+/* Whether timers are enabled in the module state (NULL-safe) */
+#define PYMP3_TIMERS_ENABLED(state) ((state) != NULL && PYMP3_ATOMIC_LOAD_INT(&(state)->timers))
+
+/* Get the state of the module, which defines the type */
+pymp3_state* pymp3_get_state(PyTypeObject *type);
+
+/* Module-wide statistics */
+void pymp3_stats_publish(pymp3_state *state, pymp3_stats_kind_t kind, const pymp3_stats *stats, pymp3_stats *published);
+void pymp3_stats_snapshot(pymp3_state *state, const pymp3_stats *published, pymp3_stats *snapshot);
+PyObject* pymp3_module_stats(PyObject *module, PyObject *args);
+PyObject* pymp3_module_reset_stats(PyObject *module, PyObject *args);
+PyObject* pymp3_module_enable_timers(PyObject *module, PyObject *args);
+
+/* Module-wide accounting of native memory */
+void pymp3_memory_publish(pymp3_state *state, pymp3_stats_kind_t kind, size_t memory, size_t *published);
+PyObject* pymp3_module_memory_usage(PyObject *module, PyObject *args);
+
+/* Validation of MPEG audio stream by frame headers */
+PyObject* pymp3_probe(PyObject *module, PyObject *args, PyObject *kwds);
+
+/* Transcoding of MP3 data (libmad to LAME) */
+PyObject* pymp3_transcode(PyObject *module, PyObject *args, PyObject *kwds);
+
+/* Frame-level editing of MP3 data (without decoding) */
+PyObject* pymp3_cut(PyObject *module, PyObject *args, PyObject *kwds);
+PyObject* pymp3_concat(PyObject *module, PyObject *args, PyObject *kwds);
+
+/* Waveform summary of MP3 data */
+PyObject* pymp3_peaks(PyObject *module, PyObject *args, PyObject *kwds);
+
+/* Pool of encoders */
+PyObject* pymp3_acquire_encoder(PyObject *module, PyObject *args, PyObject *kwds);
+PyObject* pymp3_release_encoder(PyObject *module, PyObject *encoder);
+
+/* Per-object lock, which serializes method calls on Encoder/Decoder objects (with or without the GIL) */
+typedef struct {
+    PyThread_type_lock lock;
+    unsigned long owner;    /* thread holding the lock, used to detect reentrant calls (atomic) */
+} pymp3_lock;
+
+int pymp3_lock_init(pymp3_lock *lock);
+void pymp3_lock_free(pymp3_lock *lock);
+int pymp3_lock_acquire(pymp3_lock *lock, PyObject *obj);
+void pymp3_lock_release(pymp3_lock *lock);
+
+/* Calls the regular constructor (tp_new and tp_init) of a type with vectorcall arguments */
+PyObject* pymp3_vectorcall_fallback(PyTypeObject *type, PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames);
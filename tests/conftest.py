@@ -0,0 +1,33 @@
+from array import array
+from io import BytesIO
+import math
+import sys
+import pytest
+
+import mp3
+
+
+def _encode_sine(duration_s, sample_rate=44100, channels=1, bit_rate=128, amplitude=8000):
+    samples = array('h')
+    for i in range(int(sample_rate * duration_s)):
+        value = int(amplitude * math.sin(2 * math.pi * 440 * i / sample_rate))
+        samples.extend([value] * channels)
+    if sys.byteorder != 'little':
+        samples.byteswap()
+
+    mp3_fp = BytesIO()
+    writer = mp3.Encoder(mp3_fp)
+    writer.set_channels(channels)
+    writer.set_sample_rate(sample_rate)
+    writer.set_bit_rate(bit_rate)
+    writer.write(samples.tobytes())
+    writer.flush()
+    return mp3_fp.getvalue()
+
+
+@pytest.fixture
+def encode_sine():
+    """
+    MP3 data of a 440 Hz sine wave: encode_sine(duration_s, sample_rate=44100, channels=1, bit_rate=128, amplitude=8000)
+    """
+    return _encode_sine
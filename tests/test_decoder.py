@@ -1,4 +1,6 @@
+import bz2
 import codecs
+import gzip
 from io import BytesIO
 import os
 import pytest
@@ -229,6 +231,21 @@ def test_decoder_invalid_file_object_read_attr():
         reader.read(1152)
 
 
+def test_decoder_invalid_arguments():
+    """
+    Testing the constructor without a file-like object, and with optional arguments of wrong types
+
+    EXPECTED: ValueError without a file-like object, TypeError of the argument parser for invalid types
+    """
+    with pytest.raises(ValueError):
+        mp3.Decoder()
+
+    for kwargs in ({'chunk_size': 'large'}, {'backend': 'minimp3'}, {'memory_limit': 1.5}, {'read_ahead': '4'}):
+        with pytest.raises(TypeError) as excinfo:
+            mp3.Decoder(BytesIO(b''), **kwargs)
+        assert 'File-like object' not in str(excinfo.value)
+
+
 def test_decoder_partially_corrupted_file():
     """
     Test decodding mp3 file with some MP3 frames corrupted.
@@ -274,3 +291,720 @@ def test_decoder_invalid_file_open_mode():
 
         with pytest.raises(RuntimeError):
             reader.read(1152)
+
+
+def test_decoder_decode_frame():
+    """
+    Test decoding MP3 file frame by frame.
+
+    EXPECTED: each call returns PCM data of exactly one MPEG frame together with its header.
+    """
+
+    # MPEG-2 Layer III (8000 Hz) has 576 samples per frame
+    # Frame size is 72 * 24000 / 8000 = 216 bytes (+1 byte if padded)
+    SAMPLE_MP3_FILE_PATH = os.path.join(os.path.dirname(__file__), 'data', 'silence-8KHz-stereo-24kbps-0.4s.mp3')
+
+    with open(SAMPLE_MP3_FILE_PATH, 'rb') as mp3_file:
+        reader = mp3.Decoder(mp3_file)
+
+        decoded_data = b''
+        offsets = []
+        while True:
+            frame = reader.decode_frame()
+            if frame is None:
+                break
+
+            pcm_data, header = frame
+            assert header['samples'] == 576
+            assert header['sample_rate'] == 8000
+            assert len(pcm_data) == 576*2*2
+
+            offsets.append(header['offset'])
+            decoded_data += pcm_data
+
+        assert len(decoded_data) == 4032*2*2
+        assert decoded_data[:32] == b'\x00'*32
+
+        # Frames are reported at increasing byte offsets
+        assert len(offsets) == 7
+        assert all(b - a in (216, 217) for a, b in zip(offsets[1:], offsets[2:]))
+
+        assert reader.decode_frame() is None, "Should return None after EOF"
+
+
+def test_decoder_decode_frame_after_read():
+    """
+    Test mixing read() and decode_frame() calls.
+
+    EXPECTED: decode_frame() returns the remainder of a frame partially consumed by read().
+    """
+
+    SAMPLE_MP3_FILE_PATH = os.path.join(os.path.dirname(__file__), 'data', 'silence-8KHz-stereo-24kbps-0.4s.mp3')
+
+    with open(SAMPLE_MP3_FILE_PATH, 'rb') as mp3_file:
+        reader = mp3.Decoder(mp3_file)
+
+        decoded_data = reader.read(100)
+        assert len(decoded_data) == 100
+
+        pcm_data, header = reader.decode_frame()
+        assert len(pcm_data) == 576*2*2 - 100
+        decoded_data += pcm_data
+
+        decoded_data += reader.read()
+        assert len(decoded_data) == 4032*2*2
+
+
+def test_decoder_iterator():
+    """
+    Test iterating over decoder.
+
+    EXPECTED: iterator yields chunks of whole MPEG frames, at least `chunk_size` bytes each (except the last one).
+    """
+
+    SAMPLE_MP3_FILE_PATH = os.path.join(os.path.dirname(__file__), 'data', 'silence-8KHz-stereo-24kbps-0.4s.mp3')
+
+    with open(SAMPLE_MP3_FILE_PATH, 'rb') as mp3_file:
+        reader = mp3.Decoder(mp3_file, chunk_size=4000)
+
+        chunks = list(reader)
+
+        # One frame is 576 samples, stereo 16-bit, i.e. 2 frames per chunk
+        assert [len(chunk) for chunk in chunks] == [4608, 4608, 4608, 2304]
+        assert b''.join(chunks)[:32] == b'\x00'*32
+
+        assert reader.read(100) == b'', "Should return empty data after the end of iteration"
+
+    with pytest.raises(ValueError):
+        mp3.Decoder(BytesIO(b''), chunk_size=0)
+
+
+def test_decoder_readinto():
+    """
+    Test reading decoded audio into a pre-allocated buffer.
+    """
+
+    SAMPLE_MP3_FILE_PATH = os.path.join(os.path.dirname(__file__), 'data', 'silence-8KHz-stereo-24kbps-0.4s.mp3')
+
+    with open(SAMPLE_MP3_FILE_PATH, 'rb') as mp3_file:
+        reader = mp3.Decoder(mp3_file)
+
+        buffer = bytearray(1000)
+        view = memoryview(buffer)
+
+        total_size = 0
+        while True:
+            size = reader.readinto(view)
+            if size == 0:
+                break
+            assert buffer[:32] == b'\x00'*32
+            total_size += size
+
+        assert total_size == 4032*2*2
+
+        with pytest.raises(BufferError):
+            reader.readinto(b'read-only buffer')
+
+        with pytest.raises(TypeError):
+            reader.read(1, 2)
+
+
+def test_decoder_threads():
+    """
+    Test concurrent reads from several threads and a reentrant call from a read() method of the file-like object.
+
+    EXPECTED: calls on the same decoder are serialized, all decoded data is returned exactly once.
+    """
+    import threading
+
+    SAMPLE_MP3_FILE_PATH = os.path.join(os.path.dirname(__file__), 'data', 'silence-8KHz-stereo-24kbps-0.4s.mp3')
+
+    with open(SAMPLE_MP3_FILE_PATH, 'rb') as mp3_file:
+        reader = mp3.Decoder(mp3_file)
+
+        sizes = []
+
+        def worker():
+            while True:
+                data = reader.read(1000)
+                if not data:
+                    break
+                sizes.append(len(data))
+
+        threads = [threading.Thread(target=worker) for _ in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+        assert sum(sizes) == 4032*4
+
+    class ReentrantFile(BytesIO):
+        def read(self, size=-1):
+            return decoder.read(10)
+
+    decoder = mp3.Decoder(ReentrantFile(b''))
+    with pytest.raises(RuntimeError):
+        decoder.read(10)
+
+
+def test_decoder_stats():
+    """
+    Test performance counters of the decoder and module-wide aggregates.
+
+    EXPECTED: counters reflect the decoded data, timers are collected only when enabled.
+    """
+
+    SAMPLE_MP3_FILE_PATH = os.path.join(os.path.dirname(__file__), 'data', 'silence-8KHz-stereo-24kbps-0.4s.mp3')
+
+    mp3.reset_stats()
+    previous = mp3.enable_timers(True)
+    try:
+        with open(SAMPLE_MP3_FILE_PATH, 'rb') as mp3_file:
+            reader = mp3.Decoder(mp3_file)
+            decoded_data = reader.read()
+
+        stats = reader.stats()
+        assert stats['bytes_in'] == os.path.getsize(SAMPLE_MP3_FILE_PATH)
+        assert stats['bytes_out'] == len(decoded_data)
+        assert stats['frames'] == 7
+        assert stats['read_calls'] >= 1
+        assert stats['decode_ns'] > 0
+        assert stats['synth_ns'] > 0
+
+        module_stats = mp3.stats()
+        assert module_stats['timers'] is True
+        assert module_stats['decoder']['frames'] >= stats['frames']
+        assert module_stats['decoder']['bytes_out'] >= stats['bytes_out']
+    finally:
+        mp3.enable_timers(previous)
+
+    with open(SAMPLE_MP3_FILE_PATH, 'rb') as mp3_file:
+        reader = mp3.Decoder(mp3_file)
+        reader.read()
+    assert reader.stats()['decode_ns'] == 0, "Timers must be disabled"
+
+
+def test_decoder_reset():
+    """
+    Test reusing the decoder for several files with reset().
+
+    EXPECTED: the format is detected again and each file is decoded completely.
+    """
+
+    STEREO_MP3_FILE_PATH = os.path.join(os.path.dirname(__file__), 'data', 'silence-8KHz-stereo-24kbps-0.4s.mp3')
+    MONO_MP3_FILE_PATH = os.path.join(os.path.dirname(__file__), 'data', 'silence-16KHz-mono-32kbps-0.6s.mp3')
+
+    with open(STEREO_MP3_FILE_PATH, 'rb') as mp3_file:
+        stereo_data = mp3_file.read()
+
+    with open(MONO_MP3_FILE_PATH, 'rb') as mp3_file:
+        mono_data = mp3_file.read()
+
+    reader = mp3.Decoder(BytesIO(stereo_data))
+    expected_stereo = reader.read()
+
+    reader.reset(BytesIO(mono_data))
+    assert reader.is_valid()
+    assert reader.get_channels() == 1
+    assert reader.get_sample_rate() == 16000
+    expected_mono = mp3.Decoder(BytesIO(mono_data)).read()
+    assert reader.read() == expected_mono
+
+    # Reset in the middle of a file
+    reader.reset(BytesIO(stereo_data))
+    reader.read(100)
+    reader.reset(BytesIO(stereo_data))
+    assert reader.get_channels() == 2
+    assert reader.get_sample_rate() == 8000
+    assert reader.read() == expected_stereo
+
+    reader.reset(BytesIO(b'\x00' * 8000))
+    assert not reader.is_valid()
+    assert reader.get_channels() == 0
+    assert reader.read(512) == b''
+
+    with pytest.raises(TypeError):
+        reader.reset(object())
+
+
+def test_decoder_resilient(encode_sine):
+    """
+    Test decoding of a corrupted stream in resilient mode
+
+    EXPECTED: lost frames are replaced with silence, and the damaged ranges are reported
+    """
+
+    mp3_data = encode_sine(3.0)
+
+    clean_reader = mp3.Decoder(BytesIO(mp3_data))
+    offsets = []
+    while True:
+        frame = clean_reader.decode_frame()
+        if frame is None:
+            break
+        offsets.append(frame[1]['offset'])
+    clean_pcm = mp3.Decoder(BytesIO(mp3_data)).read()
+
+    # Overwrite frames 40-42 with data without frame sync, and insert junk before frame 80
+    junk = bytes(i % 255 for i in range(offsets[43] - offsets[40]))
+    corrupted_data = mp3_data[:offsets[40]] + junk + mp3_data[offsets[43]:offsets[80]] + b'\x00' * 100 + mp3_data[offsets[80]:]
+
+    # Frames are dropped in the regular mode
+    assert len(mp3.Decoder(BytesIO(corrupted_data)).read()) < len(clean_pcm)
+
+    reader = mp3.Decoder(BytesIO(corrupted_data), resilient=True)
+    pcm_data = reader.read()
+    assert len(pcm_data) == len(clean_pcm)
+    assert pcm_data[:40 * MPEG_FRAME_SIZE * 2] == clean_pcm[:40 * MPEG_FRAME_SIZE * 2]
+
+    damage = reader.get_damaged_ranges()
+    assert len(damage) == 2
+
+    start_byte, end_byte, start_sample, end_sample = damage[0]
+    assert start_byte == offsets[40]
+    assert end_byte >= offsets[43]      # The next frame can be lost as well, if it refers to the bit reservoir of the damaged frames
+    assert start_sample == 40 * MPEG_FRAME_SIZE
+    assert end_sample >= 43 * MPEG_FRAME_SIZE
+    assert (end_sample - start_sample) % MPEG_FRAME_SIZE == 0
+    assert pcm_data[start_sample * 2:end_sample * 2] == b'\x00' * ((end_sample - start_sample) * 2)
+
+    # Junk between frames doesn't shift the timeline
+    assert damage[1] == (offsets[80], offsets[80] + 100, 80 * MPEG_FRAME_SIZE, 80 * MPEG_FRAME_SIZE)
+
+    reader.reset(BytesIO(mp3_data))
+    assert reader.get_damaged_ranges() == []
+    assert reader.read() == clean_pcm
+
+
+def test_decoder_resilient_tags(encode_sine):
+    """
+    Test decoding of a stream with tags and a long run of junk between frames in resilient mode
+
+    EXPECTED: tags are not reported as damage, and the silence inserted for the junk is capped at 500 frames
+    """
+    import struct
+
+    mp3_data = encode_sine(3.0)
+
+    clean_reader = mp3.Decoder(BytesIO(mp3_data))
+    offsets = []
+    while True:
+        frame = clean_reader.decode_frame()
+        if frame is None:
+            break
+        offsets.append(frame[1]['offset'])
+    clean_pcm = mp3.Decoder(BytesIO(mp3_data)).read()
+
+    # ID3v2.4 tag with 2048 bytes of padding (syncsafe size), and APE tag with a header, 100 bytes of items and a footer
+    id3_tag = b'ID3\x04\x00\x00\x00\x00\x10\x00' + b'\x00' * 2048
+    ape_tag = (b'APETAGEX' + struct.pack('<IIII', 2000, 132, 0, 0xa0000000) + b'\x00' * 8 + b'\x00' * 100 +
+               b'APETAGEX' + struct.pack('<IIII', 2000, 132, 0, 0x80000000) + b'\x00' * 8)
+    junk = bytes(i % 255 for i in range(4 * 1024 * 1024))
+
+    corrupted_data = (mp3_data[:offsets[40]] + id3_tag + mp3_data[offsets[40]:offsets[60]] + ape_tag +
+                      mp3_data[offsets[60]:offsets[80]] + junk + mp3_data[offsets[80]:])
+
+    reader = mp3.Decoder(BytesIO(corrupted_data), resilient=True)
+    pcm_data = reader.read()
+
+    damage = reader.get_damaged_ranges()
+    assert len(damage) == 1
+
+    start_byte, end_byte, start_sample, end_sample = damage[0]
+    assert start_byte == offsets[80] + len(id3_tag) + len(ape_tag)
+    assert end_byte == start_byte + len(junk)
+    assert start_sample == 80 * MPEG_FRAME_SIZE
+    assert end_sample - start_sample == 500 * MPEG_FRAME_SIZE
+
+    assert len(pcm_data) == len(clean_pcm) + 500 * MPEG_FRAME_SIZE * 2
+    assert pcm_data[:start_sample * 2] == clean_pcm[:start_sample * 2]
+    assert pcm_data[start_sample * 2:end_sample * 2] == b'\x00' * ((end_sample - start_sample) * 2)
+
+    # The silence is emitted frame by frame, so it fits in a small memory limit
+    reader = mp3.Decoder(BytesIO(corrupted_data), resilient=True, memory_limit=128 * 1024)
+    chunks = []
+    while True:
+        chunk = reader.read(8192)
+        if not chunk:
+            break
+        chunks.append(chunk)
+    assert b''.join(chunks) == pcm_data
+
+
+def test_decoder_levels():
+    """
+    Test measuring of frame levels without synthesis (1s of silence, 1s of a sine wave, 1s of silence)
+
+    EXPECTED: levels match RMS of the decoded PCM data of each frame
+    """
+    import math
+    import sys
+    from array import array
+
+    sample_rate = 16000
+    samples = array('h', [0] * sample_rate)
+    samples.extend(int(8000 * math.sin(2 * math.pi * 440 * i / sample_rate)) for i in range(sample_rate))
+    samples.extend([0] * sample_rate)
+    if sys.byteorder != 'little':
+        samples.byteswap()
+
+    mp3_fp = BytesIO()
+    writer = mp3.Encoder(mp3_fp)
+    writer.set_channels(1)
+    writer.set_sample_rate(sample_rate)
+    writer.set_bit_rate(32)
+    writer.write(samples.tobytes())
+    writer.flush()
+    mp3_data = mp3_fp.getvalue()
+
+    # Reference levels from the PCM data of each frame
+    reference = []
+    reader = mp3.Decoder(BytesIO(mp3_data))
+    while True:
+        frame = reader.decode_frame()
+        if frame is None:
+            break
+        pcm = array('h', frame[0])
+        if sys.byteorder != 'little':
+            pcm.byteswap()
+        mean_square = sum(x * x for x in pcm) / (len(pcm) * 32768.0 * 32768.0)
+        reference.append(10 * math.log10(mean_square) if mean_square > 0 else -120.0)
+
+    reader = mp3.Decoder(BytesIO(mp3_data))
+    levels = reader.read_levels()
+    assert len(levels) == len(reference)
+    assert reader.read_levels() == []
+
+    # A sine wave of the amplitude 8000 is -15.3 dBFS
+    loud = [i for i, level in enumerate(reference) if abs(level + 15.3) < 0.5]
+    silent = [i for i, level in enumerate(reference) if level < -90]
+    assert len(loud) > 20 and len(silent) > 40
+    for i in loud:
+        assert levels[i] == pytest.approx(reference[i], abs=1.0)
+    for i in silent:
+        assert levels[i] < -60
+
+    # A limited number of frames, and reading of PCM data after the analysis
+    reader = mp3.Decoder(BytesIO(mp3_data))
+    assert len(reader.read_levels(10)) == 10
+    assert len(reader.read()) == (len(reference) - 10) * 576 * 2
+
+
+def test_decoder_channels():
+    """
+    Test selection of channels and planar output (a sine wave in the left channel, a sine wave of another frequency in the right channel)
+
+    EXPECTED: the selected channels are the same as the channels of the interleaved output
+    """
+    import math
+    import sys
+    from array import array
+
+    sample_rate = 44100
+    samples = array('h')
+    for i in range(sample_rate):
+        samples.append(int(8000 * math.sin(2 * math.pi * 440 * i / sample_rate)))
+        samples.append(int(4000 * math.sin(2 * math.pi * 1000 * i / sample_rate)))
+    if sys.byteorder != 'little':
+        samples.byteswap()
+
+    mp3_fp = BytesIO()
+    writer = mp3.Encoder(mp3_fp)
+    writer.set_channels(2)
+    writer.set_sample_rate(sample_rate)
+    writer.set_mode(mp3.MODE_STEREO)
+    writer.set_bit_rate(128)
+    writer.write(samples.tobytes())
+    writer.flush()
+    mp3_data = mp3_fp.getvalue()
+
+    pcm = array('h', mp3.Decoder(BytesIO(mp3_data)).read())
+    left = pcm[0::2].tobytes()
+    right = pcm[1::2].tobytes()
+
+    reader = mp3.Decoder(BytesIO(mp3_data), channels=[1])
+    assert reader.get_channels() == 1
+    assert reader.read() == right
+
+    reader = mp3.Decoder(BytesIO(mp3_data), channels=[0])
+    assert reader.read() == left
+
+    swapped = array('h', mp3.Decoder(BytesIO(mp3_data), channels=(1, 0)).read())
+    assert swapped[0::2].tobytes() == right
+    assert swapped[1::2].tobytes() == left
+
+    # Planar output, after a part of the first frame is read as interleaved data
+    reader = mp3.Decoder(BytesIO(mp3_data))
+    head = array('h', reader.read(400))
+    planes = reader.read_planar(10)
+    assert len(planes) == 2
+    assert len(planes[0]) == len(planes[1]) == 1152 * 2 * 11 - 200
+    rest = reader.read_planar()
+    assert head[0::2].tobytes() + planes[0] + rest[0] == left
+    assert head[1::2].tobytes() + planes[1] + rest[1] == right
+    assert reader.read_planar() == (b'', b'')
+
+    planes = mp3.Decoder(BytesIO(mp3_data), channels=[1]).read_planar()
+    assert planes == (right,)
+
+    for channels in ([], [2], [0, 1, 0], ['left']):
+        with pytest.raises(ValueError):
+            mp3.Decoder(BytesIO(mp3_data), channels=channels)
+
+
+def test_decoder_half_rate(encode_sine):
+    """
+    Test decoding with half sample rate synthesis
+
+    EXPECTED: the output has half of the samples and the same waveform envelope as the full rate output
+    """
+    import math
+    import sys
+    from array import array
+
+    mp3_data = encode_sine(2.0)
+
+    full_reader = mp3.Decoder(BytesIO(mp3_data))
+    full = array('h', full_reader.read())
+
+    reader = mp3.Decoder(BytesIO(mp3_data), half_rate=True)
+    assert reader.get_sample_rate() == full_reader.get_sample_rate() // 2
+    half = array('h', reader.read())
+    assert len(half) * 2 == len(full)
+
+    if sys.byteorder != 'little':
+        full.byteswap()
+        half.byteswap()
+
+    # Envelope for waveform rendering: RMS and peak of blocks of 1/20 s
+    def envelope(samples, block):
+        for pos in range(0, len(samples) - block + 1, block):
+            chunk = samples[pos:pos + block]
+            yield math.sqrt(sum(x * x for x in chunk) / block), max(abs(x) for x in chunk)
+
+    for (full_rms, full_peak), (half_rms, half_peak) in zip(envelope(full, 2204), envelope(half, 1102)):
+        assert half_rms == pytest.approx(full_rms, rel=0.05, abs=10)
+        assert half_peak == pytest.approx(full_peak, rel=0.05, abs=10)
+
+    # The option is kept by reset()
+    reader.reset(BytesIO(mp3_data))
+    assert reader.get_sample_rate() == full_reader.get_sample_rate() // 2
+    assert len(reader.read()) == len(half) * 2
+
+    if mp3.BACKEND_MINIMP3 in mp3.BACKENDS:
+        with pytest.raises(ValueError):
+            mp3.Decoder(BytesIO(mp3_data), backend=mp3.BACKEND_MINIMP3, half_rate=True)
+
+
+def test_decoder_memory_limit(encode_sine):
+    """
+    Test decoding within a memory limit, and the module-wide accounting of native memory
+
+    EXPECTED: read(), iteration and read_planar() return partial data within the limit, which joins into the same audio
+    as without the limit. Native buffers of live decoders and encoders are counted by mp3.memory_usage()
+    """
+    import gc
+
+    mp3_data = encode_sine(10.0)
+    expected = mp3.Decoder(BytesIO(mp3_data)).read()
+    assert len(expected) > 800000
+
+    gc.collect()
+    before = mp3.memory_usage()
+
+    limit = 128 * 1024
+    reader = mp3.Decoder(BytesIO(mp3_data), chunk_size=1024 * 1024, memory_limit=limit)
+    usage = mp3.memory_usage()
+    assert usage['decoder'] > before['decoder']
+    assert usage['total'] == usage['decoder'] + usage['encoder']
+
+    blocks = []
+    while True:
+        block = reader.read()
+        if not block:
+            break
+        assert len(block) <= limit
+        blocks.append(block)
+    assert len(blocks) > 1
+    assert b''.join(blocks) == expected
+
+    # Chunks of the iterator are smaller than chunk_size
+    reader.reset(BytesIO(mp3_data))
+    chunks = list(reader)
+    assert all(len(chunk) <= limit // 2 for chunk in chunks)
+    assert b''.join(chunks) == expected
+
+    reader.reset(BytesIO(mp3_data))
+    planes = []
+    while True:
+        plane, = reader.read_planar()
+        if not plane:
+            break
+        assert len(plane) <= limit
+        planes.append(plane)
+    assert b''.join(planes) == expected
+
+    writer = mp3.Encoder(BytesIO())
+    writer.set_channels(1)
+    writer.write(expected)
+    assert mp3.memory_usage()['encoder'] > before['encoder']
+
+    del reader, writer
+    assert mp3.memory_usage() == before
+
+    # With the minimum limit, decoding stops while the output buffer is full, and continues in the next call
+    reader = mp3.Decoder(BytesIO(mp3_data), chunk_size=1024 * 1024, memory_limit=64 * 1024, resilient=True)
+    chunks = list(reader)
+    assert len(chunks) > 1
+    assert b''.join(chunks) == expected
+
+    with pytest.raises(ValueError):
+        mp3.Decoder(BytesIO(mp3_data), memory_limit=1024)
+    with pytest.raises(ValueError):
+        mp3.Decoder(BytesIO(mp3_data), memory_limit=-1)
+
+
+def test_decoder_buffers(encode_sine):
+    """
+    Test the allocator of native buffers: tracing by tracemalloc, and per-thread pools of buffers
+
+    EXPECTED: the input and output buffers of decoders (at least 10 KB) are traced in addition to the objects,
+    and decoding with the pools gives the same audio
+    """
+    import sys
+    import threading
+    import tracemalloc
+
+    mp3_data = encode_sine(1.0, sample_rate=16000, bit_rate=32)
+    expected = mp3.Decoder(BytesIO(mp3_data)).read()
+
+    tracemalloc.start()
+    try:
+        before = tracemalloc.get_traced_memory()[0]
+        readers = [mp3.Decoder(BytesIO(mp3_data)) for _ in range(10)]
+        traced = tracemalloc.get_traced_memory()[0] - before
+    finally:
+        tracemalloc.stop()
+    assert traced >= len(readers) * (sys.getsizeof(readers[0]) + 10 * 1024)
+    del readers
+
+    results = []
+
+    def decode():
+        for _ in range(20):
+            results.append(mp3.Decoder(BytesIO(mp3_data)).read())
+
+    previous = mp3.enable_buffer_pool(True)
+    try:
+        threads = [threading.Thread(target=decode) for _ in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        decode()
+    finally:
+        assert mp3.enable_buffer_pool(previous) is True
+
+    assert len(results) == 100
+    assert all(result == expected for result in results)
+
+
+def test_decoder_read_ahead(tmp_path, encode_sine):
+    """
+    Test decoding of a file read ahead by a background thread
+
+    EXPECTED: the audio is the same as with synchronous reads, read() of the file object is not called,
+    and the time stalled on input is counted. File-like objects without a file descriptor, and compressed files, are read synchronously
+    """
+    mp3_data = encode_sine(5.0)
+    expected = mp3.Decoder(BytesIO(mp3_data)).read()
+
+    path = tmp_path / 'sine.mp3'
+    path.write_bytes(b'\0' * 100 + mp3_data)
+
+    with open(path, 'rb') as fp:
+        # The thread starts at the current position of the file
+        fp.seek(100)
+        reader = mp3.Decoder(fp, read_ahead=4)
+        assert reader.read() == expected
+        stats = reader.stats()
+        assert stats['read_calls'] == 0
+        assert stats['bytes_in'] == len(mp3_data)
+        assert stats['read_stalls'] >= 0
+        assert stats['read_stall_ns'] >= 0
+        assert fp.tell() == 100
+
+        # The read-ahead is restarted for a new file
+        fp.seek(100)
+        reader.reset(fp)
+        assert b''.join(reader) == expected
+
+        # A file object without a file descriptor is read synchronously
+        reader.reset(BytesIO(mp3_data))
+        assert reader.read() == expected
+        assert reader.stats()['read_calls'] > 0
+        del reader
+
+    # Compressed files have a descriptor of the compressed data, they are read synchronously
+    for module in (gzip, bz2):
+        compressed_path = tmp_path / ('sine.mp3.' + module.__name__)
+        with module.open(compressed_path, 'wb') as fp:
+            fp.write(mp3_data)
+        with module.open(compressed_path, 'rb') as fp:
+            assert fp.fileno() >= 0
+            reader = mp3.Decoder(fp, read_ahead=4)
+            assert reader.read() == expected
+            assert reader.stats()['read_calls'] > 0
+            del reader
+
+    with pytest.raises(ValueError):
+        mp3.Decoder(BytesIO(mp3_data), read_ahead=-1)
+    with pytest.raises(ValueError):
+        mp3.Decoder(BytesIO(mp3_data), read_ahead=4, memory_limit=512 * 1024)
+
+
+@pytest.mark.skipif(mp3.BACKEND_MINIMP3 not in mp3.BACKENDS, reason="minimp3 backend is not built (PYMP3_WITH_MINIMP3)")
+def test_decoder_backends(encode_sine):
+    """
+    Test conformance of the decoder backends
+
+    EXPECTED: minimp3 decodes the same stream format, and its PCM data differs from libmad by a few LSB at most.
+    libmad doesn't decode the last frame of a file, so minimp3 returns at most one frame more.
+    """
+    from array import array
+
+    for sample_rate, bit_rate in ((44100, 128), (16000, 32), (8000, 16)):
+        mp3_data = encode_sine(2.0, sample_rate=sample_rate, bit_rate=bit_rate)
+
+        reader = mp3.Decoder(BytesIO(mp3_data))
+        expected = array('h', reader.read())
+
+        minimp3_reader = mp3.Decoder(BytesIO(mp3_data), backend=mp3.BACKEND_MINIMP3)
+        assert minimp3_reader.is_valid()
+        assert minimp3_reader.get_channels() == reader.get_channels()
+        assert minimp3_reader.get_sample_rate() == reader.get_sample_rate()
+        assert minimp3_reader.get_bit_rate() == reader.get_bit_rate()
+        assert minimp3_reader.get_mode() == reader.get_mode()
+        assert minimp3_reader.get_layer() == reader.get_layer()
+        actual = array('h', minimp3_reader.read())
+
+        assert 0 <= len(actual) - len(expected) <= MPEG_FRAME_SIZE
+        max_diff = max(abs(a - b) for a, b in zip(expected, actual))
+        assert max_diff <= 8, "Max difference between backends is {} LSB".format(max_diff)
+
+
+def test_decoder_backend_unavailable():
+    """
+    Test selection of a backend, which is not built in the module
+
+    EXPECTED: ValueError is raised
+    """
+    assert mp3.BACKEND_LIBMAD in mp3.BACKENDS
+
+    with pytest.raises(ValueError):
+        mp3.Decoder(BytesIO(b''), backend=100)
+
+    if mp3.BACKEND_MINIMP3 not in mp3.BACKENDS:
+        with pytest.raises(ValueError):
+            mp3.Decoder(BytesIO(b''), backend=mp3.BACKEND_MINIMP3)
@@ -0,0 +1,91 @@
+from io import BytesIO
+import os
+import pytest
+
+import mp3
+
+
+DATA_DIR = os.path.join(os.path.dirname(__file__), 'data')
+
+
+def _decode(mp3_data):
+    """
+    Decode MP3 data, return the duration (in seconds) and the number of errors reported by libmad
+    """
+    reader = mp3.Decoder(BytesIO(mp3_data))
+    pcm_data = reader.read()
+    duration = len(pcm_data) / (2.0 * reader.get_channels() * reader.get_sample_rate())
+    return duration, reader.stats()['sync_errors']
+
+
+def test_cut(encode_sine):
+    """
+    Test cutting of MP3 data at frame boundaries
+
+    EXPECTED: the output contains frames of the requested time range, the bit reservoir of the first frame is preserved
+    """
+    mp3_data = encode_sine(3.0, channels=2)
+
+    output = mp3.cut(mp3_data, None, 1.0, 2.0)
+    assert mp3.probe(output)['valid']
+    assert len(output) < len(mp3_data) / 2
+
+    duration, errors = _decode(output)
+    assert duration == pytest.approx(1.0, abs=0.1)
+    assert errors == 0, "The first frame must be decoded with its bit reservoir"
+
+    # Without the end, the rest of the source is copied
+    output_fp = BytesIO()
+    written = mp3.cut(BytesIO(mp3_data), output_fp, 2.0)
+    assert written == len(output_fp.getvalue())
+
+    duration, errors = _decode(output_fp.getvalue())
+    assert duration == pytest.approx(1.0, abs=0.1)
+    assert errors == 0
+
+    # The whole source is copied without changes
+    assert mp3.cut(mp3_data, None) == mp3_data
+
+
+def test_concat(encode_sine):
+    """
+    Test joining of MP3 data, including pieces produced by mp3.cut()
+
+    EXPECTED: the output contains all frames of the sources
+    """
+    mp3_data = encode_sine(3.0, channels=2)
+    pieces = [mp3.cut(mp3_data, None, 0.0, 1.0), BytesIO(mp3.cut(mp3_data, None, 1.0, 2.0)), encode_sine(1.0, channels=2)]
+
+    output = mp3.concat(pieces, None)
+    duration, errors = _decode(output)
+    assert duration == pytest.approx(3.0, abs=0.2)
+    assert errors == 0
+
+    output_fp = BytesIO()
+    assert mp3.concat([mp3_data, mp3_data], output_fp) == 2 * len(mp3_data)
+    assert output_fp.getvalue() == 2 * mp3_data
+
+
+def test_edit_errors(encode_sine):
+    """
+    Test editing of invalid data and sources of different formats
+
+    EXPECTED: ValueError/TypeError is raised
+    """
+    with open(os.path.join(DATA_DIR, 'silence-16KHz-mono-32kbps-0.6s.mp3'), 'rb') as mp3_file:
+        mono_data = mp3_file.read()
+
+    with pytest.raises(ValueError):
+        mp3.concat([encode_sine(0.5, channels=2), mono_data], None)
+
+    with pytest.raises(ValueError):
+        mp3.concat([], None)
+
+    with pytest.raises(ValueError):
+        mp3.cut(b'\x00' * 8000, None)
+
+    with pytest.raises(ValueError):
+        mp3.cut(mono_data, None, 0.5, 0.2)
+
+    with pytest.raises(TypeError):
+        mp3.cut(object(), None)
@@ -148,3 +148,277 @@ def test_encoder_mono():
 
 
 
+
+
+def test_encoder_low_latency():
+    """
+    Test the low-latency encoder profile.
+
+    EXPECTED: MP3 frames are written on every write() call, and
+    the number of samples buffered inside the encoder stays bounded.
+    """
+
+    sample_rate = 16000
+    channels = 1
+    bit_rate = 32
+
+    temp_fp = BytesIO()
+    writer = mp3.Encoder(temp_fp)
+
+    writer.set_channels(channels)
+    writer.set_sample_rate(sample_rate)
+    writer.set_bit_rate(bit_rate)
+    writer.set_mode(mp3.MODE_SINGLE_CHANNEL)
+    writer.set_low_latency(True)
+
+    assert writer.get_buffered_samples() == 0, "Nothing is buffered before the first write"
+    assert writer.get_frame_size() == 576, "The frame size is known before the first write"
+    assert writer.get_encoder_delay() > 0
+
+    # 20ms blocks, as in the real-time streaming
+    block_size = int(sample_rate / 1000) * 20 * 2 * channels
+
+    written_size = 0
+    for idx in range(50):
+        assert writer.write(b'\x00' * block_size) == block_size
+
+        frame_size = writer.get_frame_size()
+        buffered = writer.get_buffered_samples()
+        assert 0 <= buffered < 2 * frame_size + writer.get_encoder_delay(), "Iteration #%u" % idx
+
+        # After the initial encoder delay, every 2nd write (40ms) completes
+        # at least one MPEG frame (576 samples = 36ms)
+        if idx >= 5 and idx % 2 == 1:
+            assert len(temp_fp.getvalue()) > written_size, "Iteration #%u" % idx
+            written_size = len(temp_fp.getvalue())
+
+    assert writer.flush()
+
+    with pytest.raises(RuntimeError):
+        writer.set_low_latency(False)
+
+    mp3_info = mpeg_info.MPEGInfo(BytesIO(temp_fp.getvalue()))
+    assert mp3_info.sample_rate == 16000
+    assert mp3_info.layer == 3
+
+
+def test_encoder_write_buffer_objects():
+    """
+    Test encoding PCM data from objects supporting the buffer protocol.
+    """
+
+    temp_fp = BytesIO()
+    writer = mp3.Encoder(temp_fp)
+
+    writer.set_channels(2)
+    writer.set_sample_rate(8000)
+    writer.set_bit_rate(32)
+
+    pcm_data = bytearray(8000 * 2 * 2)   # 1 second of stereo audio
+
+    assert writer.write(pcm_data) == len(pcm_data)
+    assert writer.write(memoryview(pcm_data)[:4000]) == 4000
+    assert writer.flush()
+
+    with pytest.raises(TypeError):
+        writer.write(pcm_data, pcm_data)
+
+    mp3_info = mpeg_info.MPEGInfo(BytesIO(temp_fp.getvalue()))
+    assert mp3_info.sample_rate == 8000
+
+
+def test_encoder_stats():
+    """
+    Test performance counters of the encoder.
+
+    EXPECTED: counters reflect the encoded data.
+    """
+
+    temp_fp = BytesIO()
+    writer = mp3.Encoder(temp_fp)
+
+    writer.set_channels(1)
+    writer.set_sample_rate(8000)
+    writer.set_bit_rate(16)
+
+    pcm_data = bytes(8000 * 2)   # 1 second of mono audio
+    writer.write(pcm_data)
+    writer.flush()
+
+    stats = writer.stats()
+    assert stats['bytes_in'] == len(pcm_data)
+    assert stats['bytes_out'] == len(temp_fp.getvalue())
+    assert stats['frames'] > 0
+    assert stats['write_calls'] >= 1
+    assert stats['encode_ns'] == 0, "Timers are disabled by default"
+
+    assert mp3.stats()['encoder']['bytes_out'] >= stats['bytes_out']
+
+
+def _decoded_length(mp3_data):
+    decoder = mp3.Decoder(BytesIO(mp3_data))
+    return len(decoder.read())
+
+
+def test_encoder_reset():
+    """
+    Test reusing the encoder for several streams with reset().
+
+    EXPECTED: every stream is a complete MP3 file, not flushed data is flushed into the previous file.
+    The streams after reset() have all the audio (plus a little silence of the reused LAME encoder),
+    and the streams after reset(fresh=True) are the same as the stream of a new encoder.
+    """
+
+    pcm_data = bytes(8000 * 2)   # 1 second of mono audio
+
+    first_fp = BytesIO()
+    writer = mp3.Encoder(first_fp)
+    writer.set_channels(1)
+    writer.set_sample_rate(8000)
+    writer.set_bit_rate(16)
+    writer.write(pcm_data)
+
+    second_fp = BytesIO()
+    writer.reset(second_fp)
+    assert len(first_fp.getvalue()) > 0, "reset() must flush the previous stream"
+    writer.write(pcm_data)
+    writer.flush()
+
+    third_fp = BytesIO()
+    writer.reset(third_fp)
+    writer.write(pcm_data)
+    writer.flush()
+
+    fresh_fp = BytesIO()
+    writer.reset(fresh_fp, fresh=True)
+    writer.write(pcm_data)
+    writer.flush()
+
+    first_length = _decoded_length(first_fp.getvalue())
+    assert first_length >= len(pcm_data)
+    for fp in (second_fp, third_fp):
+        assert _decoded_length(fp.getvalue()) >= first_length
+        mp3_info = mpeg_info.MPEGInfo(BytesIO(fp.getvalue()))
+        assert mp3_info.sample_rate == 8000
+        assert mp3_info.bitrate == 16000
+    assert fresh_fp.getvalue() == first_fp.getvalue()
+
+    # Settings changed after reset() apply to the new stream
+    changed_fp = BytesIO()
+    writer.reset(changed_fp)
+    writer.set_bit_rate(32)
+    writer.write(pcm_data)
+    writer.flush()
+    assert mpeg_info.MPEGInfo(BytesIO(changed_fp.getvalue())).bitrate == 32000
+
+    with pytest.raises(TypeError):
+        writer.reset(object())
+
+
+def test_encoder_pool():
+    """
+    Test the pool of encoders.
+
+    EXPECTED: released encoders are handed out again for the same configuration, with the settings of the configuration
+    and the initialised LAME encoder. A released encoder can't be used nor released again until it is acquired.
+    """
+
+    pcm_data = bytes(16000 * 2 * 2)   # 1 second of stereo audio
+
+    first_fp = BytesIO()
+    writer = mp3.acquire_encoder(first_fp, sample_rate=16000, channels=2, bit_rate=32)
+    writer.write(pcm_data)
+    mp3.release_encoder(writer)
+    assert len(first_fp.getvalue()) > 0, "release_encoder() must flush the stream"
+
+    with pytest.raises(RuntimeError):
+        writer.write(pcm_data)
+    with pytest.raises(ValueError):
+        mp3.release_encoder(writer)
+
+    second_fp = BytesIO()
+    assert mp3.acquire_encoder(second_fp, sample_rate=16000, channels=2, bit_rate=32) is writer
+    writer.write(pcm_data)
+    writer.flush()
+    assert _decoded_length(second_fp.getvalue()) >= _decoded_length(first_fp.getvalue())
+
+    # Settings changed after acquire_encoder() are reverted by release_encoder()
+    writer.reset(BytesIO())
+    writer.set_bit_rate(64)
+    mp3.release_encoder(writer)
+    third_fp = BytesIO()
+    assert mp3.acquire_encoder(third_fp, sample_rate=16000, channels=2, bit_rate=32) is writer
+    writer.write(pcm_data)
+    mp3.release_encoder(writer)
+
+    for fp in (second_fp, third_fp):
+        mp3_info = mpeg_info.MPEGInfo(BytesIO(fp.getvalue()))
+        assert mp3_info.sample_rate == 16000
+        assert mp3_info.bitrate == 32000
+
+    other = mp3.acquire_encoder(BytesIO(), sample_rate=8000, channels=1, bit_rate=16)
+    assert other is not writer
+
+    with pytest.raises(ValueError):
+        mp3.release_encoder(mp3.Encoder(BytesIO()))
+
+
+def _sine_pcm(sample_rate, duration_s):
+    import math
+    from array import array
+    samples = array('h', (int(8000 * math.sin(2 * math.pi * 440 * i / sample_rate)) for i in range(int(sample_rate * duration_s))))
+    if sys.byteorder != 'little':
+        samples.byteswap()
+    return samples.tobytes()
+
+
+class _PipeWriter(object):
+    """File-like object, which is not seekable (like a pipe or a socket)"""
+    def __init__(self):
+        self.data = b''
+
+    def write(self, data):
+        self.data += data
+        return len(data)
+
+
+def test_encoder_vbr():
+    """
+    Test VBR and ABR encoding.
+
+    EXPECTED: the Xing tag is written into seekable files only, VBR mode can't be changed after the first write.
+    """
+
+    pcm_data = _sine_pcm(16000, 2.0)
+
+    for configure in (lambda writer: writer.set_vbr(4), lambda writer: writer.set_abr(48)):
+        temp_fp = BytesIO()
+        writer = mp3.Encoder(temp_fp)
+        writer.set_channels(1)
+        writer.set_sample_rate(16000)
+        configure(writer)
+        writer.set_min_bit_rate(16)
+        writer.set_max_bit_rate(128)
+        writer.write(pcm_data)
+        writer.flush()
+
+        mp3_data = temp_fp.getvalue()
+        assert b'Xing' in mp3_data[:200], "VBR tag must be written at the beginning of the file"
+        assert temp_fp.tell() == len(mp3_data), "The file position must be restored after writing the tag"
+        assert len(mp3.Decoder(BytesIO(mp3_data)).read()) >= len(pcm_data)
+
+        with pytest.raises(RuntimeError):
+            writer.set_vbr(2)
+
+    pipe = _PipeWriter()
+    writer = mp3.Encoder(pipe)
+    writer.set_channels(1)
+    writer.set_sample_rate(16000)
+    writer.set_vbr(4)
+    writer.write(pcm_data)
+    writer.flush()
+    assert b'Xing' not in pipe.data[:200], "VBR tag can't be written into not seekable files"
+    assert len(mp3.Decoder(BytesIO(pipe.data)).read()) >= len(pcm_data)
+
+    with pytest.raises(ValueError):
+        mp3.Encoder(BytesIO()).set_vbr(10)
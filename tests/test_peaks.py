@@ -0,0 +1,81 @@
+from array import array
+from io import BytesIO
+import math
+import sys
+import pytest
+
+import mp3
+
+
+def _points(peaks_data):
+    points = array('h', peaks_data)
+    if sys.byteorder != 'little':
+        points.byteswap()
+    return [tuple(points[i:i + 3]) for i in range(0, len(points), 3)]
+
+
+@pytest.mark.parametrize('channels', [1, 2])
+def test_peaks(channels, encode_sine):
+    """
+    Test the waveform summary against min/max/RMS of decoded PCM data
+
+    EXPECTED: one (min, max, RMS) point per 256 samples, equal to the values computed from PCM data of the Decoder
+    """
+    mp3_data = encode_sine(2.0, channels=channels, amplitude=16000)
+
+    points = _points(mp3.peaks(mp3_data))
+
+    reader = mp3.Decoder(BytesIO(mp3_data))
+    pcm = array('h', reader.read())
+    if sys.byteorder != 'little':
+        pcm.byteswap()
+
+    # The Decoder doesn't output the last frame, compare the common whole points
+    block = 256 * channels
+    expected_count = len(pcm) // block
+    assert len(points) > expected_count
+
+    for index in range(expected_count):
+        values = pcm[index * block:(index + 1) * block]
+        low, high, rms = points[index]
+        expected_rms = math.sqrt(sum(v * v for v in values) / len(values))
+        assert low == pytest.approx(min(values), abs=2)
+        assert high == pytest.approx(max(values), abs=2)
+        assert rms == pytest.approx(expected_rms, abs=2)
+
+    # The amplitude of the sine is reached after the encoder delay
+    assert min(p[0] for p in points) == pytest.approx(-16000, abs=1000)
+    assert max(p[1] for p in points) == pytest.approx(16000, abs=1000)
+
+
+def test_peaks_samples_per_point(encode_sine):
+    """
+    Test the number of points for other sizes of a point and a file-like source
+
+    EXPECTED: the last point covers the rest of the samples, the result is the same for bytes and file-like sources
+    """
+    mp3_data = encode_sine(1.0, sample_rate=16000)
+    samples = len(mp3.peaks(mp3_data, samples_per_point=1)) // 6
+
+    for samples_per_point in [100, 576, 1152, 10000, samples + 1]:
+        peaks_data = mp3.peaks(BytesIO(mp3_data), samples_per_point=samples_per_point)
+        assert len(peaks_data) == 6 * ((samples + samples_per_point - 1) // samples_per_point)
+        assert peaks_data == mp3.peaks(memoryview(mp3_data), samples_per_point)
+
+
+def test_peaks_errors(encode_sine):
+    """
+    Test invalid arguments and data
+
+    EXPECTED: ValueError for non-positive samples_per_point or no MPEG audio frames, TypeError for invalid source
+    """
+    mp3_data = encode_sine(0.5, sample_rate=16000)
+
+    with pytest.raises(ValueError):
+        mp3.peaks(mp3_data, samples_per_point=0)
+
+    with pytest.raises(ValueError):
+        mp3.peaks(b'\x00' * 10000)
+
+    with pytest.raises(TypeError):
+        mp3.peaks(12345)
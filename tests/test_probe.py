@@ -0,0 +1,78 @@
+from io import BytesIO
+import os
+import random
+import pytest
+
+import mp3
+
+
+DATA_DIR = os.path.join(os.path.dirname(__file__), 'data')
+
+
+def test_probe_valid_files():
+    """
+    Test probing of valid MP3 files (bytes and file-like objects).
+
+    EXPECTED: the format is detected from frame headers.
+    """
+
+    with open(os.path.join(DATA_DIR, 'silence-8KHz-stereo-24kbps-0.4s.mp3'), 'rb') as mp3_file:
+        info = mp3.probe(mp3_file)
+
+    assert info['valid']
+    assert info['version'] == 2.5
+    assert info['layer'] == mp3.LAYER_III
+    assert info['bit_rate'] == 24
+    assert info['sample_rate'] == 8000
+    assert info['channels'] == 2
+    assert info['samples_per_frame'] == 576
+    assert info['offset'] == 0
+
+    with open(os.path.join(DATA_DIR, 'silence-16KHz-mono-32kbps-0.6s.mp3'), 'rb') as mp3_file:
+        info = mp3.probe(mp3_file.read())
+
+    assert info['valid']
+    assert info['sample_rate'] == 16000
+    assert info['channels'] == 1
+    assert info['mode'] == mp3.MODE_SINGLE_CHANNEL
+
+
+def test_probe_id3v2():
+    """
+    Test probing of MP3 data with ID3v2 tag.
+
+    EXPECTED: the tag is skipped, even if it is larger than max_bytes (for seekable files).
+    """
+
+    with open(os.path.join(DATA_DIR, 'silence-8KHz-stereo-24kbps-0.4s.mp3'), 'rb') as mp3_file:
+        mp3_data = mp3_file.read()
+
+    # ID3v2.3 tag with 4096 bytes of (empty) frames
+    id3_tag = b'ID3\x03\x00\x00\x00\x00\x20\x00' + b'\x00' * 4096
+    info = mp3.probe(BytesIO(id3_tag + mp3_data), max_bytes=1024)
+
+    assert info['valid']
+    assert info['id3v2_size'] == len(id3_tag)
+    assert info['offset'] == len(id3_tag)
+
+    assert mp3.probe(id3_tag + mp3_data, max_bytes=1024)['valid']
+
+
+def test_probe_invalid_data():
+    """
+    Test probing of non-MP3 data.
+
+    EXPECTED: the data is rejected with a reason.
+    """
+
+    for data in (b'', b'\x00' * 8000, b'RIFF\x00\x00\x00\x00WAVEfmt ' + b'\x00' * 1000, random.Random(1).randbytes(64 * 1024)):
+        info = mp3.probe(data)
+        assert not info['valid']
+        assert info['reason']
+
+    # A single random frame sync is not enough
+    info = mp3.probe(b'\x00' * 100 + b'\xff\xfb\x90\x00' + b'\x00' * 100)
+    assert not info['valid']
+
+    with pytest.raises(ValueError):
+        mp3.probe(b'', max_bytes=0)
@@ -0,0 +1,76 @@
+from io import BytesIO
+import os
+import pytest
+
+import mp3
+
+
+DATA_DIR = os.path.join(os.path.dirname(__file__), 'data')
+
+
+def _duration(mp3_data):
+    reader = mp3.Decoder(BytesIO(mp3_data))
+    pcm_data = reader.read()
+    return len(pcm_data) / (2.0 * reader.get_channels() * reader.get_sample_rate()), reader
+
+
+def test_transcode(encode_sine):
+    """
+    Test transcoding of stereo 44100 Hz 128 kbps to mono 16000 Hz 32 kbps (downmix and resampling)
+
+    EXPECTED: the output has the requested format and the same duration
+    """
+    mp3_data = encode_sine(3.0, channels=2)
+
+    output_fp = BytesIO()
+    written = mp3.transcode(BytesIO(mp3_data), output_fp, bit_rate=32, sample_rate=16000, channels=1)
+    assert written == len(output_fp.getvalue())
+    assert written < len(mp3_data) / 3
+
+    duration, reader = _duration(output_fp.getvalue())
+    assert reader.get_channels() == 1
+    assert reader.get_sample_rate() == 16000
+    assert reader.get_bit_rate() == 32
+    assert duration == pytest.approx(3.0, abs=0.2)
+
+    # The source can be bytes-like object, and the result is returned as bytes without destination
+    assert mp3.transcode(mp3_data, None, bit_rate=32, sample_rate=16000, channels=1) == output_fp.getvalue()
+    assert mp3.transcode(memoryview(mp3_data), None, bit_rate=32, sample_rate=16000, channels=1) == output_fp.getvalue()
+
+
+def test_transcode_keep_format():
+    """
+    Test transcoding with the default sample rate and channels (upmix of mono source)
+
+    EXPECTED: the sample rate and channels of the source are kept, unless requested otherwise
+    """
+    with open(os.path.join(DATA_DIR, 'silence-16KHz-mono-32kbps-0.6s.mp3'), 'rb') as mp3_file:
+        mp3_data = mp3_file.read()
+
+    _, reader = _duration(mp3.transcode(mp3_data, None, bit_rate=24))
+    assert reader.get_channels() == 1
+    assert reader.get_sample_rate() == 16000
+    assert reader.get_bit_rate() == 24
+
+    _, reader = _duration(mp3.transcode(mp3_data, None, bit_rate=64, channels=2))
+    assert reader.get_channels() == 2
+    assert reader.get_sample_rate() == 16000
+
+
+def test_transcode_errors():
+    """
+    Test transcoding of invalid data and invalid arguments
+
+    EXPECTED: ValueError/TypeError is raised
+    """
+    with pytest.raises(ValueError):
+        mp3.transcode(b'\x00' * 8000, BytesIO())
+
+    with pytest.raises(ValueError):
+        mp3.transcode(b'', None, channels=3)
+
+    with pytest.raises(TypeError):
+        mp3.transcode(object(), BytesIO())
+
+    with pytest.raises(TypeError):
+        mp3.transcode(b'', object())